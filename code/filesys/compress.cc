@@ -0,0 +1,202 @@
+// compress.cc
+//	Routines to compress and decompress file data (cf. compress.h).
+//
+//	The compressor is greedy: at each position, it looks up the last
+//	place the next MinMatch bytes were seen, in a hash table, and if
+//	they really match there, extends the match as far as it goes and
+//	codes it as a back reference.  Otherwise the byte is a literal.
+//
+//	The decompressor checks every length and distance against the
+//	buffers, so that corrupt data (say, an extent whose new contents
+//	never reached the disk before a crash) can't make it run wild.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "compress.h"
+#include "utility.h"
+
+// Size of the hash table of recently seen positions, as a power of two
+#define HashBits		10
+
+// Furthest back a match can be
+#define MaxDistance		0xffff
+
+//----------------------------------------------------------------------
+// Hash
+// 	Hash the MinMatch bytes starting at "p".
+//----------------------------------------------------------------------
+
+static int
+Hash(unsigned char *p)
+{
+    unsigned int v = p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+
+    return (v * 2654435761U) >> (32 - HashBits);
+}
+
+//----------------------------------------------------------------------
+// PutLength
+// 	Append the bytes that extend a length of 15 or more in a token.
+//	Return where the output continues, or NULL if it is full.
+//----------------------------------------------------------------------
+
+static unsigned char *
+PutLength(unsigned char *op, unsigned char *limit, int length)
+{
+    for (length -= 15; length >= 255; length -= 255) {
+	if (op == limit)
+	    return NULL;
+	*op++ = 255;
+    }
+    if (op == limit)
+	return NULL;
+    *op++ = length;
+    return op;
+}
+
+//----------------------------------------------------------------------
+// PutSequence
+// 	Append one sequence: "numLiterals" literals, then a match of
+//	"match" bytes, "distance" bytes back (none, if "match" is 0).
+//	Return where the output continues, or NULL if it is full.
+//----------------------------------------------------------------------
+
+static unsigned char *
+PutSequence(unsigned char *op, unsigned char *limit, unsigned char *literals,
+	    int numLiterals, int distance, int match)
+{
+    int matchCode = (match > 0) ? match - MinMatch : 0;
+
+    if (op == limit)
+	return NULL;
+    *op++ = (min(numLiterals, 15) << 4) | min(matchCode, 15);
+    if (numLiterals >= 15 && (op = PutLength(op, limit, numLiterals)) == NULL)
+	return NULL;
+    if (limit - op < numLiterals)
+	return NULL;
+    bcopy(literals, op, numLiterals);
+    op += numLiterals;
+    if (match == 0)
+	return op;
+    if (limit - op < 2)
+	return NULL;
+    *op++ = distance & 0xff;
+    *op++ = distance >> 8;
+    if (matchCode >= 15)
+	op = PutLength(op, limit, matchCode);
+    return op;
+}
+
+//----------------------------------------------------------------------
+// Compress
+// 	Compress "length" bytes from "from" into "to".  Return the length
+//	of the compressed data, or -1 if it would take more than
+//	"capacity" bytes.
+//----------------------------------------------------------------------
+
+int
+Compress(char *from, int length, char *to, int capacity)
+{
+    unsigned char *in = (unsigned char *) from;
+    unsigned char *op = (unsigned char *) to;
+    unsigned char *limit = op + capacity;
+    int *table = new int[1 << HashBits];
+    int anchor = 0, i = 0;		// literals start at "anchor"
+
+    for (int h = 0; h < (1 << HashBits); h++)
+	table[h] = -1;
+    while (i + MinMatch <= length) {
+	int h = Hash(in + i);
+	int ref = table[h];
+	int match = 0;
+
+	table[h] = i;
+	if (ref >= 0 && i - ref <= MaxDistance)
+	    while (i + match < length && in[ref + match] == in[i + match])
+		match++;
+	if (match < MinMatch) {
+	    i++;
+	    continue;
+	}
+	op = PutSequence(op, limit, in + anchor, i - anchor, i - ref, match);
+	if (op == NULL)
+	    break;
+	i += match;
+	anchor = i;
+    }
+    if (op != NULL)
+	op = PutSequence(op, limit, in + anchor, length - anchor, 0, 0);
+    delete [] table;
+    return (op == NULL) ? -1 : op - (unsigned char *) to;
+}
+
+//----------------------------------------------------------------------
+// GetLength
+// 	Read the bytes that extend a length of 15 in a token, adding them
+//	to "*length".  Return where the input continues, or NULL if it
+//	runs out.
+//----------------------------------------------------------------------
+
+static unsigned char *
+GetLength(unsigned char *ip, unsigned char *end, int *length)
+{
+    int b;
+
+    do {
+	if (ip == end)
+	    return NULL;
+	b = *ip++;
+	*length += b;
+    } while (b == 255);
+    return ip;
+}
+
+//----------------------------------------------------------------------
+// Decompress
+// 	Decompress "length" bytes from "from" into "to".  Return the
+//	length of the decompressed data, or -1 if the data is corrupt or
+//	would take more than "capacity" bytes.
+//----------------------------------------------------------------------
+
+int
+Decompress(char *from, int length, char *to, int capacity)
+{
+    unsigned char *ip = (unsigned char *) from;
+    unsigned char *end = ip + length;
+    unsigned char *op = (unsigned char *) to;
+    unsigned char *limit = op + capacity;
+
+    while (ip < end) {
+	int token = *ip++;
+	int numLiterals = token >> 4;
+	int match = token & 15;
+	int distance;
+
+	if (numLiterals == 15 && (ip = GetLength(ip, end, &numLiterals)) == NULL)
+	    return -1;
+	if (numLiterals > end - ip || numLiterals > limit - op)
+	    return -1;
+	bcopy(ip, op, numLiterals);
+	ip += numLiterals;
+	op += numLiterals;
+	if (ip == end)
+	    break;			// the last sequence
+
+	if (end - ip < 2)
+	    return -1;
+	distance = ip[0] | (ip[1] << 8);
+	ip += 2;
+	if (match == 15 && (ip = GetLength(ip, end, &match)) == NULL)
+	    return -1;
+	match += MinMatch;
+	if (distance == 0 || distance > op - (unsigned char *) to
+	    || match > limit - op)
+	    return -1;
+	for (int i = 0; i < match; i++, op++)	// may overlap itself
+	    *op = *(op - distance);
+    }
+    return op - (unsigned char *) to;
+}
@@ -0,0 +1,40 @@
+// compress.h
+//	A fast, simple compressor for file data, in the style of LZ4:
+//	the data is coded as a series of literal bytes and back
+//	references ("copy so many bytes from so far back"), with no
+//	entropy coding, so that decompressing costs little more than
+//	copying.  Used for compressed files (cf. filehdr.h).
+//
+//	Each sequence in the compressed data is:
+//	   a token byte: the number of literals in the high four bits,
+//	     the length of the match, less MinMatch, in the low four
+//	   if the number of literals is 15 or more, further bytes to add
+//	     to it, each 255 except the last
+//	   the literals themselves
+//	   the distance back to the match, two bytes, low byte first
+//	   if the match length is 15 or more (after taking off MinMatch),
+//	     further bytes to add to it, as for the literals
+//	The last sequence has only literals; the data ends after them.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+// Shortest repeat worth coding as a back reference
+#define MinMatch		4
+
+extern int Compress(char *from, int length, char *to, int capacity);
+					// Compress "length" bytes; return
+					// the compressed length, or -1 if
+					// it is more than "capacity"
+extern int Decompress(char *from, int length, char *to, int capacity);
+					// Undo Compress; return the original
+					// length, or -1 if the data is bad
+					// or won't fit in "capacity"
+
+#endif // COMPRESS_H
@@ -7,14 +7,19 @@
 //	of each directory entry means that we have the restriction
 //	of a fixed maximum size for file names.
 //
+//	The table is a hash table with linear probing: a name is stored
+//	in the first free slot at or after the slot its hash selects.
+//	When the table is three quarters full it is doubled and every
+//	entry is rehashed, so the directory file grows along with the
+//	number of files in it; the caller is responsible for extending
+//	the file on disk before writing the larger table back.
+//
 //	The constructor initializes an empty directory of a certain size;
 //	we use ReadFrom/WriteBack to fetch the contents of the directory
 //	from disk, and to write back any modifications back to disk.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
-//	Fixing this is one of the parts to the assignment.
+//	This file also implements the dentry cache, which remembers the
+//	results of recent name lookups.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -23,8 +28,24 @@
 #include "copyright.h"
 #include "utility.h"
 #include "filehdr.h"
+#include "filesys.h"
 #include "directory.h"
 
+//----------------------------------------------------------------------
+// HashName
+// 	Hash a file name, to choose where in the table to look for it.
+//----------------------------------------------------------------------
+
+static unsigned int
+HashName(char *name)
+{
+    unsigned int hash = 5381;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++)
+	hash = hash * 33 + (unsigned char) name[i];
+    return hash;
+}
+
 //----------------------------------------------------------------------
 // Directory::Directory
 // 	Initialize a directory; initially, the directory is completely
@@ -32,15 +53,19 @@
 //	is all we need, but otherwise, we need to call FetchFrom in order
 //	to initialize it from disk.
 //
-//	"size" is the number of entries in the directory
+//	"size" is the number of entries in the directory; a power of two
 //----------------------------------------------------------------------
 
 Directory::Directory(int size)
 {
+    ASSERT(size > 0 && (size & (size - 1)) == 0);
     table = new DirectoryEntry[size];
     tableSize = size;
+    numEntries = 0;
     for (int i = 0; i < tableSize; i++)
 	table[i].inUse = FALSE;
+    dirtyLow = 0;			// nothing on disk yet, so
+    dirtyHigh = tableSize;		//   the whole table must be written
 }
 
 //----------------------------------------------------------------------
@@ -55,7 +80,9 @@ Directory::~Directory()
 
 //----------------------------------------------------------------------
 // Directory::FetchFrom
-// 	Read the contents of the directory from disk.
+// 	Read the contents of the directory from disk.  The table on disk
+//	may be bigger than the one we were constructed with, in which
+//	case we re-allocate ours to match.
 //
 //	"file" -- file containing the directory contents
 //----------------------------------------------------------------------
@@ -63,12 +90,29 @@ Directory::~Directory()
 void
 Directory::FetchFrom(OpenFile *file)
 {
-    (void) file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    int header[2];
+
+    (void) file->ReadAt((char *)header, DirectoryHeaderSize, 0);
+    if (header[0] != tableSize) {
+	delete [] table;
+	tableSize = header[0];
+	table = new DirectoryEntry[tableSize];
+    }
+    numEntries = header[1];
+    (void) file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry),
+			DirectoryHeaderSize);
+    dirtyLow = tableSize;		// in-memory copy matches the disk
+    dirtyHigh = 0;
 }
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
-// 	Write any modifications to the directory back to disk
+// 	Write any modifications to the directory back to disk.  The file
+//	must already be at least FileSize() bytes long.
+//
+//	Only the header and the range of entries changed since the
+//	directory was fetched are written, so that adding or removing
+//	a file touches a sector or two rather than the whole table.
 //
 //	"file" -- file to contain the new directory contents
 //----------------------------------------------------------------------
@@ -76,13 +120,54 @@ Directory::FetchFrom(OpenFile *file)
 void
 Directory::WriteBack(OpenFile *file)
 {
-    (void) file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    int header[2];
+
+    ASSERT(file->Length() >= FileSize());
+    header[0] = tableSize;
+    header[1] = numEntries;
+    (void) file->WriteAt((char *)header, DirectoryHeaderSize, 0);
+    if (dirtyLow < dirtyHigh)
+	(void) file->WriteAt((char *)&table[dirtyLow],
+			(dirtyHigh - dirtyLow) * sizeof(DirectoryEntry),
+			DirectoryHeaderSize + dirtyLow * sizeof(DirectoryEntry));
+    dirtyLow = tableSize;
+    dirtyHigh = 0;
+}
+
+//----------------------------------------------------------------------
+// Directory::MarkDirty
+// 	Remember that entry "i" has changed and must be written back.
+//----------------------------------------------------------------------
+
+void
+Directory::MarkDirty(int i)
+{
+    if (i < dirtyLow)
+	dirtyLow = i;
+    if (i + 1 > dirtyHigh)
+	dirtyHigh = i + 1;
+}
+
+//----------------------------------------------------------------------
+// Directory::FileSize
+// 	Return the number of bytes needed to store the directory on disk.
+//----------------------------------------------------------------------
+
+int
+Directory::FileSize()
+{
+    return DirectoryHeaderSize + tableSize * sizeof(DirectoryEntry);
 }
 
 //----------------------------------------------------------------------
 // Directory::FindIndex
 // 	Look up file name in directory, and return its location in the table of
-//	directory entries.  Return -1 if the name isn't in the directory.
+//	directory entries.  Return -1 if the name isn't in the directory
+//	-- as a name too long to store can't be, though its first
+//	FileNameMaxLen characters may match one that is.
+//
+//	Starting from the slot selected by the name's hash, probe
+//	successive slots until we find the name or reach a free slot.
 //
 //	"name" -- the file name to look up
 //----------------------------------------------------------------------
@@ -90,21 +175,16 @@ Directory::WriteBack(OpenFile *file)
 int
 Directory::FindIndex(char *name)
 {
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse && !strcmp(table[i].name, name))
+    int mask = tableSize - 1;
+
+    if (strlen(name) > FileNameMaxLen)
+	return -1;
+    for (int i = HashName(name) & mask; table[i].inUse; i = (i + 1) & mask)
+        if (!strncmp(table[i].name, name, FileNameMaxLen))
 	    return i;
     return -1;		// name not in directory
 }
 
-int
-Directory::FindIndexByFullPath(char *fullPath)
-{
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse && !strcmp(table[i].fullPath, fullPath))
-        return i;
-    return -1;      // name not in directory
-}
-
 //----------------------------------------------------------------------
 // Directory::Find
 // 	Look up file name in directory, and return the disk sector number
@@ -112,52 +192,89 @@ Directory::FindIndexByFullPath(char *fullPath)
 //	in the directory.
 //
 //	"name" -- the file name to look up
+//	"type" -- if not NULL, set to the type of the file
 //----------------------------------------------------------------------
 
 int
-Directory::Find(char *name)
+Directory::Find(char *name, int *type)
 {
     int i = FindIndex(name);
 
-    if (i != -1)
-	return table[i].sector;
-    return -1;
+    if (i == -1)
+	return -1;
+    if (type != NULL)
+	*type = table[i].type;
+    return table[i].sector;
+}
+
+//----------------------------------------------------------------------
+// Directory::Grow
+// 	Double the size of the table, re-inserting every entry at the
+//	position its hash selects in the larger table.
+//----------------------------------------------------------------------
+
+void
+Directory::Grow()
+{
+    DirectoryEntry *oldTable = table;
+    int oldSize = tableSize;
+    int mask;
+
+    tableSize = oldSize * 2;
+    mask = tableSize - 1;
+    table = new DirectoryEntry[tableSize];
+    for (int i = 0; i < tableSize; i++)
+	table[i].inUse = FALSE;
+    for (int i = 0; i < oldSize; i++)
+	if (oldTable[i].inUse) {
+	    int j = HashName(oldTable[i].name) & mask;
+	    while (table[j].inUse)
+		j = (j + 1) & mask;
+	    table[j] = oldTable[i];
+	}
+    DEBUG('f', "Directory grown from %d to %d entries\n", oldSize, tableSize);
+    delete [] oldTable;
+    dirtyLow = 0;			// every entry may have moved
+    dirtyHigh = tableSize;
 }
 
 //----------------------------------------------------------------------
 // Directory::Add
 // 	Add a file into the directory.  Return TRUE if successful;
-//	return FALSE if the file name is already in the directory, or if
-//	the directory is completely full, and has no more space for
-//	additional file names.
+//	return FALSE if the file name is already in the directory, or
+//	is too long to be stored.
+//
+//	If the table is getting full, it is doubled first; in that
+//	case FileSize() grows, and the caller has to extend the file
+//	holding the directory before calling WriteBack.
 //
 //	"name" -- the name of the file being added
 //	"newSector" -- the disk sector containing the added file's header
+//	"type" -- RegularFileType or DirectoryFileType
 //----------------------------------------------------------------------
 
 bool
-Directory::Add(char *name, int newSector, int type, char *path)
+Directory::Add(char *name, int newSector, int type)
 { 
-    char fullPath[50] = "\0";
-    strcat(fullPath, path);
-    strcat(fullPath, "\/");
-    strcat(fullPath, name);
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].fullPath != NULL && !strcmp(table[i].fullPath, fullPath))
-            return FALSE;
-    
-    for (int i = 0; i < tableSize; i++)
-        if (!table[i].inUse) {
-            table[i].inUse = TRUE;
-            // strncpy(table[i].name, name, FileNameMaxLen); 
-            table[i].name = name;
-            table[i].sector = newSector;
-            table[i].type = type;
-            table[i].path = path;
-            strcpy(table[i].fullPath, fullPath);
-        return TRUE;
-	}
-    return FALSE;	// no space.  Fix when we have extensible files.
+    int mask, i;
+
+    if (strlen(name) > FileNameMaxLen || FindIndex(name) != -1)
+        return FALSE;
+
+    if (4 * (numEntries + 1) > 3 * tableSize)	// keep probe chains short
+	Grow();
+
+    mask = tableSize - 1;
+    for (i = HashName(name) & mask; table[i].inUse; i = (i + 1) & mask)
+	;
+    table[i].inUse = TRUE;
+    table[i].type = type;
+    table[i].sector = newSector;
+    strncpy(table[i].name, name, FileNameMaxLen);
+    table[i].name[FileNameMaxLen] = '\0';
+    numEntries++;
+    MarkDirty(i);
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -165,42 +282,68 @@ Directory::Add(char *name, int newSector, int type, char *path)
 // 	Remove a file name from the directory.  Return TRUE if successful;
 //	return FALSE if the file isn't in the directory. 
 //
+//	With linear probing we can't just mark the slot free, since that
+//	would cut the probe chain of any entry stored after it.  Instead,
+//	entries that follow in the chain are shifted back into the hole
+//	whenever their home slot does not lie between the hole and them.
+//
 //	"name" -- the file name to be removed
 //----------------------------------------------------------------------
 
 bool
-Directory::Remove(char *fullPath)
+Directory::Remove(char *name)
 { 
-    int i = FindIndexByFullPath(fullPath);
+    int mask = tableSize - 1;
+    int i = FindIndex(name);
 
     if (i == -1)
 	return FALSE; 		// name not in directory
-    if (table[i].type == 0) {
-        table[i].inUse = FALSE;
-        return TRUE;    
+    table[i].inUse = FALSE;
+    numEntries--;
+    MarkDirty(i);
+
+    for (int j = (i + 1) & mask; table[j].inUse; j = (j + 1) & mask) {
+	int home = HashName(table[j].name) & mask;
+	bool stays = (i <= j) ? (i < home && home <= j)
+			      : (i < home || home <= j);
+	if (!stays) {
+	    table[i] = table[j];
+	    table[j].inUse = FALSE;
+	    i = j;
+	    MarkDirty(i);
+	}
     }
-    else {
-        for (int j = 0; j < tableSize; ++j) {
-            if (!strcmp(table[j].path, fullPath)) {
-                Remove(table[j].fullPath);
-                table[j].inUse = FALSE;
-            }
-        }
-        return TRUE;
-    }    
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
 // Directory::List
-// 	List all the file names in the directory. 
+// 	List all the file names in the directory, and recursively in
+//	every subdirectory, as full path names.
+//
+//	"prefix" -- the path name of this directory ("" for the root)
 //----------------------------------------------------------------------
 
 void
-Directory::List()
+Directory::List(char *prefix)
 {
-   for (int i = 0; i < tableSize; i++)
-	if (table[i].inUse)
-	    printf("%s\n", table[i].fullPath);
+    char *path = new char[strlen(prefix) + FileNameMaxLen + 2];
+
+    for (int i = 0; i < tableSize; i++)
+	if (table[i].inUse) {
+	    sprintf(path, "%s/%s", prefix, table[i].name);
+	    printf("%s\n", path);
+	    if (table[i].type == DirectoryFileType) {
+		OpenFile *file = new OpenFile(table[i].sector);
+		Directory *subdir = new Directory(NumDirEntries);
+
+		subdir->FetchFrom(file);
+		subdir->List(path);
+		delete subdir;
+		delete file;
+	    }
+	}
+    delete [] path;
 }
 
 //----------------------------------------------------------------------
@@ -214,13 +357,159 @@ Directory::Print()
 { 
     FileHeader *hdr = new FileHeader;
 
-    printf("Directory contents:\n");
+    printf("Directory contents (%d of %d entries used):\n",
+	   numEntries, tableSize);
     for (int i = 0; i < tableSize; i++)
 	if (table[i].inUse) {
-	    printf("Name: %s, Sector: %d\n", table[i].name, table[i].sector);
+	    printf("Name: %s, Sector: %d%s\n", table[i].name, table[i].sector,
+		   table[i].type == DirectoryFileType ? " (directory)" : "");
 	    hdr->FetchFrom(table[i].sector);
 	    hdr->Print();
 	}
     printf("\n");
     delete hdr;
-}
\ No newline at end of file
+}
+
+//----------------------------------------------------------------------
+// DentryCache::DentryCache
+// 	Initialize an empty dentry cache.
+//
+//	"size" is the maximum number of names to remember
+//----------------------------------------------------------------------
+
+DentryCache::DentryCache(int size)
+{
+    numEntries = size;
+    entries = new Dentry[size];
+    buckets = new Dentry *[size];
+    clock = 0;
+    for (int i = 0; i < size; i++) {
+	entries[i].valid = FALSE;
+	buckets[i] = NULL;
+    }
+}
+
+//----------------------------------------------------------------------
+// DentryCache::~DentryCache
+// 	De-allocate the dentry cache.
+//----------------------------------------------------------------------
+
+DentryCache::~DentryCache()
+{
+    delete [] entries;
+    delete [] buckets;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::FindSlot
+// 	Return the link in the hash chain that points to the entry for
+//	<dirSector, name>, or to NULL at the end of the chain if there
+//	is no such entry.
+//----------------------------------------------------------------------
+
+Dentry **
+DentryCache::FindSlot(int dirSector, char *name)
+{
+    Dentry **link = &buckets[(HashName(name) + dirSector) % numEntries];
+
+    for (; *link != NULL; link = &(*link)->hashNext)
+	if ((*link)->dirSector == dirSector
+		&& !strncmp((*link)->name, name, FileNameMaxLen))
+	    break;
+    return link;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Unlink
+// 	Take an entry off its hash chain and mark it free.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Unlink(Dentry *dentry)
+{
+    Dentry **link = FindSlot(dentry->dirSector, dentry->name);
+
+    ASSERT(*link == dentry);
+    *link = dentry->hashNext;
+    dentry->valid = FALSE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Lookup
+// 	Look for <dirSector, name> in the cache.  Return TRUE if found,
+//	setting "sector" (-1 if the name is known not to exist) and "type".
+//----------------------------------------------------------------------
+
+bool
+DentryCache::Lookup(int dirSector, char *name, int *sector, int *type)
+{
+    Dentry *dentry = *FindSlot(dirSector, name);
+
+    if (dentry == NULL)
+	return FALSE;
+    dentry->lastUse = ++clock;
+    *sector = dentry->sector;
+    if (type != NULL)
+	*type = dentry->type;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Insert
+// 	Remember the result of looking up "name" in directory "dirSector".
+//	If the cache is full, replace the least recently used entry.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Insert(int dirSector, char *name, int sector, int type)
+{
+    Dentry **link = FindSlot(dirSector, name);
+    Dentry *dentry = *link;
+
+    if (dentry == NULL) {
+	dentry = &entries[0];
+	for (int i = 0; i < numEntries && dentry->valid; i++)
+	    if (!entries[i].valid || entries[i].lastUse < dentry->lastUse)
+		dentry = &entries[i];
+	if (dentry->valid)
+	    Unlink(dentry);
+	dentry->dirSector = dirSector;
+	strncpy(dentry->name, name, FileNameMaxLen);
+	dentry->name[FileNameMaxLen] = '\0';
+	link = FindSlot(dirSector, name);	// chain may have changed
+	dentry->hashNext = NULL;
+	*link = dentry;
+	dentry->valid = TRUE;
+    }
+    dentry->sector = sector;
+    dentry->type = type;
+    dentry->lastUse = ++clock;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Invalidate
+// 	Forget anything we know about "name" in directory "dirSector".
+//----------------------------------------------------------------------
+
+void
+DentryCache::Invalidate(int dirSector, char *name)
+{
+    Dentry *dentry = *FindSlot(dirSector, name);
+
+    if (dentry != NULL)
+	Unlink(dentry);
+}
+
+//----------------------------------------------------------------------
+// DentryCache::InvalidateDirectory
+// 	Forget every name cached for directory "dirSector" -- called
+//	when the directory itself is deleted.
+//----------------------------------------------------------------------
+
+void
+DentryCache::InvalidateDirectory(int dirSector)
+{
+    for (int i = 0; i < numEntries; i++)
+	if (entries[i].valid && entries[i].dirSector == dirSector)
+	    Unlink(&entries[i]);
+}
@@ -6,6 +6,11 @@
 //	where to find its file header (the data structure describing
 //	where to find the file's data blocks) on disk.
 //
+//	The table is an open-addressed hash table keyed by file name, so
+//	that looking up a name does not require scanning every entry.
+//	The table doubles in size whenever it becomes too full, so a
+//	directory can hold any number of files.
+//
 //      We assume mutual exclusion is provided by the caller.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -22,6 +27,16 @@
 #define FileNameMaxLen 		9	// for simplicity, we assume 
 					// file names are <= 9 characters long
 
+// Initial number of entries in a new directory; must be a power of two.
+// The table grows (by doubling) as files are added.
+#define NumDirEntries 		8
+
+// A directory file starts with a small header -- the size of the table
+// and the number of entries in use -- followed by the table itself.
+#define DirectoryHeaderSize	(2 * sizeof(int))
+#define DirectoryFileSize 	(DirectoryHeaderSize + \
+				 sizeof(DirectoryEntry) * NumDirEntries)
+
 // The following class defines a "directory entry", representing a file
 // in the directory.  Each entry gives the name of the file, and where
 // the file's header is to be found on disk.
@@ -32,14 +47,11 @@
 class DirectoryEntry {
   public:
     bool inUse;				// Is this directory entry in use?
+    char type;				// RegularFileType or DirectoryFileType
     int sector;				// Location on disk to find the 
 					//   FileHeader for this file 
-    // char name[FileNameMaxLen + 1];	// Text name for file, with +1 for 
-				// 	// the trailing '\0'
-    char *name;
-    char *path;
-    char fullPath[50];
-    int type;
+    char name[FileNameMaxLen + 1];	// Text name for file, with +1 for
+					// the trailing '\0'
 };
 
 // The following class defines a UNIX-like "directory".  Each entry in
@@ -62,27 +74,88 @@ class Directory {
     void WriteBack(OpenFile *file);	// Write modifications to 
 					// directory contents back to disk
 
-    int Find(char *name);		// Find the sector number of the 
+    int Find(char *name, int *type = NULL);
+					// Find the sector number of the
 					// FileHeader for file: "name"
 
-    bool Add(char *name, int newSector, int type = 0, char *path = "");  // Add a file name into the directory
+    bool Add(char *name, int newSector, int type = 0);
+					// Add a file name into the directory
 
     bool Remove(char *name);		// Remove a file from the directory
 
-    void List();			// Print the names of all the files
-					//  in the directory
+    bool IsEmpty() { return numEntries == 0; }
+    int FileSize();			// Number of bytes the directory
+					// occupies when written to disk
+
+    void List(char *prefix);		// Print the names of all the files
+					//  in the directory, and in all
+					//  of its subdirectories
     void Print();			// Verbose print of the contents
 					//  of the directory -- all the file
 					//  names and their contents.
 
+    DirectoryEntry *GetEntry(int i)	// Entry "i" of the table, or NULL
+	{ return table[i].inUse ? &table[i] : NULL; }
+    int TableSize() { return tableSize; }
+
   private:
-    int tableSize;			// Number of directory entries
+    int tableSize;			// Number of directory entries,
+					//  always a power of two
+    int numEntries;			// Number of entries in use
     DirectoryEntry *table;		// Table of pairs: 
 					// <file name, file header location> 
+    int dirtyLow, dirtyHigh;		// Range of entries changed since
+					//  the last FetchFrom/WriteBack
 
     int FindIndex(char *name);		// Find the index into the directory 
 					//  table corresponding to "name"
-    int FindIndexByFullPath(char *fullPath);
+    void Grow();			// Double the size of the table
+    void MarkDirty(int i);		// Entry "i" must be written back
+};
+
+// The following class defines a cache of recently used directory
+// entries ("dentries").  Each entry maps a <directory, name> pair to
+// the sector holding that file's header, so that resolving a path
+// name does not have to read every directory along the way from disk.
+//
+// Names that were looked up and not found are cached too (with
+// sector -1), so repeated failing lookups are also cheap.  Any
+// operation that changes a directory must update the cache to match.
+
+class Dentry {
+  public:
+    bool valid;				// Is this cache entry in use?
+    int dirSector;			// Header sector of the directory
+    char name[FileNameMaxLen + 1];	// Name within that directory
+    int sector;				// Header sector of the file, or -1
+    int type;				// RegularFileType or DirectoryFileType
+    int lastUse;			// For LRU replacement
+    Dentry *hashNext;			// Next entry in the same hash bucket
+};
+
+class DentryCache {
+  public:
+    DentryCache(int size);		// Initialize an empty cache
+    ~DentryCache();
+
+    bool Lookup(int dirSector, char *name, int *sector, int *type);
+					// Return TRUE if <dirSector, name>
+					// is cached, along with its result
+    void Insert(int dirSector, char *name, int sector, int type);
+					// Remember the result of a lookup
+    void Invalidate(int dirSector, char *name);
+					// Forget a single name
+    void InvalidateDirectory(int dirSector);
+					// Forget every name in a directory
+
+  private:
+    int numEntries;			// Number of cache entries
+    Dentry *entries;			// The cache entries themselves
+    Dentry **buckets;			// Hash chains, numEntries long
+    int clock;				// Logical time, for LRU
+
+    Dentry **FindSlot(int dirSector, char *name);
+    void Unlink(Dentry *dentry);
 };
 
 #endif // DIRECTORY_H
@@ -10,8 +10,9 @@
 //	blocks). The table size is chosen so that the file header
 //	will be just big enough to fit in one disk sector, 
 //
-//      Unlike in a real system, we do not keep track of file permissions, 
-//	ownership, last modification date, etc., in the file header. 
+//      Unlike in a real system, we do not keep track of file permissions
+//	or ownership in the file header; we do keep the times the file
+//	was created, last read and last written, as seconds since 1970.
 //
 //	A file header can be initialized in two ways:
 //	   for a new file, by modifying the in-memory data structure
@@ -27,6 +28,20 @@
 #include "system.h"
 #include "filehdr.h"
 #include <time.h>
+
+//----------------------------------------------------------------------
+// TimeString
+// 	Return a printable version of a time kept in a file header.
+//----------------------------------------------------------------------
+
+static char *
+TimeString(int t)
+{
+    time_t rawtime = t;
+
+    return ctime(&rawtime);
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Allocate
 // 	Initialize a fresh file header for a newly created file.
@@ -34,14 +49,20 @@
 //	Return FALSE if there are not enough free blocks to accomodate
 //	the new file.
 //
+//	A compressed file starts out as nothing but holes, since we don't
+//	know how small its data will get; only the sector for the sizes of
+//	its extents is allocated, and written out, all 0.
+//
 //	"freeMap" is the bit map of free disk sectors
 //	"fileSize" is the bit map of free disk sectors
+//	"compressed" -- should the file be compressed?
 //----------------------------------------------------------------------
 
 bool
-FileHeader::Allocate(BitMap *freeMap, int fileSize)
+FileHeader::Allocate(FreeMap *freeMap, int fileSize, bool compressed)
 { 
     numBytes = fileSize;
+    compressMap = 0;
     numSectors  = divRoundUp(fileSize, SectorSize);
     int leftSectors;
     int leftSecondBlock;
@@ -59,87 +80,215 @@ FileHeader::Allocate(BitMap *freeMap, int fileSize)
         totalSectors = numSectors + leftSecondBlock;
         printf("leftSecondBlock: %d, totalSectors: %d\n", leftSecondBlock, totalSectors);
     }
-    if (freeMap->NumClear() < totalSectors)
+    if (compressed)
+	totalSectors = 1;
+    if (!freeMap->HasFree(totalSectors))
 	return FALSE;		// not enough space
-    if (numSectors <= FirstIndex) {
-        for (int i = 0; i < numSectors; i++)
-            dataSectors[i] = freeMap->Find();
-    }
-    else {
-         for (int i = 0; i < FirstIndex; i++)
-            dataSectors[i] = freeMap->Find();
-        for (int j = 0; j < leftSecondBlock; ++j) {
-            dataSectors[FirstIndex + j] = freeMap->Find();
-            int cnt;
-            if (leftSectors <= 0)
-                break;
-            if (leftSectors > SecondDirect)
-                cnt = SecondDirect;
-            else
-                cnt = leftSectors;
-            int *sector = new int[cnt];
-            for (int k = 0; k < cnt; ++k) {
-                sector[k] = freeMap->Find();
-            }
-            synchDisk->WriteSector(dataSectors[FirstIndex + j], (char *)sector);
-            delete sector;
-            leftSectors -= SecondDirect;
-        }
+    for (int i = 0; i < TotalIndex; i++)
+	dataSectors[i] = 0;			// all holes, to start with
+    if (compressed) {
+	int *sizes = new int[MaxExtents];
+
+	compressMap = freeMap->Find();
+	bzero(sizes, MaxExtents * sizeof(int));
+	WriteExtentSizes(sizes);
+	delete [] sizes;
+    } else {
+	int *sectors = new int[numSectors + 1];
+
+	bzero(sectors, (numSectors + 1) * sizeof(int));
+	AllocateBlocks(freeMap, 0, numSectors, sectors);
+	delete [] sectors;
     }
     freeMap->Print();
     setCreateTime();
-    printf("File created! CreateTime: %s\n", createTime);
-    setLastAccessTime();
-    setLastModifiedTime();
+    printf("File created! CreateTime: %s\n", TimeString(createTime));
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// FileHeader::AllocateBlocks
+// 	Give each hole among the "count" blocks of the file starting at
+//	block "first" a sector of its own, along with any indirect block
+//	it needs, from the map of free disk blocks.  The indirect blocks
+//	are written to disk; the caller must write back the header and
+//	the free map.
+//
+//	Return the number of blocks, from "first" on, that are backed by
+//	a sector: "count", unless the disk fills up.
+//
+//	"sectors" -- in: the sector of each block, or 0 for a hole (the
+//		caller's block map); out: the sectors filled in
+//----------------------------------------------------------------------
+
+int
+FileHeader::AllocateBlocks(FreeMap *freeMap, int first, int count,
+			   int *sectors)
+{
+    int *indirect = new int[SecondDirect];
+    int loaded = -1;			// indirect block in "indirect"
+    bool changed = FALSE;		// ... and not yet written
+    int i;
+
+    ASSERT(first + count <= numSectors);
+    for (i = 0; i < count; i++) {
+	int block = first + i;
+	int sector;
+
+	if (sectors[i] != 0)
+	    continue;			// not a hole
+	if (block < FirstIndex) {
+	    if ((sector = freeMap->Find()) == -1)
+		break;
+	    dataSectors[block] = sectors[i] = sector;
+	    continue;
+	}
+	int index = (block - FirstIndex) / SecondDirect;
+	if (index != loaded) {
+	    if (changed)
+		synchDisk->WriteSector(dataSectors[FirstIndex + loaded],
+				       (char *)indirect);
+	    changed = FALSE;
+	    loaded = index;
+	    if (dataSectors[FirstIndex + index] != 0)
+		synchDisk->ReadSector(dataSectors[FirstIndex + index],
+				      (char *)indirect);
+	    else {
+		if ((sector = freeMap->Find()) == -1)
+		    break;
+		printf("New Second Index Block! Point to %d\n", sector);
+		dataSectors[FirstIndex + index] = sector;
+		bzero(indirect, SecondDirect * sizeof(int));
+		changed = TRUE;
+	    }
+	}
+	if ((sector = freeMap->Find()) == -1)
+	    break;
+	indirect[(block - FirstIndex) % SecondDirect] = sectors[i] = sector;
+	changed = TRUE;
+    }
+    if (changed)
+	synchDisk->WriteSector(dataSectors[FirstIndex + loaded],
+			       (char *)indirect);
+    delete [] indirect;
+    return i;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FreeBlocks
+// 	Free the sectors of the "count" blocks of the file starting at
+//	block "first", leaving holes.  The indirect blocks are written to
+//	disk (though not freed, even if they now point only to holes);
+//	the caller must write back the header and the free map.
+//
+//	"sectors" -- in: the sector of each block, or 0 for a hole (the
+//		caller's block map); out: all 0
+//----------------------------------------------------------------------
+
+void
+FileHeader::FreeBlocks(FreeMap *freeMap, int first, int count, int *sectors)
+{
+    int *indirect = new int[SecondDirect];
+    int loaded = -1;			// indirect block in "indirect"
+
+    ASSERT(first + count <= numSectors);
+    for (int i = 0; i < count; i++) {
+	int block = first + i;
+
+	if (sectors[i] == 0)
+	    continue;			// a hole already
+	freeMap->Clear(sectors[i]);
+	sectors[i] = 0;
+	if (block < FirstIndex) {
+	    dataSectors[block] = 0;
+	    continue;
+	}
+	int index = (block - FirstIndex) / SecondDirect;
+	if (index != loaded) {
+	    if (loaded != -1)
+		synchDisk->WriteSector(dataSectors[FirstIndex + loaded],
+				       (char *)indirect);
+	    loaded = index;
+	    synchDisk->ReadSector(dataSectors[FirstIndex + index],
+				  (char *)indirect);
+	}
+	indirect[(block - FirstIndex) % SecondDirect] = 0;
+    }
+    if (loaded != -1)
+	synchDisk->WriteSector(dataSectors[FirstIndex + loaded],
+			       (char *)indirect);
+    delete [] indirect;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FetchExtentSizes
+// FileHeader::WriteExtentSizes
+// 	Read (write) the compressed size of each extent of a compressed
+//	file, MaxExtents of them, from (to) the sector that holds them.
+//----------------------------------------------------------------------
+
+void
+FileHeader::FetchExtentSizes(int *sizes)
+{
+    int *buf = new int[SectorSize / sizeof(int)];
+
+    ASSERT(compressMap != 0 && MaxExtents <= SectorSize / sizeof(int));
+    synchDisk->ReadSector(compressMap, (char *)buf);
+    bcopy(buf, sizes, MaxExtents * sizeof(int));
+    delete [] buf;
+}
+
+void
+FileHeader::WriteExtentSizes(int *sizes)
+{
+    int *buf = new int[SectorSize / sizeof(int)];
+
+    ASSERT(compressMap != 0 && MaxExtents <= SectorSize / sizeof(int));
+    bzero(buf, SectorSize);
+    bcopy(sizes, buf, MaxExtents * sizeof(int));
+    synchDisk->WriteSector(compressMap, (char *)buf);
+    delete [] buf;
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Deallocate
-// 	De-allocate all the space allocated for data blocks for this file.
+// 	De-allocate all the space allocated for data blocks for this file,
+//	for its indirect blocks, and for the sizes of its extents if it is
+//	compressed.  Holes have nothing to free.
 //
 //	"freeMap" is the bit map of free disk sectors
 //----------------------------------------------------------------------
 
 void 
-FileHeader::Deallocate(BitMap *freeMap)
+FileHeader::Deallocate(FreeMap *freeMap)
 {
-    if (numSectors <= FirstIndex) {
-        for (int i = 0; i < numSectors; i++) {
-            ASSERT(freeMap->Test((int) dataSectors[i]));  // ought to be marked!
-            freeMap->Clear((int) dataSectors[i]);
-        }
+    int *indirect = new int[SecondDirect];
+
+    for (int i = 0; i < numSectors && i < FirstIndex; i++)
+	if (dataSectors[i] != 0) {
+	    ASSERT(freeMap->Test(dataSectors[i]));  // ought to be marked!
+	    freeMap->Clear(dataSectors[i]);
+	}
+    for (int j = 0; FirstIndex + j * SecondDirect < numSectors; j++) {
+	int indirectSector = dataSectors[FirstIndex + j];
+	int left = numSectors - FirstIndex - j * SecondDirect;
+
+	if (indirectSector == 0)
+	    continue;			// nothing but holes
+	synchDisk->ReadSector(indirectSector, (char *)indirect);
+	for (int k = 0; k < SecondDirect && k < left; k++)
+	    if (indirect[k] != 0) {
+		ASSERT(freeMap->Test(indirect[k]));  // ought to be marked!
+		freeMap->Clear(indirect[k]);
+	    }
+	ASSERT(freeMap->Test(indirectSector));  // ought to be marked!
+	freeMap->Clear(indirectSector);
     }
-    else {
-        int leftSectors = numSectors - FirstIndex;
-        int leftSecondBlock = leftSectors / SecondDirect;
-        if (leftSectors % SecondDirect != 0)
-            leftSecondBlock += 1;
-         for (int i = 0; i < FirstIndex; i++) {
-            ASSERT(freeMap->Test((int) dataSectors[i]));  // ought to be marked!
-            freeMap->Clear((int) dataSectors[i]);
-         }
-        for (int j = 0; j < leftSecondBlock; ++j) {
-            char *sectorTmp = new char[SectorSize];
-            synchDisk->ReadSector(dataSectors[FirstIndex + j], sectorTmp);
-            int *sector = (int *) sectorTmp;
-            int cnt;
-            if (leftSectors <= 0)
-                break;
-            if (leftSectors > SecondDirect)
-                cnt = SecondDirect;
-            else
-                cnt = leftSectors;
-            for (int k = 0; k < cnt; ++k) {
-                ASSERT(freeMap->Test((int)sector[k]));  // ought to be marked!
-                freeMap->Clear((int)sector[k]);
-            }
-            delete sectorTmp;
-            ASSERT(freeMap->Test((int)dataSectors[FirstIndex + j]));  // ought to be marked!
-            freeMap->Clear((int)dataSectors[FirstIndex + j]);
-            leftSectors -= SecondDirect;
-        }
+    if (compressMap != 0) {
+	ASSERT(freeMap->Test(compressMap));  // ought to be marked!
+	freeMap->Clear(compressMap);
     }
+    delete [] indirect;
 }
 
 //----------------------------------------------------------------------
@@ -189,16 +338,97 @@ FileHeader::ByteToSector(int offset)
         int leftSectors = sectorOffset - FirstIndex;
         int index = leftSectors / SecondDirect;
         int indexOffset = leftSectors % SecondDirect;
+        if (dataSectors[FirstIndex + index] == 0)
+            return 0;                   // the whole indirect block is a hole
         char *sectorTmp = new char[SectorSize];
         synchDisk->ReadSector(dataSectors[FirstIndex + index], sectorTmp);
         int *sector = (int *) sectorTmp;
         int ans = sector[indexOffset];
-        ASSERT(ans > 0);
-        delete sectorTmp;
+        ASSERT(ans >= 0);
+        delete [] sectorTmp;
         return ans;
     }
 }
 
+//----------------------------------------------------------------------
+// FileHeader::LoadBlockMap
+// 	Translate every block of the file, from block "from" on, into the
+//	disk sector storing it, so that the caller can keep the whole
+//	map in memory instead of calling ByteToSector for each access.
+//	Each indirect block is only read from disk once.
+//
+//	"map" -- array to fill in, with room for TotalDirect entries
+//	"from" -- the first block to translate; the entries before it
+//		are assumed to be filled in already
+//
+//	Holes are entered as sector 0.
+//----------------------------------------------------------------------
+
+int
+FileHeader::LoadBlockMap(int *map, int from)
+{
+    int *indirect = NULL;
+    int loaded = -1;			// indirect block in "indirect"
+
+    for (int i = from; i < numSectors; i++) {
+	if (i < FirstIndex) {
+	    map[i] = dataSectors[i];
+	    continue;
+	}
+	int index = (i - FirstIndex) / SecondDirect;
+	if (dataSectors[FirstIndex + index] == 0) {
+	    map[i] = 0;			// nothing but holes
+	    continue;
+	}
+	if (index != loaded) {
+	    if (indirect == NULL)
+		indirect = new int[SecondDirect];
+	    synchDisk->ReadSector(dataSectors[FirstIndex + index],
+				  (char *)indirect);
+	    loaded = index;
+	}
+	map[i] = indirect[(i - FirstIndex) % SecondDirect];
+	ASSERT(map[i] >= 0);
+    }
+    delete [] indirect;
+    return numSectors;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ListSectors
+// 	Fill in the number of every sector the file uses, other than its
+//	header: its data blocks, then its indirect blocks, then the sizes
+//	of its extents if it is compressed; holes are left out.  Return
+//	how many there are, or -1 if the header cannot be right (used by
+//	the file system check).
+//
+//	"sectors" -- array to fill in, with room for TotalDirect +
+//		SecondIndex + 1 entries
+//----------------------------------------------------------------------
+
+int
+FileHeader::ListSectors(int *sectors)
+{
+    int *map;
+    int count = 0;
+
+    if (numSectors < 0 || numSectors > (int) TotalDirect
+	|| numSectors != divRoundUp(numBytes, SectorSize))
+	return -1;
+    map = new int[TotalDirect];
+    LoadBlockMap(map, 0);
+    for (int i = 0; i < numSectors; i++)
+	if (map[i] != 0)
+	    sectors[count++] = map[i];
+    for (int j = 0; FirstIndex + j * SecondDirect < numSectors; j++)
+	if (dataSectors[FirstIndex + j] != 0)
+	    sectors[count++] = dataSectors[FirstIndex + j];
+    if (compressMap != 0)
+	sectors[count++] = compressMap;
+    delete [] map;
+    return count;
+}
+
 //----------------------------------------------------------------------
 // FileHeader::FileLength
 // 	Return the number of bytes in the file.
@@ -223,15 +453,22 @@ FileHeader::Print()
     char *data = new char[SectorSize];
 
     printf("FileHeader contents.  File size: %d.  File blocks:\n", numBytes);
-    printf("createTime:%s\n", createTime);
-    printf("lastAccessTime:%s\n", lastAccessTime);
-    printf("lastModifiedTime:%s\n", lastModifiedTime);
+    if (compressMap != 0)
+	printf("Compressed, extent sizes in sector %d\n", compressMap);
+    printf("createTime:%s", TimeString(createTime));
+    printf("lastAccessTime:%s", TimeString(lastAccessTime));
+    printf("lastModifiedTime:%s", TimeString(lastModifiedTime));
 
     for (i = 0; i < numSectors; i++)
-	printf("%d ", dataSectors[i]);
+	printf("%d ", ByteToSector(i * SectorSize));
     printf("\nFile contents:\n");
     for (i = k = 0; i < numSectors; i++) {
-	synchDisk->ReadSector(dataSectors[i], data);
+	int sector = ByteToSector(i * SectorSize);
+
+	if (sector == 0)
+	    bzero(data, SectorSize);		// a hole
+	else
+	    synchDisk->ReadSector(sector, data);
         for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++) {
 	    if ('\040' <= data[j] && data[j] <= '\176')   // isprint(data[j])
 		printf("%c", data[j]);
@@ -243,107 +480,87 @@ FileHeader::Print()
     delete [] data;
 }
 
+//----------------------------------------------------------------------
+// FileHeader::setCreateTime
+// 	Stamp a new file with the current time.
+//----------------------------------------------------------------------
+
 void
 FileHeader::setCreateTime()
 {
-    time_t rawtime;
-    struct tm * timeinfo;
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
-    char *tmp = asctime(timeinfo);
-    strncpy(createTime, tmp, TimeLen);
+    createTime = lastAccessTime = lastModifiedTime = (int) time(NULL);
 }
 
-void
+//----------------------------------------------------------------------
+// FileHeader::setLastAccessTime
+// 	Note that the file has been read.  Like the UNIX "relatime"
+//	option, we only bother if the access time is older than the
+//	modification time, or more than RelatimeInterval seconds old, so
+//	that most reads leave the header unchanged.  Return TRUE if the
+//	header changed and will need to be written back.
+//
+//	accessTimeDue just says whether setLastAccessTime would change
+//	anything, so that a reader can find out without having to lock
+//	the header for writing.
+//----------------------------------------------------------------------
+
+bool
+FileHeader::accessTimeDue()
+{
+    int now = (int) time(NULL);
+
+    return now != lastAccessTime && (lastAccessTime <= lastModifiedTime
+		|| now - lastAccessTime >= RelatimeInterval);
+}
+
+bool
 FileHeader::setLastAccessTime()
 {
-    time_t rawtime;
-    struct tm * timeinfo;
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
-    char *tmp = asctime(timeinfo);
-    strncpy(lastAccessTime, tmp, TimeLen);
+    if (!accessTimeDue())
+	return FALSE;
+    lastAccessTime = (int) time(NULL);
+    return TRUE;
 }
 
-void
+//----------------------------------------------------------------------
+// FileHeader::setLastModifiedTime
+// 	Note that the file has been written.  Return TRUE if the header
+//	changed and will need to be written back.
+//----------------------------------------------------------------------
+
+bool
 FileHeader::setLastModifiedTime()
 {
-    time_t rawtime;
-    struct tm * timeinfo;
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
-    char *tmp = asctime(timeinfo);
-    strncpy(lastModifiedTime, tmp, TimeLen);
+    int now = (int) time(NULL);
+
+    if (now == lastModifiedTime)
+	return FALSE;
+    lastModifiedTime = now;
+    return TRUE;
 }
 
+//----------------------------------------------------------------------
+// FileHeader::externLength
+// 	Grow the file by "size" bytes.  No disk space is allocated: the
+//	new blocks are holes until they are written (cf. AllocateBlocks).
+//	Return FALSE, leaving the file alone, if it would be too big.
+//
+//	"size" -- the number of bytes to add
+//----------------------------------------------------------------------
+
 bool
-FileHeader::externLength(BitMap *freeMap, int size)
+FileHeader::externLength(int size)
 {
-    int needSectors  = divRoundUp(size, SectorSize);
-    int totalSectors = numSectors + needSectors;
-    if (totalSectors > TotalDirect)
-        return FALSE;
-    if (freeMap->NumClear() < needSectors)
+    if (numBytes + size > MaxFileSize)
         return FALSE;
 
-    printf("numSectors: %d, needSectors:%d\n", numSectors, needSectors);
-    // calculate lastSecondBlock and lastIndex
-    int lastSecondBlock;
-    int lastIndex;
-    if (numSectors <= FirstIndex) {
-        lastSecondBlock = 0;
-        lastIndex = 0;
-    }
-    else {
-        lastSecondBlock = (numSectors - FirstIndex) / SecondDirect;
-        lastIndex = (numSectors - FirstIndex) % SecondDirect;
-    }
-  
-    int leftSectors = needSectors;
-    for (int i = 0; i < needSectors; ++i) {
-        if (leftSectors <= 0)
-            break;
-        // append in the first index
-        if (numSectors + i < FirstIndex) {
-            printf("appending in the first index %d\n", numSectors + i);
-            dataSectors[numSectors + i] = freeMap->Find();
-            leftSectors--;
-        }
-        else {
-            if (lastIndex == 0) { // prepare for new second index block
-                dataSectors[FirstIndex + lastSecondBlock] = freeMap->Find();
-                printf("New Second Index Block! Point to %d\n",  
-                    dataSectors[FirstIndex + lastSecondBlock]);
-                int *sector = new int[SecondDirect];
-                synchDisk->WriteSector(dataSectors[FirstIndex + lastSecondBlock], (char *)sector);
-                delete sector;
-            }
-            // append in the second index block
-            for (; leftSectors > 0; lastSecondBlock++) {
-                char *sectorTmp = new char[SectorSize];
-                synchDisk->ReadSector(dataSectors[FirstIndex + lastSecondBlock], sectorTmp);
-                int *tmp = (int *)sectorTmp;
-                for (int k = lastIndex; k < SecondDirect; ++k) {
-                    tmp[k] = freeMap->Find();
-                    leftSectors -= 1;
-                    if (leftSectors <= 0)
-                        break;
-                }
-                synchDisk->WriteSector(dataSectors[FirstIndex + lastSecondBlock], sectorTmp);
-                if (leftSectors > 0) {
-                    lastIndex = 0;
-                    dataSectors[FirstIndex + lastSecondBlock + 1] = freeMap->Find();
-                    printf("New Second Index Block! Point to %d\n",  
-                        dataSectors[FirstIndex + lastSecondBlock + 1]);
-                    int *sector = new int[SecondDirect];
-                    synchDisk->WriteSector(dataSectors[FirstIndex + lastSecondBlock + 1], (char *)sector);
-                    delete sector;
-                }
-            }
-        }
-    }
-    numSectors += needSectors;
-    numBytes += SectorSize * needSectors;
-    OpenFile *freeMapFile = new  OpenFile(0);
-    freeMap->WriteBack(freeMapFile);
-}
\ No newline at end of file
+    int oldSectors = numSectors;
+    numBytes += size;
+    numSectors = divRoundUp(numBytes, SectorSize);
+    for (int i = oldSectors; i < numSectors && i < FirstIndex; i++)
+        dataSectors[i] = 0;
+    for (int j = 0; FirstIndex + j * SecondDirect < numSectors; j++)
+        if (FirstIndex + j * SecondDirect >= oldSectors)
+            dataSectors[FirstIndex + j] = 0;    // a new indirect block
+    return TRUE;
+}
@@ -15,16 +15,25 @@
 #define FILEHDR_H
 
 #include "disk.h"
-#include "bitmap.h"
+#include "freemap.h"
 
-#define TimeLen 25
 #define SecondIndex 5
-#define TotalIndex ((SectorSize - 2 * sizeof(int) - 3 * TimeLen) / sizeof(int))
+#define TotalIndex ((SectorSize - 6 * sizeof(int)) / sizeof(int))
 #define FirstIndex 	(TotalIndex - SecondIndex)
 #define SecondDirect (SectorSize / sizeof(int))
 #define TotalDirect (FirstIndex + SecondIndex * SecondDirect)
 #define MaxFileSize 	(TotalDirect * SectorSize)
 
+// In a compressed file, each run of ExtentBlocks blocks (an "extent") is
+// compressed as a unit.
+#define ExtentBlocks		8
+#define ExtentSize		(ExtentBlocks * SectorSize)
+#define MaxExtents		divRoundUp(TotalDirect, ExtentBlocks)
+
+// The access time is only brought up to date when reading a file if it
+// is older than the modification time, or older than this (in seconds).
+#define RelatimeInterval	(24 * 60 * 60)
+
 // The following class defines the Nachos "file header" (in UNIX terms,  
 // the "i-node"), describing where on disk to find all of the data in the file.
 // The file header is organized as a simple table of pointers to
@@ -39,13 +48,29 @@
 // There is no constructor; rather the file header can be initialized
 // by allocating blocks for the file (if it is a new file), or by
 // reading it from disk.
+//
+// A file may have "holes": blocks with no disk sector yet, recorded as
+// sector 0 (which always holds a cylinder group descriptor, so it is
+// never file data).  A hole reads as zeros; the sector is allocated
+// when the block is first written.  Likewise a whole indirect block
+// that points only to holes need not exist.
+//
+// A file may be "compressed".  Then the header also points to a sector
+// holding the compressed size of each extent of the file.  An extent
+// with a compressed size of n bytes is stored in its first
+// divRoundUp(n, SectorSize) blocks, the rest being holes; one with a
+// size of 0 is stored as is, like the blocks of any other file (and
+// an extent of zeros takes no space at all).  Compressing and
+// uncompressing is up to the OpenFile (cf. openfile.h); to the header
+// these are just blocks.
 
 class FileHeader {
   public:
-    bool Allocate(BitMap *bitMap, int fileSize);// Initialize a file header, 
+    bool Allocate(FreeMap *freeMap, int fileSize, bool compressed = FALSE);
+						// Initialize a file header, 
 						//  including allocating space 
 						//  on disk for the file data
-    void Deallocate(BitMap *bitMap);  		// De-allocate this file's 
+    void Deallocate(FreeMap *freeMap);		// De-allocate this file's 
 						//  data blocks
 
     void FetchFrom(int sectorNumber); 	// Initialize file header from disk
@@ -54,28 +79,52 @@ class FileHeader {
 
     int ByteToSector(int offset);	// Convert a byte offset into the file
 					// to the disk sector containing
-					// the byte
+					// the byte (0 for a hole)
+    int LoadBlockMap(int *map, int from);
+					// Fill in map[i], the disk sector
+					// holding block i of the file, for
+					// each block from "from" on; return
+					// the number of blocks in the file
+    int ListSectors(int *sectors);	// Fill in every sector the file
+					// uses, data and indirect blocks;
+					// return how many, or -1 if the
+					// header is corrupt
+    int AllocateBlocks(FreeMap *freeMap, int first, int count,
+		       int *sectors);	// Fill in the holes among "count"
+					// blocks from "first" on; return
+					// how many are backed by disk
+    void FreeBlocks(FreeMap *freeMap, int first, int count, int *sectors);
+					// Turn "count" blocks from "first"
+					// on back into holes
+
+    bool IsCompressed() { return compressMap != 0; }
+    void FetchExtentSizes(int *sizes);	// Read/write the compressed size of
+    void WriteExtentSizes(int *sizes);	// each extent, for a compressed file
 
     int FileLength();			// Return the length of the file 
 					// in bytes
 
     void Print();			// Print the contents of the file.
-    char* getCreateTime() {return createTime;}
-    char* getLastAccessTime() {return lastAccessTime;}
-    char* getLastModifiedTime() {return lastModifiedTime;}
-    void setCreateTime();
-    void setLastAccessTime();
-    void setLastModifiedTime();
-    bool externLength(BitMap *freeMap, int size);
+    int getCreateTime() {return createTime;}
+    int getLastAccessTime() {return lastAccessTime;}
+    int getLastModifiedTime() {return lastModifiedTime;}
+    void setCreateTime();		// Set all three times to now
+    bool accessTimeDue();		// Would setLastAccessTime change it?
+    bool setLastAccessTime();		// Return TRUE if the time changed
+    bool setLastModifiedTime();
+    bool externLength(int size);	// Grow the file by "size" bytes,
+					// of holes
 
   private:
     int numBytes;			// Number of bytes in the file
     int numSectors;			// Number of data sectors in the file
     int dataSectors[TotalIndex];		// Disk sector numbers for each data 
 					// block in the file
-    char createTime[TimeLen];
-    char lastAccessTime[TimeLen];
-    char lastModifiedTime[TimeLen];
+    int createTime;			// Times, in seconds since 1970
+    int lastAccessTime;
+    int lastModifiedTime;
+    int compressMap;			// Sector holding the size of each
+					// extent, or 0 if not compressed
 };
 
 #endif // FILEHDR_H
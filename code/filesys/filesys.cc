@@ -7,37 +7,73 @@
 //		(the size of the file header data structure is arranged
 //		to be precisely the size of 1 disk sector)
 //	   A number of data blocks
-//	   An entry in the file system directory
+//	   An entry in the directory that contains it
 //
 // 	The file system consists of several data structures:
-//	   A bitmap of free disk sectors (cf. bitmap.h)
-//	   A directory of file names and file headers
+//	   A map of free disk sectors (cf. freemap.h)
+//	   A root directory of file names and file headers
+//	   A table of the files in use (the "inode table")
 //
-//      Both the bitmap and the directory are represented as normal
-//	files.  Their file headers are located in specific sectors
-//	(sector 0 and sector 1), so that the file system can find them 
-//	on bootup.
+//	Directories are files too, so they can be nested: "/a/b/c" names
+//	the file "c" in the directory "b", which is in the directory "a",
+//	which is in the root directory.  A cache of recently resolved
+//	names (cf. DentryCache in directory.h) saves re-reading the
+//	directories along a path on every lookup.
 //
-//	The file system assumes that the bitmap and directory files are
-//	kept "open" continuously while Nachos is running.
+//      The directory is represented as a normal file.  Its file header
+//	is located in a specific sector (sector 1), so that the file
+//	system can find it on bootup.
+//
+//	The file system assumes that the root directory file is kept
+//	"open" continuously while Nachos is running.
+//
+//	Every OpenFile for a file shares one entry in the inode table
+//	(cf. Inode in openfile.h), holding the in-memory copy of the
+//	file header, found by the header's sector.  When the last
+//	OpenFile is closed the entry stays cached, so that opening the
+//	file again need not read the header in, until the slot is needed
+//	for another file (least recently used first).
 //
 //	For those operations (such as Create, Remove) that modify the
 //	directory and/or bitmap, if the operation succeeds, the changes
-//	are written immediately back to disk (the two files are kept
-//	open during all this time).  If the operation fails, and we have
-//	modified part of the directory and/or bitmap, we simply discard
-//	the changed version, without writing it back to disk.
+//	are written back to disk (the two files are kept open during all
+//	this time) as a single journal transaction, so that after a crash
+//	either all of them or none of them take effect.  If the operation
+//	fails, and we have modified part of the directory and/or bitmap,
+//	we simply discard the changed version, without writing it back.
+//
+//	Several threads can use the file system at once.  Each file and
+//	directory in use has a reader/writer lock in its inode, found
+//	by the sector of its header: reading a file or looking a name up
+//	in a directory takes it for reading, while writing a file or
+//	changing a directory takes it for writing.  Allocating or freeing
+//	sectors takes the free map lock, and the dentry cache has a lock of
+//	its own.  So operations on different files only wait for each other
+//	to update the bitmap.  Locks are taken in the order: directory,
+//	then file, then free map.
+//
+//	A file removed while it is open disappears from its directory at
+//	once, but its sectors are freed only when it is last closed.
+//
+//	The journal keeps a flag on disk saying whether the file system
+//	was cleanly unmounted (cf. journal.h), so mounting a clean disk
+//	reads nothing but the log descriptor and the root directory.  If
+//	it was not -- Nachos crashed, or was stopped with ^C -- the
+//	journal makes each update whole, but sectors can still be lost:
+//	those of a file removed while open, for one.  So we check the
+//	file system: a few threads walk the directory tree in parallel,
+//	noting the sectors each file uses, and the free map is brought
+//	into line with what they find.  This happens in the background,
+//	while the file system is in use; sectors allocated or freed in
+//	the meantime are left as they are.
 //
 // 	Our implementation at this point has the following restrictions:
 //
-//	   there is no synchronization for concurrent accesses
-//	   files have a fixed size, set when the file is created
-//	   files cannot be bigger than about 3KB in size
-//	   there is no hierarchical directory structure, and only a limited
-//	     number of files can be added to the system
-//	   there is no attempt to make the system robust to failures
-//	    (if Nachos exits in the middle of an operation that modifies
-//	    the file system, it may corrupt the disk)
+//	   files cannot be bigger than MaxFileSize (about 22KB; cf.
+//	    filehdr.h), though they grow as they are written
+//	   each component of a path name is at most 9 characters long
+//	   only metadata is journalled; if Nachos exits in the middle of
+//	    writing a file, part of the new data may be lost
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -46,34 +82,37 @@
 #include "copyright.h"
 
 #include "disk.h"
-#include "bitmap.h"
+#include "freemap.h"
 #include "directory.h"
 #include "filehdr.h"
 #include "filesys.h"
+#include "journal.h"
+#include "synch.h"
 #include "system.h"
 
-// Sectors containing the file headers for the bitmap of free sectors,
-// and the directory of files.  These file headers are placed in well-known 
-// sectors, so that they can be located on boot-up.
-#define FreeMapSector 		0
+// Sector containing the file header for the root directory.  This file
+// header is placed in a well-known sector, so that it can be located on
+// boot-up: the first sector of the inode area of the first cylinder
+// group, right after the group's descriptor (cf. freemap.h).
 #define DirectorySector 	1
 
-// Initial file sizes for the bitmap and directory; until the file system
-// supports extensible files, the directory size sets the maximum number 
-// of files that can be loaded onto the disk.
-#define FreeMapFileSize 	(NumSectors / BitsInByte)
-#define NumDirEntries 		10
-#define DirectoryFileSize 	(sizeof(DirectoryEntry) * NumDirEntries)
+// Number of path name components remembered by the dentry cache
+#define DentryCacheSize		64
+
+// Number of threads that check the file system after an unclean shutdown
+#define CheckThreads		3
 
 //----------------------------------------------------------------------
 // FileSystem::FileSystem
 // 	Initialize the file system.  If format = TRUE, the disk has
 //	nothing on it, and we need to initialize the disk to contain
-//	an empty directory, and a bitmap of free sectors (with almost but
-//	not all of the sectors marked as free).  
+//	an empty directory, and cylinder groups with almost but not
+//	all of their sectors marked as free.
 //
-//	If format = FALSE, we just have to open the files
-//	representing the bitmap and the directory.
+//	If format = FALSE, we just have to read in the map of free sectors
+//	and open the file representing the directory -- after replaying
+//	the journal, in case we crashed in the middle of an update.  If
+//	the file system wasn't cleanly unmounted, we start checking it.
 //
 //	"format" -- should we initialize the disk?
 //----------------------------------------------------------------------
@@ -81,72 +120,530 @@
 FileSystem::FileSystem(bool format)
 { 
     DEBUG('f', "Initializing the file system.\n");
+    for (int i = 0; i < MAX_FILE_NUM; ++i) {
+	inodes[i].sector = -1;
+	inodes[i].refs = inodes[i].lockers = 0;
+	inodes[i].removed = FALSE;
+	inodes[i].lock = new RWlock("file lock");
+	inodes[i].lastUse = 0;
+	inodes[i].loaded = FALSE;
+	inodes[i].hdr = new FileHeader;
+	inodes[i].blockMap = new int[TotalDirect];
+	inodes[i].writeBuffer = new char[SectorSize];
+	inodes[i].extentSizes = NULL;	// only for compressed files
+	inodes[i].extentBuffer = NULL;
+    }
+    inodeClock = 0;
+    inodesLock = new Lock("inode table lock");
+    freeMapLock = new Lock("free map lock");
+    dentryLock = new Lock("dentry cache lock");
+    dentryCache = new DentryCache(DentryCacheSize);
+    compressFiles = FALSE;
+    checking = FALSE;
+    checkQueue = new class List;
+    checkLock = new Lock("check lock");
+    checkIdle = new Condition("check idle");
+
+    journal = new Journal(format);
+    synchDisk->SetJournal(journal);
     if (format) {
-        BitMap *freeMap = new BitMap(NumSectors);
         Directory *directory = new Directory(NumDirEntries);
-	FileHeader *mapHdr = new FileHeader;
 	FileHeader *dirHdr = new FileHeader;
 
         DEBUG('f', "Formatting the file system.\n");
 
-    // First, allocate space for FileHeaders for the directory and bitmap
-    // (make sure no one else grabs these!)
-	freeMap->Mark(FreeMapSector);	    
+    // First, set up the cylinder groups, covering the disk up to the
+    // log, and allocate space for the FileHeader for the directory
+    // (make sure no one else grabs it!)
+	freeMap = new FreeMap(JournalStart, TRUE);
 	freeMap->Mark(DirectorySector);
 
     // Second, allocate space for the data blocks containing the contents
-    // of the directory and bitmap files.  There better be enough space!
+    // of the directory file.  There better be enough space!
 
-	ASSERT(mapHdr->Allocate(freeMap, FreeMapFileSize));
+	freeMap->SetGoal(DirectorySector);
 	ASSERT(dirHdr->Allocate(freeMap, DirectoryFileSize));
 
-    // Flush the bitmap and directory FileHeaders back to disk
+    // Flush the directory FileHeader back to disk
     // We need to do this before we can "Open" the file, since open
     // reads the file header off of disk (and currently the disk has garbage
     // on it!).
 
         DEBUG('f', "Writing headers back to disk.\n");
 
-	mapHdr->WriteBack(FreeMapSector);
 	dirHdr->WriteBack(DirectorySector);
 
 
-    // OK to open the bitmap and directory files now
-    // The file system operations assume these two files are left open
+    // OK to open the directory file now
+    // The file system operations assume this file is left open
     // while Nachos is running.
 
-        freeMapFile = new OpenFile(FreeMapSector);
-        directoryFile = new OpenFile(DirectorySector);
+        directoryFile = new OpenFile(GetInode(DirectorySector));
      
-    // Once we have the files "open", we can write the initial version
-    // of each file back to disk.  The directory at this point is completely
-    // empty; but the bitmap has been changed to reflect the fact that
-    // sectors on the disk have been allocated for the file headers and
-    // to hold the file data for the directory and bitmap.
-
-        DEBUG('f', "Writing bitmap and directory back to disk.\n");
-	freeMap->WriteBack(freeMapFile);	 // flush changes to disk
+    // Once we have the file "open", we can write the initial version
+    // of it back to disk, along with the cylinder groups.  The directory
+    // at this point is completely empty; but the groups have been changed
+    // to reflect the fact that sectors on the disk have been allocated
+    // for the file header and to hold the file data for the directory.
+
+        DEBUG('f', "Writing free map and directory back to disk.\n");
+	freeMap->WriteBack();	 	// flush changes to disk
 	directory->WriteBack(directoryFile);
 
 	if (DebugIsEnabled('f')) {
 	    freeMap->Print();
 	    directory->Print();
-
-        delete freeMap; 
+	}
 	delete directory; 
-	delete mapHdr; 
 	delete dirHdr;
-	}
     } else {
-    // if we are not formatting the disk, just open the files representing
-    // the bitmap and directory; these are left open while Nachos is running
-        freeMapFile = new OpenFile(FreeMapSector);
-        directoryFile = new OpenFile(DirectorySector);
+    // if we are not formatting the disk, just read in the free map and
+    // open the file representing the directory; these are kept while
+    // Nachos is running
+	freeMap = new FreeMap(JournalStart, FALSE);
+        directoryFile = new OpenFile(GetInode(DirectorySector));
+	if (!journal->IsClean())
+	    StartCheck();
     }
-    for (int i = 0; i < MAX_FILE_NUM; ++i) {
-        strcpy(openFileNames[i], "");
-        refCnt[i] = 0;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FindInode
+// 	Return the inode table entry for the file whose header is at
+//	"sector".  If there isn't one and "create", take a free entry for
+//	it, or else the least recently used entry that no one is using;
+//	otherwise return NULL.  Called with the table lock held.
+//----------------------------------------------------------------------
+
+Inode *
+FileSystem::FindInode(int sector, bool create)
+{
+    Inode *free = NULL, *victim = NULL;
+
+    for (int i = 0; i < MAX_FILE_NUM; i++) {
+	Inode *inode = &inodes[i];
+
+	if (inode->sector == sector)
+	    return inode;
+	if (free == NULL && inode->sector == -1)
+	    free = inode;
+	else if (inode->refs == 0 && inode->lockers == 0
+		 && (victim == NULL || inode->lastUse < victim->lastUse))
+	    victim = inode;
+    }
+    if (!create)
+	return NULL;
+    if (free == NULL) {
+	ASSERT(victim != NULL);		// too many files in use at once
+	ASSERT(!victim->dirty && victim->bufSector == -1
+	       && !victim->extentDirty);
+	DEBUG('f', "Evicting inode for sector %d\n", victim->sector);
+	free = victim;
+    }
+    free->sector = sector;
+    free->removed = FALSE;
+    free->loaded = FALSE;
+    return free;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::LockFile
+// FileSystem::UnlockFile
+// 	Acquire (release) the lock on the file or directory whose header
+//	is at "sector".  Any number of threads can hold it for reading at
+//	once, but only one for writing.
+//
+//	"exclusive" -- TRUE to lock for writing, FALSE for reading
+//----------------------------------------------------------------------
+
+void
+FileSystem::LockFile(int sector, bool exclusive)
+{
+    Inode *inode;
+
+    inodesLock->Acquire();
+    inode = FindInode(sector, TRUE);
+    inode->lockers++;
+    inodesLock->Release();
+
+    if (exclusive)
+	inode->lock->wrlock();
+    else
+	inode->lock->rdlock();
+}
+
+void
+FileSystem::UnlockFile(int sector)
+{
+    Inode *inode;
+
+    inodesLock->Acquire();
+    inode = FindInode(sector, FALSE);
+    ASSERT(inode != NULL && inode->lockers > 0);
+    inode->lock->unlock();
+    if (--inode->lockers == 0 && inode->refs == 0 && !inode->loaded)
+	inode->sector = -1;		// nothing worth keeping
+    inodesLock->Release();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::UpgradeFile
+// 	Called by a thread holding the lock on the file at "sector" for
+//	reading: lock it for writing instead, without letting anyone else
+//	in between, and return TRUE -- if no other thread is reading it.
+//	Otherwise return FALSE, still reading.
+//----------------------------------------------------------------------
+
+bool
+FileSystem::UpgradeFile(int sector)
+{
+    Inode *inode;
+    bool upgraded;
+
+    inodesLock->Acquire();
+    inode = FindInode(sector, FALSE);
+    ASSERT(inode != NULL && inode->lockers > 0);
+    upgraded = inode->lock->TryUpgrade();
+    inodesLock->Release();
+    return upgraded;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::GetInode
+// 	Return the inode for the file whose header is at "sector", for a
+//	new OpenFile, and count the OpenFile.  The header and the map of
+//	the file's blocks are read in from disk, unless the file is open
+//	already, or its inode is still cached.
+//
+//	We hold the table lock while reading, so that two threads opening
+//	the same file don't both read it in.
+//----------------------------------------------------------------------
+
+Inode *
+FileSystem::GetInode(int sector)
+{
+    Inode *inode;
+
+    inodesLock->Acquire();
+    inode = FindInode(sector, TRUE);
+    if (!inode->loaded) {
+	DEBUG('f', "Reading in inode for sector %d\n", sector);
+	inode->hdr->FetchFrom(sector);
+	inode->mapSectors = inode->hdr->LoadBlockMap(inode->blockMap, 0);
+	inode->dirty = FALSE;
+	inode->bufSector = -1;
+	inode->bufExtent = -1;
+	inode->extentDirty = FALSE;
+	if (inode->hdr->IsCompressed()) {
+	    if (inode->extentSizes == NULL) {
+		inode->extentSizes = new int[MaxExtents];
+		inode->extentBuffer = new char[ExtentSize];
+	    }
+	    inode->hdr->FetchExtentSizes(inode->extentSizes);
+	}
+	inode->loaded = TRUE;
+    }
+    inode->refs++;
+    inode->lastUse = ++inodeClock;
+    inodesLock->Release();
+    return inode;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::PutInode
+// 	An OpenFile for "inode" is being closed, after writing back any
+//	changes.  When the last one is closed, if the file was removed in
+//	the meantime, free its sectors now; otherwise keep the inode
+//	cached.
+//----------------------------------------------------------------------
+
+void
+FileSystem::PutInode(Inode *inode)
+{
+    int sector = inode->sector;
+    bool removed;
+
+    inodesLock->Acquire();
+    ASSERT(inode->refs > 0);
+    removed = (--inode->refs == 0 && inode->removed);
+    inodesLock->Release();
+
+    if (removed) {
+	DEBUG('f', "Freeing removed file at sector %d\n", sector);
+	journal->Begin();
+	freeMapLock->Acquire();
+	FreeFile(sector);
+	freeMap->WriteBack();
+	freeMapLock->Release();
+	journal->End();
+    }
+}
+
+//----------------------------------------------------------------------
+// FileSystem::RemoveIfOpen
+// 	A file is being removed.  If it is open, mark it to be freed when
+//	it is last closed, and return TRUE; otherwise the caller should
+//	free it now.
+//----------------------------------------------------------------------
+
+bool
+FileSystem::RemoveIfOpen(int sector)
+{
+    Inode *inode;
+    bool open = FALSE;
+
+    inodesLock->Acquire();
+    inode = FindInode(sector, FALSE);
+    if (inode != NULL && inode->refs > 0) {
+	inode->removed = TRUE;
+	open = TRUE;
+    }
+    inodesLock->Release();
+    return open;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FreeFile
+// 	Free the data blocks and the header of the file whose header is
+//	at "sector".  Called with the free map locked.
+//----------------------------------------------------------------------
+
+void
+FileSystem::FreeFile(int sector)
+{
+    FileHeader *fileHdr = new FileHeader;
+
+    fileHdr->FetchFrom(sector);
+    fileHdr->Deallocate(freeMap);		// remove data blocks
+    freeMap->Clear(sector);			// remove header block
+    delete fileHdr;
+    ForgetInode(sector);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ForgetInode
+// 	The file whose header is at "sector" has been freed; if its inode
+//	is still cached, drop the header, so that a new file whose header
+//	ends up in the same sector is read in afresh.  The entry itself
+//	goes once no one holds its lock.
+//----------------------------------------------------------------------
+
+void
+FileSystem::ForgetInode(int sector)
+{
+    Inode *inode;
+
+    inodesLock->Acquire();
+    inode = FindInode(sector, FALSE);
+    if (inode != NULL) {
+	ASSERT(inode->refs == 0);
+	inode->loaded = FALSE;
+	inode->removed = FALSE;
+	if (inode->lockers == 0)
+	    inode->sector = -1;
+    }
+    inodesLock->Release();
+}
+
+//----------------------------------------------------------------------
+// SplitPath
+// 	Copy the first component of a path name into "component",
+//	skipping any leading '/'s.  Return the rest of the path (also
+//	without leading '/'s), or NULL if the component is too long
+//	to be a file name.
+//
+//	"component" -- buffer of at least FileNameMaxLen + 1 characters
+//----------------------------------------------------------------------
+
+static char *
+SplitPath(char *path, char *component)
+{
+    int len = 0;
+
+    while (*path == '/')
+	path++;
+    while (*path != '\0' && *path != '/') {
+	if (len == FileNameMaxLen)
+	    return NULL;
+	component[len++] = *path++;
+    }
+    component[len] = '\0';
+    while (*path == '/')
+	path++;
+    return path;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::OpenDirectory
+// FileSystem::CloseDirectory
+// 	Open (close) the file holding the directory whose header is at
+//	"sector".  The root directory is kept open while Nachos is
+//	running, so we hand out (and never close) the same OpenFile for it.
+//----------------------------------------------------------------------
+
+OpenFile *
+FileSystem::OpenDirectory(int sector)
+{
+    if (sector == DirectorySector)
+	return directoryFile;
+    return new OpenFile(sector);
+}
+
+void
+FileSystem::CloseDirectory(OpenFile *file)
+{
+    if (file != directoryFile)
+	delete file;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::LookupName
+// 	Look up a single name in the directory whose header is at
+//	"dirSector".  Return the sector of the file's header, or -1 if
+//	it isn't there.
+//
+//	"type" -- if not NULL, set to the type of the file
+//----------------------------------------------------------------------
+
+int
+FileSystem::LookupName(int dirSector, char *name, int *type)
+{
+    int sector;
+
+    LockFile(dirSector, FALSE);
+    sector = SearchDirectory(dirSector, name, type);
+    UnlockFile(dirSector);
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::SearchDirectory
+// 	Same as LookupName, but the caller has the directory locked.  The
+//	directory is only read from disk if the dentry cache doesn't
+//	already know the answer.  Since the directory can't change while
+//	it is locked, neither can the answer we add to the cache.
+//----------------------------------------------------------------------
+
+int
+FileSystem::SearchDirectory(int dirSector, char *name, int *type)
+{
+    int sector, fileType = RegularFileType;
+    bool cached;
+
+    if (strlen(name) > FileNameMaxLen)
+	return -1;			// can't be in any directory
+    dentryLock->Acquire();
+    cached = dentryCache->Lookup(dirSector, name, &sector, &fileType);
+    dentryLock->Release();
+    if (!cached) {
+	OpenFile *dirFile = OpenDirectory(dirSector);
+	Directory *directory = new Directory(NumDirEntries);
+
+	directory->FetchFrom(dirFile);
+	sector = directory->Find(name, &fileType);
+	dentryLock->Acquire();
+	dentryCache->Insert(dirSector, name, sector, fileType);
+	dentryLock->Release();
+	delete directory;
+	CloseDirectory(dirFile);
+    }
+    if (type != NULL)
+	*type = fileType;
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::LookupParent
+// 	Walk a path name such as "/a/b/c" one component at a time,
+//	starting from the root directory, up to (but not including) the
+//	last component.  Return the sector of the header of the directory
+//	that should hold the last component, and copy the last component
+//	into "leaf".  Paths without a leading '/' start at the root too.
+//
+//	Return -1 if the path is empty, if any component is too long,
+//	or if any but the last component is missing or isn't a directory.
+//
+//	"leaf" -- buffer of at least FileNameMaxLen + 1 characters
+//----------------------------------------------------------------------
+
+int
+FileSystem::LookupParent(char *path, char *leaf)
+{
+    int dirSector = DirectorySector;
+    int type;
+    char *rest = SplitPath(path, leaf);
+
+    if (rest == NULL || leaf[0] == '\0')
+	return -1;
+    while (*rest != '\0') {
+	dirSector = LookupName(dirSector, leaf, &type);
+	if (dirSector == -1 || type != DirectoryFileType)
+	    return -1;
+	rest = SplitPath(rest, leaf);
+	if (rest == NULL)
+	    return -1;
     }
+    return dirSector;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Lookup
+// 	Return the sector of the header of the file named by "path",
+//	or -1 if there is no such file.
+//
+//	"type" -- if not NULL, set to the type of the file
+//----------------------------------------------------------------------
+
+int
+FileSystem::Lookup(char *path, int *type)
+{
+    char leaf[FileNameMaxLen + 1];
+    int dirSector = LookupParent(path, leaf);
+
+    if (dirSector == -1)
+	return -1;
+    return LookupName(dirSector, leaf, type);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ExtendDirectory
+// 	If adding an entry made a directory's table grow, extend the file
+//	holding the directory so that the new table fits, and write its
+//	header back.  Return FALSE if there isn't enough free space.
+//
+//	"dirFile" -- the open directory file
+//	"dirSector" -- the sector holding the directory's file header
+//	"directory" -- the in-memory copy of the directory
+//
+//	Called with the free map locked.
+//----------------------------------------------------------------------
+
+bool
+FileSystem::ExtendDirectory(OpenFile *dirFile, int dirSector,
+			    Directory *directory)
+{
+    int length = dirFile->Length();
+    int needed = directory->FileSize() - length;
+    FileHeader *dirHdr = dirFile->getHdr();
+    int first = divRoundUp(length, SectorSize);
+    int count, allocated, *sectors;
+
+    if (needed <= 0)
+	return TRUE;
+    count = divRoundUp(directory->FileSize(), SectorSize) - first;
+    if (!freeMap->HasFree(count + divRoundUp(count, SecondDirect) + 1))
+	return FALSE;			// so that we can't fail half way
+    if (!dirHdr->externLength(needed))
+	return FALSE;
+    sectors = new int[count + 1];
+    bzero(sectors, (count + 1) * sizeof(int));	// the new blocks are holes
+    freeMap->SetGoal(length > 0 ? dirHdr->ByteToSector(length - 1)
+			        : dirSector);
+    allocated = dirHdr->AllocateBlocks(freeMap, first, count, sectors);
+    ASSERT(allocated == count);
+    delete [] sectors;
+    dirHdr->WriteBack(dirSector);
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -156,116 +653,173 @@ FileSystem::FileSystem(bool format)
 //	to give Create the initial size of the file.
 //
 //	The steps to create a file are:
+//	  Find the directory the file goes in
 //	  Make sure the file doesn't already exist
 //        Allocate a sector for the file header
 // 	  Allocate space on disk for the data blocks for the file
-//	  Add the name to the directory
-//	  Store the new file header on disk 
+//	  Add the name to the directory, growing it if need be
+//	  Store the new file header on disk
 //	  Flush the changes to the bitmap and the directory back to disk
 //
 //	Return TRUE if everything goes ok, otherwise, return FALSE.
 //
 // 	Create fails if:
+//		the directory it would go in doesn't exist
 //   		file is already in directory
 //	 	no free space for file header
-//	 	no free entry for file in directory
-//	 	no free space for data blocks for the file 
+//	 	no free space for data blocks for the file, or for the
+//		  directory to grow
 //
-// 	Note that this implementation assumes there is no concurrent access
-//	to the file system!
+//	The header goes near the directory's, and the data blocks near
+//	the header (cf. FreeMap::FindHeader).
 //
-//	"name" -- name of file to be created
-//	"initialSize" -- size of file to be created
+//	"name" -- path name of file to be created
+//	"initialSize" -- size of file to be created (ignored for directories)
+//	"type" -- RegularFileType, or DirectoryFileType to create an
+//		empty directory
 //----------------------------------------------------------------------
 
 bool
-FileSystem::Create(char *name, int initialSize, int type, char *path)
+FileSystem::Create(char *name, int initialSize, int type)
 {
     Directory *directory;
-    BitMap *freeMap;
     FileHeader *hdr;
-    int sector;
+    OpenFile *dirFile;
+    char leaf[FileNameMaxLen + 1];
+    int sector, dirSector;
     bool success;
 
     DEBUG('f', "Creating file %s, size %d\n", name, initialSize);
 
+    dirSector = LookupParent(name, leaf);
+    if (dirSector == -1)
+	return FALSE;			// no such directory
+    if (type == DirectoryFileType)
+	initialSize = DirectoryFileSize;
+
+    LockFile(dirSector, TRUE);
+    journal->Begin();
+    dirFile = OpenDirectory(dirSector);
     directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
+    directory->FetchFrom(dirFile);
 
-    if (directory->Find(name) != -1)
+    if (directory->Find(leaf) != -1)
       success = FALSE;			// file is already in directory
-    else {	
-        freeMap = new BitMap(NumSectors);
-        freeMap->FetchFrom(freeMapFile);
-        sector = freeMap->Find();	// find a sector to hold the file header
-    	if (sector == -1) 		
-            success = FALSE;		// no free block for file header 
-        else if (!directory->Add(name, sector, type, path))
-            success = FALSE;	// no space in directory
+    else {
+	freeMapLock->Acquire();
+        sector = freeMap->FindHeader(dirSector, type == DirectoryFileType);
+    	if (sector == -1)
+            success = FALSE;		// no free block for file header
+        else if (!directory->Add(leaf, sector, type))
+            success = FALSE;	// name too long
 	else {
     	    hdr = new FileHeader;
-	    if (!hdr->Allocate(freeMap, initialSize))
+	    if (!hdr->Allocate(freeMap, initialSize,
+			       compressFiles && type == RegularFileType))
             	success = FALSE;	// no space on disk for data
-	    else {	
+	    else if (!ExtendDirectory(dirFile, dirSector, directory))
+            	success = FALSE;	// no space on disk for directory
+	    else {
 	    	success = TRUE;
 		// everthing worked, flush all changes back to disk
-    	    	hdr->WriteBack(sector); 		
-    	    	directory->WriteBack(directoryFile);
-    	    	freeMap->WriteBack(freeMapFile);
+    	    	hdr->WriteBack(sector);
+		if (type == DirectoryFileType) {
+		    Directory *newDir = new Directory(NumDirEntries);
+		    OpenFile *newDirFile = new OpenFile(sector);
+
+		    newDir->WriteBack(newDirFile);	// starts out empty
+		    delete newDirFile;
+		    delete newDir;
+		}
+    	    	directory->WriteBack(dirFile);
+    	    	freeMap->WriteBack();
+		dentryLock->Acquire();
+		dentryCache->Insert(dirSector, leaf, sector, type);
+		dentryLock->Release();
 	    }
             delete hdr;
 	}
-        delete freeMap;
+	if (!success)
+	    freeMap->Discard();		// undo any allocations
+	freeMapLock->Release();
     }
     delete directory;
+    CloseDirectory(dirFile);
+    journal->End();
+    UnlockFile(dirSector);
     return success;
 }
 
 //----------------------------------------------------------------------
 // FileSystem::Open
-// 	Open a file for reading and writing.  
+// 	Open a file for reading and writing.
 //	To open a file:
-//	  Find the location of the file's header, using the directory 
-//	  Bring the header into memory
+//	  Find the location of the file's header, by walking its path
+//	    name through the directories
+//	  Bring the header into memory, unless the file is already open
+//	    (cf. GetInode)
+//	The directory stays locked until the file is open, so that it
+//	can't be removed in between.
 //
-//	"name" -- the text name of the file to be opened
+//	"name" -- the path name of the file to be opened
 //----------------------------------------------------------------------
 
 OpenFile *
 FileSystem::Open(char *name)
 {
-    Directory *directory = new Directory(NumDirEntries);
     OpenFile *openFile = NULL;
-    int sector;
+    char leaf[FileNameMaxLen + 1];
+    int sector, dirSector;
 
     DEBUG('f', "Opening file %s\n", name);
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name); 
-    if (sector >= 0) 		
-	openFile = new OpenFile(sector);	// name was found in directory 
-    delete directory;
+    dirSector = LookupParent(name, leaf);
+    if (dirSector == -1)
+	return NULL;			// no such directory
+    LockFile(dirSector, FALSE);
+    sector = SearchDirectory(dirSector, leaf, NULL);
+    if (sector >= 0)
+	openFile = new OpenFile(sector, TRUE);	// name was found in directory
+    UnlockFile(dirSector);
+    return openFile;				// return NULL if not found
+}
+
+//----------------------------------------------------------------------
+// FileSystem::RemoveContents
+// 	Delete every file in the directory whose header is at "dirSector",
+//	recursing into subdirectories.  The directory itself is left for
+//	the caller to delete, so its (now stale) table is not written back.
+//	Files that are open are freed when they are closed.
+//
+//	Called with the free map locked, so, to keep to the locking order,
+//	we can't lock the directories below; removing a directory while
+//	other threads are creating or looking up files inside it is not
+//	supported.
+//----------------------------------------------------------------------
+
+void
+FileSystem::RemoveContents(int dirSector)
+{
+    OpenFile *dirFile = OpenDirectory(dirSector);
+    Directory *directory = new Directory(NumDirEntries);
 
-    int found = 0;
-    for (int i = 0; i < MAX_FILE_NUM; ++i)
-        if (!strcmp(openFileNames[i], name)) {
-            refCnt[i]++;
-            found = 1;
-            break;
-        }
-    if (found == 0) {
-        int index;
-        for (int index = 0; index < MAX_FILE_NUM; ++index)
-        if (refCnt[index] == 0) {
-            strcpy(openFileNames[index], name);
-            refCnt[index] = 1;
-            break;
-        }
-        if (index == MAX_FILE_NUM) {
-            delete openFile;
-            openFile = NULL;
-        }
+    directory->FetchFrom(dirFile);
+    for (int i = 0; i < directory->TableSize(); i++) {
+	DirectoryEntry *entry = directory->GetEntry(i);
+
+	if (entry == NULL)
+	    continue;
+	if (entry->type == DirectoryFileType) {
+	    RemoveContents(entry->sector);
+	    freeMap->DirectoryRemoved(entry->sector);
+	}
+	if (!RemoveIfOpen(entry->sector))
+	    FreeFile(entry->sector);
     }
-    return openFile;				// return NULL if not found
+    dentryLock->Acquire();
+    dentryCache->InvalidateDirectory(dirSector);
+    dentryLock->Release();
+    delete directory;
+    CloseDirectory(dirFile);
 }
 
 //----------------------------------------------------------------------
@@ -275,55 +829,69 @@ FileSystem::Open(char *name)
 //	    Delete the space for its header
 //	    Delete the space for its data blocks
 //	    Write changes to directory, bitmap back to disk
+//	Removing a directory removes everything in it as well.
+//
+//	We wait for any read or write of the file in progress to finish.
+//	If the file is still open, it is only taken out of the directory
+//	now; its space is freed when it is last closed.
 //
 //	Return TRUE if the file was deleted, FALSE if the file wasn't
 //	in the file system.
 //
-//	"name" -- the text name of the file to be removed
+//	"name" -- the path name of the file to be removed
 //----------------------------------------------------------------------
 
 bool
 FileSystem::Remove(char *name)
-{ 
-     for (int i = 0; i < MAX_FILE_NUM; ++i)
-        if (!strcmp(name, openFileNames[i])) {
-            while (refCnt[i] > 0)
-                currentThread->Sleep();
-            break;
-        }
+{
     Directory *directory;
-    BitMap *freeMap;
-    FileHeader *fileHdr;
-    int sector;
-    
+    OpenFile *dirFile;
+    char leaf[FileNameMaxLen + 1];
+    int sector, dirSector, type;
+
+    dirSector = LookupParent(name, leaf);
+    if (dirSector == -1)
+	return FALSE;			// no such directory
+    LockFile(dirSector, TRUE);
+    dirFile = OpenDirectory(dirSector);
     directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name);
+    directory->FetchFrom(dirFile);
+    sector = directory->Find(leaf, &type);
     if (sector == -1) {
        delete directory;
-       return FALSE;			 // file not found 
+       CloseDirectory(dirFile);
+       UnlockFile(dirSector);
+       return FALSE;			 // file not found
     }
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(sector);
-
-    freeMap = new BitMap(NumSectors);
-    freeMap->FetchFrom(freeMapFile);
+    LockFile(sector, TRUE);
+    journal->Begin();
+    freeMapLock->Acquire();
 
-    fileHdr->Deallocate(freeMap);  		// remove data blocks
-    freeMap->Clear(sector);			// remove header block
-    directory->Remove(name);
+    if (type == DirectoryFileType) {
+	RemoveContents(sector);			// empty it out first
+	freeMap->DirectoryRemoved(sector);
+    }
+    if (!RemoveIfOpen(sector))
+	FreeFile(sector);
+    directory->Remove(leaf);
 
-    freeMap->WriteBack(freeMapFile);		// flush to disk
-    directory->WriteBack(directoryFile);        // flush to disk
-    delete fileHdr;
+    freeMap->WriteBack();			// flush to disk
+    freeMapLock->Release();
+    directory->WriteBack(dirFile);        	// flush to disk
+    dentryLock->Acquire();
+    dentryCache->Invalidate(dirSector, leaf);
+    dentryLock->Release();
     delete directory;
-    delete freeMap;
+    CloseDirectory(dirFile);
+    journal->End();
+    UnlockFile(sector);
+    UnlockFile(dirSector);
     return TRUE;
-} 
+}
 
 //----------------------------------------------------------------------
 // FileSystem::List
-// 	List all the files in the file system directory.
+// 	List all the files in the file system, by full path name.
 //----------------------------------------------------------------------
 
 void
@@ -331,15 +899,17 @@ FileSystem::List()
 {
     Directory *directory = new Directory(NumDirEntries);
 
+    LockFile(DirectorySector, FALSE);
     directory->FetchFrom(directoryFile);
-    directory->List();
+    directory->List("");
+    UnlockFile(DirectorySector);
     delete directory;
 }
 
 //----------------------------------------------------------------------
 // FileSystem::Print
 // 	Print everything about the file system:
-//	  the contents of the bitmap
+//	  the cylinder groups and their bitmaps
 //	  the contents of the directory
 //	  for each file in the directory,
 //	      the contents of the file header
@@ -349,41 +919,369 @@ FileSystem::List()
 void
 FileSystem::Print()
 {
-    FileHeader *bitHdr = new FileHeader;
     FileHeader *dirHdr = new FileHeader;
-    BitMap *freeMap = new BitMap(NumSectors);
     Directory *directory = new Directory(NumDirEntries);
 
-    printf("Bit map file header:\n");
-    bitHdr->FetchFrom(FreeMapSector);
-    bitHdr->Print();
-
     printf("Directory file header:\n");
     dirHdr->FetchFrom(DirectorySector);
     dirHdr->Print();
 
-    freeMap->FetchFrom(freeMapFile);
-    freeMap->Print();
+    freeMapLock->Acquire();
+    freeMap->Print(TRUE);
+    freeMapLock->Release();
 
+    LockFile(DirectorySector, FALSE);
     directory->FetchFrom(directoryFile);
     directory->Print();
+    UnlockFile(DirectorySector);
 
-    delete bitHdr;
     delete dirHdr;
-    delete freeMap;
     delete directory;
 } 
 
 bool
 FileSystem::externFileLength(char *name, int size)
 {
-    OpenFile *file = Open(name);
-    ASSERT(file != NULL);
-    BitMap *freeMap = new BitMap(NumSectors);
-    freeMap->FetchFrom(freeMapFile);
-    FileHeader *hdr = file->getHdr();
-    ASSERT(hdr != NULL);
-    bool ans = hdr->externLength(freeMap, size);
-    delete freeMap;
+    int sector = Lookup(name);
+    if (sector == -1)
+        return FALSE;
+    OpenFile *file = new OpenFile(sector, TRUE);  // so open files see it
+    bool ans = file->Extend(size);
+    delete file;
     return ans;
-}
\ No newline at end of file
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FillHoles
+// 	Allocate disk sectors for the holes among "count" blocks of a
+//	file, starting at block "first", and write the new file header
+//	and free map back to disk as one journal transaction.  Each
+//	sector goes as close as we can get to the block before it.
+//	Return the number of blocks, from "first" on, that now have a
+//	sector: less than "count" if the disk is full.  The caller must
+//	have the file locked for writing.
+//
+//	"hdr" -- the in-memory copy of the file's header
+//	"hdrSector" -- the sector holding the file's header
+//	"sectors" -- the sector of each block, 0 for a hole; the new
+//		sectors are filled in
+//----------------------------------------------------------------------
+
+int
+FileSystem::FillHoles(FileHeader *hdr, int hdrSector, int first, int count,
+		      int *sectors)
+{
+    int goal = (first > 0) ? hdr->ByteToSector((first - 1) * SectorSize) : 0;
+    int allocated;
+
+    journal->Begin();
+    freeMapLock->Acquire();
+    freeMap->SetGoal(goal != 0 ? goal : hdrSector);
+    allocated = hdr->AllocateBlocks(freeMap, first, count, sectors);
+    hdr->WriteBack(hdrSector);
+    freeMap->WriteBack();
+    freeMapLock->Release();
+    journal->End();
+    return allocated;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::StoreExtent
+// 	Make room on disk for a new version of one extent of a compressed
+//	file, "numSectors" blocks long: give its first "numSectors" blocks
+//	sectors, free the rest, and record its compressed size.  The new
+//	header, the extent sizes and the free map go to disk as one
+//	journal transaction; the caller then writes the data.
+//
+//	If the disk is too full for the new version, nothing is changed
+//	-- the old version is still there, whole -- and we return FALSE.
+//	The blocks freed from the end of the extent count as free space.
+//	The caller must have the file locked for writing.
+//
+//	"hdr" -- the in-memory copy of the file's header
+//	"hdrSector" -- the sector holding the file's header
+//	"sizes" -- the compressed size of each extent of the file
+//	"extent", "size" -- the extent, and its new compressed size (0 if
+//		it is to be stored as is)
+//	"sectors" -- the sector of each block of the extent, 0 for a hole;
+//		brought up to date
+//----------------------------------------------------------------------
+
+bool
+FileSystem::StoreExtent(FileHeader *hdr, int hdrSector, int *sizes,
+			int extent, int size, int numSectors, int *sectors)
+{
+    int first = extent * ExtentBlocks;
+    int count = min(ExtentBlocks,
+		    divRoundUp(hdr->FileLength(), SectorSize) - first);
+    int goal = (first > 0) ? hdr->ByteToSector((first - 1) * SectorSize) : 0;
+    int holes = 0, freeing = 0;
+    int allocated;
+
+    ASSERT(numSectors <= count);
+    for (int i = 0; i < count; i++)
+	if (i < numSectors && sectors[i] == 0)
+	    holes++;			// needs a sector
+	else if (i >= numSectors && sectors[i] != 0)
+	    freeing++;			// gives one back
+    journal->Begin();
+    freeMapLock->Acquire();
+    freeMap->SetGoal(goal != 0 ? goal : hdrSector);
+    if (holes > 0 && !freeMap->HasFree(holes + 1 - freeing)) {
+					// (maybe an indirect block)
+	freeMapLock->Release();
+	journal->End();
+	return FALSE;
+    }
+    hdr->FreeBlocks(freeMap, first + numSectors, count - numSectors,
+		    &sectors[numSectors]);
+    allocated = hdr->AllocateBlocks(freeMap, first, numSectors, sectors);
+    ASSERT(allocated == numSectors);
+    sizes[extent] = size;
+    hdr->WriteExtentSizes(sizes);
+    hdr->WriteBack(hdrSector);
+    freeMap->WriteBack();
+    freeMapLock->Release();
+    journal->End();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Sync
+// 	Make sure every metadata update so far is in place on disk;
+//	called before Nachos halts.
+//----------------------------------------------------------------------
+
+void
+FileSystem::Sync()
+{
+    journal->Sync();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Unmount
+// 	Wait for any check of the file system to finish, then flush
+//	every update to disk and mark the file system clean; called
+//	before Nachos halts normally.  Later updates mark it not clean
+//	again.
+//
+//	A file removed while still open keeps its sectors until it is
+//	closed, which now won't happen.  If there are any, we only flush,
+//	and leave the file system marked not clean, so that the next
+//	mount checks it and frees them.
+//----------------------------------------------------------------------
+
+void
+FileSystem::Unmount()
+{
+    int numRemoved = 0;
+
+    checkLock->Acquire();
+    while (checking)
+	checkIdle->Wait(checkLock);
+    checkLock->Release();
+
+    inodesLock->Acquire();
+    for (int i = 0; i < MAX_FILE_NUM; i++)
+	if (inodes[i].sector != -1 && inodes[i].refs > 0 && inodes[i].removed)
+	    numRemoved++;
+    inodesLock->Release();
+    if (numRemoved > 0) {
+	DEBUG('f', "%d removed files still open; not marking clean\n",
+	      numRemoved);
+	journal->Sync();
+    } else
+	journal->Unmount();
+}
+
+//----------------------------------------------------------------------
+// CheckThread
+// 	Thread body for the file system check.  Needs to be a C routine,
+//	because C++ can't handle pointers to member functions.
+//----------------------------------------------------------------------
+
+static void
+CheckThread(int arg)
+{
+    FileSystem *fs = (FileSystem *)arg;
+
+    fs->CheckDaemon();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::StartCheck
+// 	The file system was not cleanly unmounted.  Start tracking the
+//	sectors that are allocated and freed from now on, and start the
+//	threads that check the file system, beginning at the root.  We
+//	don't wait for them.
+//----------------------------------------------------------------------
+
+void
+FileSystem::StartCheck()
+{
+    printf("File system was not cleanly unmounted; checking it.\n");
+    checking = TRUE;
+    checkInUse = new BitMap(JournalStart);
+    checkChanged = new BitMap(JournalStart);
+    freeMap->Track(checkChanged);
+    checkBusy = 0;
+    checkThreads = CheckThreads;
+    checkQueue->Append((void *) DirectorySector);
+    for (int i = 0; i < CheckThreads; i++) {
+	Thread *t = new Thread("check");
+	t->Fork(CheckThread, (int) this);
+    }
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CheckDaemon
+// 	Body of each checking thread: check directories from the queue
+//	until it is empty and no other thread is going to add to it.  The
+//	last thread to finish brings the free map up to date.
+//----------------------------------------------------------------------
+
+void
+FileSystem::CheckDaemon()
+{
+    bool last;
+
+    checkLock->Acquire();
+    for (;;) {
+	while (checkQueue->IsEmpty() && checkBusy > 0)
+	    checkIdle->Wait(checkLock);
+	if (checkQueue->IsEmpty())
+	    break;			// the whole tree has been walked
+	int sector = (int) checkQueue->Remove();
+
+	checkBusy++;
+	checkLock->Release();
+	CheckDirectory(sector);
+	checkLock->Acquire();
+	checkBusy--;
+	checkIdle->Broadcast(checkLock);
+    }
+    last = (--checkThreads == 0);
+    checkLock->Release();
+    if (last)
+	FinishCheck();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CheckDirectory
+// 	Check the directory whose header is at "sector", and each file in
+//	it; queue up its subdirectories for the checking threads.  The
+//	directory is locked for reading, so that its entries don't change
+//	under us, and so is each file, while we read its header.
+//----------------------------------------------------------------------
+
+void
+FileSystem::CheckDirectory(int sector)
+{
+    LockFile(sector, FALSE);
+    if (CheckFile(sector)) {
+	OpenFile *dirFile = OpenDirectory(sector);
+	Directory *directory = new Directory(NumDirEntries);
+
+	directory->FetchFrom(dirFile);
+	for (int i = 0; i < directory->TableSize(); i++) {
+	    DirectoryEntry *entry = directory->GetEntry(i);
+
+	    if (entry == NULL)
+		continue;
+	    if (entry->type == DirectoryFileType) {
+		checkLock->Acquire();
+		checkQueue->Append((void *) entry->sector);
+		checkIdle->Broadcast(checkLock);
+		checkLock->Release();
+	    } else {
+		LockFile(entry->sector, FALSE);
+		CheckFile(entry->sector);
+		UnlockFile(entry->sector);
+	    }
+	}
+	delete directory;
+	CloseDirectory(dirFile);
+    }
+    UnlockFile(sector);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CheckFile
+// 	Note the sectors used by the file whose header is at "sector": the
+//	header itself, the data blocks and the indirect blocks.  Return
+//	FALSE, after complaining, if the header is corrupt.
+//----------------------------------------------------------------------
+
+bool
+FileSystem::CheckFile(int sector)
+{
+    FileHeader *hdr;
+    int *sectors;
+    int count;
+
+    if (sector <= 0 || sector >= JournalStart) {
+	printf("Check: bad file header sector %d\n", sector);
+	return FALSE;
+    }
+    hdr = new FileHeader;
+    sectors = new int[TotalDirect + SecondIndex + 1];
+    hdr->FetchFrom(sector);
+    count = hdr->ListSectors(sectors);
+    if (count == -1)
+	printf("Check: file header at sector %d is corrupt\n", sector);
+
+    checkLock->Acquire();
+    checkInUse->Mark(sector);
+    for (int i = 0; i < count; i++) {
+	if (sectors[i] <= 0 || sectors[i] >= JournalStart)
+	    printf("Check: file at sector %d uses bad sector %d\n", sector,
+		   sectors[i]);
+	else if (checkInUse->Test(sectors[i]))
+	    DEBUG('f', "Check: sector %d is used twice\n", sectors[i]);
+	else
+	    checkInUse->Mark(sectors[i]);
+    }
+    checkLock->Release();
+    delete [] sectors;
+    delete hdr;
+    return count != -1;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FinishCheck
+// 	Every directory has been checked.  Files removed while open are in
+//	no directory any more, but their sectors are still in use until
+//	they are closed, so count those too; then fix up the free map.
+//----------------------------------------------------------------------
+
+void
+FileSystem::FinishCheck()
+{
+    int removed[MAX_FILE_NUM];
+    int numRemoved = 0, freed, marked;
+
+    inodesLock->Acquire();
+    for (int i = 0; i < MAX_FILE_NUM; i++)
+	if (inodes[i].sector != -1 && inodes[i].refs > 0 && inodes[i].removed)
+	    removed[numRemoved++] = inodes[i].sector;
+    inodesLock->Release();
+    for (int i = 0; i < numRemoved; i++)
+	CheckFile(removed[i]);
+
+    journal->Begin();
+    freeMapLock->Acquire();
+    freeMap->Track(NULL);
+    freeMap->Reconcile(checkInUse, checkChanged, &freed, &marked);
+    freeMap->WriteBack();
+    freeMapLock->Release();
+    journal->End();
+    printf("Check done: %d lost sectors freed, %d sectors marked in use.\n",
+	   freed, marked);
+
+    delete checkInUse;
+    delete checkChanged;
+    checkLock->Acquire();
+    checking = FALSE;
+    checkIdle->Broadcast(checkLock);
+    checkLock->Release();
+}
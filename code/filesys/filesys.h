@@ -20,13 +20,13 @@
 //	file system (in a file named "DISK"). 
 //
 //	In the "real" implementation, there are two key data structures used 
-//	in the file system.  There is a single "root" directory, listing
-//	all of the files in the file system; unlike UNIX, the baseline
-//	system does not provide a hierarchical directory structure.  
-//	In addition, there is a bitmap for allocating
-//	disk sectors.  Both the root directory and the bitmap are themselves
-//	stored as files in the Nachos file system -- this causes an interesting
-//	bootstrap problem when the simulated disk is initialized. 
+//	in the file system.  There is a "root" directory, listing the
+//	files at the top of the file system; as in UNIX, a directory may
+//	itself contain directories, and files are named by paths such
+//	as "/a/b/c".  In addition, there is a map for allocating disk
+//	sectors, split into cylinder groups (cf. freemap.h).  The root
+//	directory is itself stored as a file in the Nachos file system,
+//	with its header in a well-known sector.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -40,6 +40,10 @@
 
 #define MAX_FILE_NUM 100
 
+// Types of file, as recorded in a directory entry
+#define RegularFileType		0
+#define DirectoryFileType	1
+
 #ifdef FILESYS_STUB 		// Temporarily implement file system calls as 
 				// calls to UNIX, until the real file system
 				// implementation is available
@@ -67,6 +71,15 @@ class FileSystem {
 };
 
 #else // FILESYS
+class BitMap;
+class Condition;
+class FreeMap;
+class Directory;
+class DentryCache;
+class FileHeader;
+class Journal;
+class Lock;
+
 class FileSystem {
   public:
     FileSystem(bool format);		// Initialize the file system.
@@ -76,26 +89,107 @@ class FileSystem {
 					// the disk, so initialize the directory
     					// and the bitmap of free blocks.
 
-    bool Create(char *name, int initialSize, int type = 0, char *path = "");  	
-					// Create a file (UNIX creat)
+    bool Create(char *name, int initialSize, int type = RegularFileType);
+					// Create a file (UNIX creat), or
+					// a directory (UNIX mkdir)
 
     OpenFile* Open(char *name); 	// Open a file (UNIX open)
 
-    bool Remove(char *name);  		// Delete a file (UNIX unlink)
+    bool Remove(char *name);  		// Delete a file (UNIX unlink), or
+					// a directory and everything in it
 
     void List();			// List all the files in the file system
 
     void Print();			// List all the files and their contents
 
     bool externFileLength(char *name, int size);
+					// Grow a file by "size" bytes, of
+					// holes
+    int FillHoles(FileHeader *hdr, int hdrSector, int first, int count,
+		  int *sectors);	// Allocate disk space for the
+					// unallocated blocks of a file that
+					// are about to be written
+    bool StoreExtent(FileHeader *hdr, int hdrSector, int *sizes, int extent,
+		     int size, int numSectors, int *sectors);
+					// Allocate exactly enough disk space
+					// for an extent of a compressed file
+    void SetCompression(bool on) { compressFiles = on; }
+					// Create new files compressed?
+
+    void Sync();			// Flush all metadata updates to disk
+    void Unmount();			// Sync, once any check is done, and
+					// mark the file system clean
+
+    void CheckDaemon();			// Body of the threads that check
+					// the file system in the background
+
+    void LockFile(int sector, bool exclusive);
+					// Lock the file whose header is at
+					// "sector", for reading or writing
+    void UnlockFile(int sector);
+    bool UpgradeFile(int sector);	// Reading -> writing, if no one else
+					// is reading it
+    Inode *GetInode(int sector);	// Find the inode for the file whose
+					// header is at "sector", reading it
+					// in if need be, for a new OpenFile
+    void PutInode(Inode *inode);	// An OpenFile is being closed
 
-    char openFileNames[MAX_FILE_NUM][50];
-    int refCnt[MAX_FILE_NUM];
   private:
-   OpenFile* freeMapFile;		// Bit map of free disk blocks,
-					// represented as a file
+   FreeMap *freeMap;			// Free disk blocks, by cylinder
+					// group; kept in memory
    OpenFile* directoryFile;		// "Root" directory -- list of 
 					// file names, represented as a file
+   DentryCache *dentryCache;		// Recently resolved path components
+   Journal *journal;			// Log of metadata updates
+
+   Inode inodes[MAX_FILE_NUM];		// Files in use, or recently used
+   int inodeClock;			// Logical time, for LRU
+   Lock *inodesLock;			// Protects inodes
+   Lock *freeMapLock;			// Held while allocating or freeing
+   Lock *dentryLock;			// Protects dentryCache
+   bool compressFiles;			// Create regular files compressed
+
+   bool checking;			// File system check in progress
+   BitMap *checkInUse;			// Sectors found in use by the check
+   BitMap *checkChanged;		// Sectors allocated or freed since
+					// the check began
+   class List *checkQueue;		// Directories waiting to be checked
+					// ("class", as List() hides it)
+   int checkBusy;			// Directories being checked
+   int checkThreads;			// Checking threads still running
+   Lock *checkLock;			// Protects the above
+   Condition *checkIdle;		// Signalled as the work runs out
+
+   Inode *FindInode(int sector, bool create);
+   bool RemoveIfOpen(int sector);	// Put off deleting an open file
+   void FreeFile(int sector);
+					// Free a file's header and data
+   void ForgetInode(int sector);	// Drop the cached copy of a header
+					// that is no longer valid
+
+   int Lookup(char *path, int *type = NULL);
+					// Sector of the header for "path"
+   int LookupParent(char *path, char *leaf);
+					// Sector of the header of the
+					// directory containing "path"
+   int LookupName(int dirSector, char *name, int *type);
+					// Sector of the header for "name"
+					// within one directory
+   int SearchDirectory(int dirSector, char *name, int *type);
+					// Same, with the directory locked
+   OpenFile *OpenDirectory(int sector);	// Open/close a directory file; the
+   void CloseDirectory(OpenFile *file);	// root is kept open all the time
+   bool ExtendDirectory(OpenFile *dirFile, int dirSector,
+			Directory *directory);
+					// Make room on disk for a grown table
+   void RemoveContents(int dirSector);
+					// Delete everything in a directory
+
+   void StartCheck();			// Check the file system after an
+					// unclean shutdown
+   void CheckDirectory(int sector);	// Check a directory and its files
+   bool CheckFile(int sector);		// Note the sectors a file uses
+   void FinishCheck();			// Bring the free map up to date
 };
 
 #endif // FILESYS
@@ -0,0 +1,458 @@
+// freemap.cc
+//	Routines to manage the map of free disk sectors, divided into
+//	cylinder groups (cf. freemap.h).
+//
+//	The caller is responsible for mutual exclusion (the file system
+//	holds its free map lock around every use), and for bracketing
+//	WriteBack with Journal::Begin/End, so that the changed groups
+//	reach the disk along with the file headers that refer to them.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "freemap.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// FreeMap::FreeMap
+// 	Initialize the map of free sectors.  If the disk is being
+//	formatted, every sector is free except the group descriptors;
+//	otherwise the descriptors are read in from disk as they are
+//	needed (cf. Load).
+//
+//	"numSectors" -- the number of sectors to manage, starting at 0
+//	"format" -- should we initialize the groups?
+//----------------------------------------------------------------------
+
+FreeMap::FreeMap(int numSectors, bool format)
+{
+    numGroups = divRoundUp(numSectors, GroupSectors);
+    groups = new CylinderGroup[numGroups];
+    goal = 0;
+    changed = NULL;
+    for (int i = 0; i < numGroups; i++) {
+	CylinderGroup *group = &groups[i];
+
+	group->first = i * GroupSectors;
+	group->numSectors = min(GroupSectors, numSectors - group->first);
+	group->map = new BitMap(GroupSectors);
+	if (format) {
+	    group->map->Mark(0);		// the descriptor
+	    for (int j = group->numSectors; j < GroupSectors; j++)
+		group->map->Mark(j);		// past the end of the disk
+	    group->freeSectors = group->numSectors - 1;
+	    group->numDirs = 0;
+	    group->loaded = group->dirty = TRUE;
+	} else
+	    group->loaded = group->dirty = FALSE;
+    }
+    DEBUG('f', "%d cylinder groups of %d sectors.\n", numGroups, GroupSectors);
+}
+
+//----------------------------------------------------------------------
+// FreeMap::~FreeMap
+// 	De-allocate the map.  Changes not written back are lost.
+//----------------------------------------------------------------------
+
+FreeMap::~FreeMap()
+{
+    for (int i = 0; i < numGroups; i++)
+	delete groups[i].map;
+    delete [] groups;
+}
+
+//----------------------------------------------------------------------
+// FreeMap::FetchGroup
+// FreeMap::WriteGroup
+// 	Read (write) the descriptor of a group from (to) its first sector.
+//----------------------------------------------------------------------
+
+void
+FreeMap::FetchGroup(CylinderGroup *group)
+{
+    char *buf = new char[SectorSize];
+    int *header = (int *) buf;
+
+    synchDisk->ReadSector(group->first, buf);
+    ASSERT(header[0] == GroupMagic);	// not formatted with cylinder groups
+    group->freeSectors = header[1];
+    group->numDirs = header[2];
+    group->map->FetchFrom(buf + GroupHeaderWords * sizeof(int));
+    group->loaded = TRUE;
+    group->dirty = FALSE;
+    delete [] buf;
+}
+
+void
+FreeMap::WriteGroup(CylinderGroup *group)
+{
+    char *buf = new char[SectorSize];
+    int *header = (int *) buf;
+
+    bzero(buf, SectorSize);
+    header[0] = GroupMagic;
+    header[1] = group->freeSectors;
+    header[2] = group->numDirs;
+    group->map->WriteBack(buf + GroupHeaderWords * sizeof(int));
+    synchDisk->WriteSector(group->first, buf);
+    group->dirty = FALSE;
+    delete [] buf;
+}
+
+//----------------------------------------------------------------------
+// FreeMap::Load
+// 	Read in the descriptor of a group, if we haven't already, and
+//	return the group.
+//----------------------------------------------------------------------
+
+CylinderGroup *
+FreeMap::Load(CylinderGroup *group)
+{
+    if (!group->loaded)
+	FetchGroup(group);
+    return group;
+}
+
+//----------------------------------------------------------------------
+// FreeMap::GroupOf
+// 	Return the cylinder group that "sector" is in, read in.
+//----------------------------------------------------------------------
+
+CylinderGroup *
+FreeMap::GroupOf(int sector)
+{
+    ASSERT(sector >= 0 && sector < numGroups * GroupSectors);
+    return Load(&groups[sector / GroupSectors]);
+}
+
+//----------------------------------------------------------------------
+// FreeMap::Mark
+// FreeMap::Clear
+// FreeMap::Test
+// 	Mark a sector in use, mark it free, or test whether it is in use.
+//----------------------------------------------------------------------
+
+void
+FreeMap::Mark(int which)
+{
+    CylinderGroup *group = GroupOf(which);
+
+    if (!group->map->Test(which - group->first)) {
+	group->map->Mark(which - group->first);
+	group->freeSectors--;
+	group->dirty = TRUE;
+	if (changed != NULL)
+	    changed->Mark(which);
+    }
+}
+
+void
+FreeMap::Clear(int which)
+{
+    CylinderGroup *group = GroupOf(which);
+
+    if (group->map->Test(which - group->first)) {
+	group->map->Clear(which - group->first);
+	group->freeSectors++;
+	group->dirty = TRUE;
+	if (changed != NULL)
+	    changed->Mark(which);
+    }
+}
+
+bool
+FreeMap::Test(int which)
+{
+    CylinderGroup *group = GroupOf(which);
+
+    return group->map->Test(which - group->first);
+}
+
+//----------------------------------------------------------------------
+// FreeMap::FindIn
+// 	Allocate the first free sector in part of a group, and return
+//	it; or return -1 if that part is full.
+//
+//	"from", "to" -- the part to search, relative to the group's start
+//----------------------------------------------------------------------
+
+int
+FreeMap::FindIn(CylinderGroup *group, int from, int to)
+{
+    Load(group);
+    if (to > group->numSectors)
+	to = group->numSectors;
+    if (group->freeSectors == 0)
+	return -1;
+    for (int i = from; i < to; i++)
+	if (!group->map->Test(i)) {
+	    group->map->Mark(i);
+	    group->freeSectors--;
+	    group->dirty = TRUE;
+	    if (changed != NULL)
+		changed->Mark(group->first + i);
+	    return group->first + i;
+	}
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// FreeMap::SetGoal
+// 	Ask for the next sectors allocated by Find to be close to
+//	"sector" -- typically the header or the last sector of the file
+//	they are for.
+//----------------------------------------------------------------------
+
+void
+FreeMap::SetGoal(int sector)
+{
+    goal = sector;
+}
+
+//----------------------------------------------------------------------
+// FreeMap::Find
+// 	Allocate a sector for file data.  Look for the first free sector
+//	after the goal in the goal's group, then in the data areas of the
+//	following groups.  Only if they are all full do we eat into the
+//	space set aside for headers.  The sector found becomes the new
+//	goal, so that a file's sectors follow each other on disk.
+//
+//	Return -1 if the disk is full.
+//----------------------------------------------------------------------
+
+int
+FreeMap::Find()
+{
+    int start = GroupOf(goal) - groups;
+    int dataStart = 1 + InodeSectors;
+    int sector = -1;
+
+    for (int i = 0; i < numGroups && sector == -1; i++) {
+	CylinderGroup *group = &groups[(start + i) % numGroups];
+
+	if (i == 0)
+	    sector = FindIn(group, max(goal - group->first, dataStart),
+			    GroupSectors);
+	if (sector == -1)
+	    sector = FindIn(group, dataStart, GroupSectors);
+    }
+    for (int i = 0; i < numGroups && sector == -1; i++)
+	sector = FindIn(&groups[(start + i) % numGroups], 1, dataStart);
+    if (sector != -1)
+	goal = sector;
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// FreeMap::FindHeader
+// 	Allocate a sector for the header of a new file, and make it the
+//	goal, so that the file's data goes in the same group.
+//
+//	A plain file goes in the group of the directory it is in.  A new
+//	directory goes there too, as long as at least a quarter of that
+//	group is free; otherwise it goes in the group with the fewest
+//	directories, among those with at least the average number of free
+//	sectors, so that directories, and the files in them, are spread
+//	over the disk as it fills up.  (Only then do we need to read in
+//	every group.)  Either way, we prefer the group's inode area, and
+//	move on to the next group if this one is full.
+//
+//	Return -1 if the disk is full.
+//
+//	"dirSector" -- the header of the directory the file is in
+//	"directory" -- is the new file a directory?
+//----------------------------------------------------------------------
+
+int
+FreeMap::FindHeader(int dirSector, bool directory)
+{
+    int start = GroupOf(dirSector) - groups;
+    int sector = -1;
+    CylinderGroup *group;
+
+    if (directory && groups[start].freeSectors < GroupSectors / 4) {
+	int average = NumClear() / numGroups;
+	int best = -1;
+
+	for (int i = 0; i < numGroups; i++)
+	    if (groups[i].freeSectors > 0
+		&& groups[i].freeSectors >= average
+		&& (best == -1 || groups[i].numDirs < groups[best].numDirs))
+		best = i;
+	if (best != -1)
+	    start = best;
+    }
+    for (int i = 0; i < numGroups && sector == -1; i++) {
+	group = &groups[(start + i) % numGroups];
+	sector = FindIn(group, 1, 1 + InodeSectors);
+	if (sector == -1)
+	    sector = FindIn(group, 1 + InodeSectors, GroupSectors);
+    }
+    if (sector == -1)
+	return -1;
+    if (directory)
+	group->numDirs++;
+    goal = sector;
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// FreeMap::DirectoryRemoved
+// 	Keep count of the directories in each group: the one whose
+//	header is at "sector" is being deleted.
+//----------------------------------------------------------------------
+
+void
+FreeMap::DirectoryRemoved(int sector)
+{
+    CylinderGroup *group = GroupOf(sector);
+
+    if (group->numDirs > 0) {
+	group->numDirs--;
+	group->dirty = TRUE;
+    }
+}
+
+//----------------------------------------------------------------------
+// FreeMap::NumClear
+// 	Return the number of free sectors on the disk.  This has to read
+//	in every group.
+//----------------------------------------------------------------------
+
+int
+FreeMap::NumClear()
+{
+    int count = 0;
+
+    for (int i = 0; i < numGroups; i++)
+	count += Load(&groups[i])->freeSectors;
+    return count;
+}
+
+//----------------------------------------------------------------------
+// FreeMap::HasFree
+// 	Return TRUE if at least "count" sectors are free.  We count from
+//	the goal's group on, the groups Find will look in first, so that
+//	we usually need not read in any other groups.
+//----------------------------------------------------------------------
+
+bool
+FreeMap::HasFree(int count)
+{
+    int start = GroupOf(goal) - groups;
+    int found = 0;
+
+    for (int i = 0; i < numGroups && found < count; i++)
+	found += Load(&groups[(start + i) % numGroups])->freeSectors;
+    return found >= count;
+}
+
+//----------------------------------------------------------------------
+// FreeMap::Track
+// 	While the file system is being checked, it is also in use: note
+//	in "changed" each sector that is allocated or freed from now on,
+//	so that the check leaves them alone.  NULL stops the tracking.
+//----------------------------------------------------------------------
+
+void
+FreeMap::Track(BitMap *changedSectors)
+{
+    changed = changedSectors;
+}
+
+//----------------------------------------------------------------------
+// FreeMap::Reconcile
+// 	The file system check is done: "inUse" has every sector some file
+//	or directory uses.  Free the sectors the map has in use that no
+//	file uses (typically those of a file that was removed while it
+//	was open, when Nachos stopped), and mark in use those that some
+//	file does.  Sectors in "recent" were allocated or freed during
+//	the check, so the map is right about them already; the group
+//	descriptors aren't in any file.
+//
+//	"freed", "marked" -- set to the number of sectors fixed each way
+//----------------------------------------------------------------------
+
+void
+FreeMap::Reconcile(BitMap *inUse, BitMap *recent, int *freed, int *marked)
+{
+    *freed = *marked = 0;
+    for (int i = 0; i < numGroups; i++) {
+	CylinderGroup *group = Load(&groups[i]);
+
+	for (int j = 1; j < group->numSectors; j++) {
+	    int sector = group->first + j;
+
+	    if (recent->Test(sector)
+		|| group->map->Test(j) == inUse->Test(sector))
+		continue;
+	    DEBUG('f', "Check: sector %d is %s\n", sector,
+		  inUse->Test(sector) ? "in use" : "free");
+	    if (inUse->Test(sector)) {
+		group->map->Mark(j);
+		group->freeSectors--;
+		(*marked)++;
+	    } else {
+		group->map->Clear(j);
+		group->freeSectors++;
+		(*freed)++;
+	    }
+	    group->dirty = TRUE;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// FreeMap::WriteBack
+// 	Write the descriptors of the groups that have changed to disk.
+//----------------------------------------------------------------------
+
+void
+FreeMap::WriteBack()
+{
+    for (int i = 0; i < numGroups; i++)
+	if (groups[i].dirty)
+	    WriteGroup(&groups[i]);
+}
+
+//----------------------------------------------------------------------
+// FreeMap::Discard
+// 	An operation has failed part way through: throw away the changes
+//	made since the last WriteBack, by reading the changed groups
+//	back in from disk.
+//----------------------------------------------------------------------
+
+void
+FreeMap::Discard()
+{
+    for (int i = 0; i < numGroups; i++)
+	if (groups[i].dirty)
+	    FetchGroup(&groups[i]);
+}
+
+//----------------------------------------------------------------------
+// FreeMap::Print
+// 	Print the summary of each group, then the numbers of all the
+//	sectors in use, for debugging.  Groups that haven't been read in
+//	are left out, unless "everything".
+//----------------------------------------------------------------------
+
+void
+FreeMap::Print(bool everything)
+{
+    if (everything)
+	NumClear();			// read every group in
+    for (int i = 0; i < numGroups; i++)
+	if (groups[i].loaded)
+	    printf("Group %d: sectors %d-%d, %d free, %d directories\n", i,
+		   groups[i].first, groups[i].first + groups[i].numSectors - 1,
+		   groups[i].freeSectors, groups[i].numDirs);
+    printf("Bitmap set:\n");
+    for (int i = 0; i < numGroups; i++)
+	for (int j = 0; groups[i].loaded && j < groups[i].numSectors; j++)
+	    if (groups[i].map->Test(j))
+		printf("%d, ", groups[i].first + j);
+    printf("\n");
+}
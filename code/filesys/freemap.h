@@ -0,0 +1,132 @@
+// freemap.h
+//	Data structures for keeping track of the free sectors on disk.
+//
+//	As in the Berkeley Fast File System, the disk is divided into
+//	"cylinder groups" -- runs of a few consecutive tracks.  Each group
+//	keeps the bitmap of its own sectors, and a summary of how much is
+//	in use, in its first sector (the group descriptor).  The next
+//	few sectors of the group are set aside for file headers (the
+//	"inode area"); the rest hold file data.
+//
+//	We try to keep things that are used together close together, so
+//	that the disk head has less far to move: a file header goes in
+//	the same group as the directory it is in, and the file's data in
+//	the same group as its header.  A new directory goes in the group
+//	of its parent too, unless that group is running short of space;
+//	then it goes in a group that has few directories and plenty of
+//	free space, so that the disk fills evenly.
+//
+//	A group's descriptor is read in the first time the group is needed,
+//	and kept in memory while the file system is mounted; only the
+//	descriptors of groups that have changed are written back.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef FREEMAP_H
+#define FREEMAP_H
+
+#include "disk.h"
+#include "bitmap.h"
+
+// Tracks in a cylinder group
+#define GroupTracks		4
+
+// Words of summary information at the start of a group descriptor,
+// ahead of the bitmap
+#define GroupHeaderWords	3
+
+// Most sectors one descriptor has room to keep a bitmap for
+#define MaxGroupSectors		((SectorSize / sizeof(unsigned) \
+				  - GroupHeaderWords) * BitsInWord)
+
+// Sectors in each cylinder group (the last one may be cut short by the
+// end of the disk, or rather, the start of the journal)
+#define GroupSectors		min(GroupTracks * SectorsPerTrack, \
+				    (int) MaxGroupSectors)
+
+// Sectors at the start of each group set aside for file headers,
+// after the descriptor
+#define InodeSectors		(GroupSectors / 8)
+
+#define GroupMagic		0x43594c47	// marks a group descriptor
+
+// The following class defines the in-memory copy of one cylinder group
+// descriptor.  On disk, the descriptor holds the magic number and the
+// two counters, followed by the bitmap.
+
+class CylinderGroup {
+  public:
+    int first;				// First sector of the group
+    int numSectors;			// Sectors in the group
+    int freeSectors;			// How many of them are free
+    int numDirs;			// Directories with their header here
+    BitMap *map;			// Which sectors are in use
+    bool loaded;			// Has been read in from disk
+    bool dirty;				// Changed since last written back
+};
+
+// The following class defines the map of free sectors for the whole
+// disk.  It has the same operations as a BitMap, so that file headers
+// can allocate from it in the same way; Find uses the hint given to
+// SetGoal to keep a file's sectors together.
+
+class FreeMap {
+  public:
+    FreeMap(int numSectors, bool format);
+					// Read the group descriptors from
+					// disk, or if "format", set up
+					// empty groups for the first
+					// "numSectors" sectors
+    ~FreeMap();
+
+    void Mark(int which);		// Mark a sector in use
+    void Clear(int which);		// Mark a sector free
+    bool Test(int which);		// Is the sector in use?
+    int Find();				// Allocate a data sector, near the
+					// goal if possible; -1 if disk full
+    int NumClear();			// Number of free sectors
+    bool HasFree(int count);		// Are at least "count" sectors free?
+					// (Cheaper than NumClear)
+
+    void SetGoal(int sector);		// Allocate near "sector" from now on
+    int FindHeader(int dirSector, bool directory);
+					// Allocate a sector for the header of
+					// a new file in the directory whose
+					// header is at "dirSector"
+    void DirectoryRemoved(int sector);	// The directory whose header is at
+					// "sector" is being deleted
+
+    void Track(BitMap *changed);	// Note in "changed" every sector
+					// allocated or freed from now on
+					// (NULL to stop)
+    void Reconcile(BitMap *inUse, BitMap *recent, int *freed,
+		   int *marked);	// Make the map agree with "inUse",
+					// except for sectors in "recent"
+
+    void WriteBack();			// Write changed groups to disk
+    void Discard();			// Undo changes since the last
+					// WriteBack, by re-reading them
+    void Print(bool everything = FALSE);
+					// Print contents of the map
+
+  private:
+    int numGroups;
+    CylinderGroup *groups;
+    int goal;				// Where to look for a free sector
+    BitMap *changed;			// Sectors allocated or freed while
+					// the file system is being checked
+
+    CylinderGroup *GroupOf(int sector);
+    CylinderGroup *Load(CylinderGroup *group);
+					// Make sure group is read in
+    int FindIn(CylinderGroup *group, int from, int to);
+					// Allocate within part of a group
+    void FetchGroup(CylinderGroup *group);
+    void WriteGroup(CylinderGroup *group);
+};
+
+#endif // FREEMAP_H
@@ -4,8 +4,10 @@
 //	We implement:
 //	   Copy -- copy a file from UNIX to Nachos
 //	   Print -- cat the contents of a Nachos file 
-//	   Perftest -- a stress test for the Nachos file system
-//		read and write a really large file in tiny chunks
+//	   Perftest -- benchmarks for the Nachos file system: large
+//		files read and written sequentially and at random, in
+//		chunks of several sizes, lots of small files, and
+//		concurrent readers and writers
 //		(won't work on baseline system!)
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -14,12 +16,15 @@
 
 #include "copyright.h"
 
+#include <sys/time.h>
+
 #include "utility.h"
 #include "filesys.h"
 #include "system.h"
 #include "thread.h"
 #include "disk.h"
 #include "stats.h"
+#include "synch.h"
 
 #define TransferSize 	10 	// make it small, just to be difficult
 
@@ -98,95 +103,414 @@ Print(char *name)
 
 //----------------------------------------------------------------------
 // PerformanceTest
-// 	Stress the Nachos file system by creating a large file, writing
-//	it out a bit at a time, reading it back a bit at a time, and then
-//	deleting the file.
+// 	Measure the Nachos file system with a set of workloads, each of
+//	which is timed separately:
+//
+//	  seqwrite, seqread -- write a large file from start to end, and
+//		read it back, at several transfer sizes
+//	  randwrite, randread -- the same file, at random positions
+//	  zseqwrite, zseqread, zrandwrite, zrandread -- the same, for a
+//		compressed file
+//	  storm -- create, write, and delete a small file, over and over
+//	  smallcreate, smallread, smallremove -- many small files at once
+//	  largewrite, largeread -- grow a file by appending, past the
+//		sectors the header can point to directly, and read it back
+//	  concurrent -- reader threads and writer threads at the same time
 //
-//	Implemented as three separate routines:
-//	  FileWrite -- write the file
-//	  FileRead -- read the file
-//	  PerformanceTest -- overall control, and print out performance #'s
+//	For each one we print a single line of "key=value" pairs, starting
+//	with "BENCH", so that results can be picked out of the output and
+//	compared between versions: the simulated ticks, disk reads and
+//	writes it took, the host time it took, and the throughput in bytes
+//	per thousand ticks and in host kilobytes per second.  "errors"
+//	counts transfers that came up short or read back the wrong data.
+//
+//	Meant to be run on a freshly formatted disk ("nachos -f -t").
 //----------------------------------------------------------------------
 
 #define FileName 	"TestFile"
-#define Contents 	"1234567890"
-#define ContentSize 	strlen(Contents)
-#define FileSize 	((int)(ContentSize * 800))
+#define FileSize 	16000		// well past the direct sectors
+#define ZipName 	"ZipFile"	// compressed
+#define LargeName 	"LargeFile"
+#define LargeSize 	20480
+#define LargeChunk 	512
+#define NumOps 		200		// transfers in a random workload
+#define NumStorm 	50		// files created in a storm
+#define NumSmall 	40		// files in the many-files workloads
+#define SmallSize 	100
+#define NumReaders 	2		// threads in the concurrent workload
+#define NumWriters 	2
+#define WriterSize 	4000
+
+static int transferSizes[] = { 10, 128, 1024 };
 
-static void 
-FileWrite()
+// Where each workload started
+static int startTicks, startReads, startWrites;
+static struct timeval startTime;
+
+static int errors;
+static unsigned int seed;
+
+//----------------------------------------------------------------------
+// BenchStart
+// BenchReport
+// 	Start timing a workload; stop, and print out its numbers.  The
+//	file system is synced first, so that a workload is charged for
+//	the journal and metadata writes it causes, and the next one
+//	starts clean.
+//
+//	"workload" -- the name of the workload
+//	"xfer" -- the size of each transfer, or 0 if it doesn't apply
+//	"ops" -- the number of operations done
+//	"bytes" -- the number of bytes transferred
+//----------------------------------------------------------------------
+
+static void
+BenchStart()
 {
-    OpenFile *openFile;    
-    int i, numBytes;
+#ifndef FILESYS_STUB
+    fileSystem->Sync();
+#endif
+    errors = 0;
+    startTicks = stats->totalTicks;
+    startReads = stats->numDiskReads;
+    startWrites = stats->numDiskWrites;
+    gettimeofday(&startTime, NULL);
+}
 
-    printf("Sequential write of %d byte file, in %d byte chunks\n", 
-	FileSize, ContentSize);
-    if (!fileSystem->Create(FileName, FileSize)) {
-      printf("Perf test: can't create %s\n", FileName);
-      return;
-    }
-    openFile = fileSystem->Open(FileName);
-    if (openFile == NULL) {
-	printf("Perf test: unable to open %s\n", FileName);
-	return;
-    }
-    for (i = 0; i < FileSize; i += ContentSize) {
-        numBytes = openFile->Write(Contents, ContentSize);
-	if (numBytes < 10) {
-	    printf("Perf test: unable to write %s\n", FileName);
-	    delete openFile;
+static void
+BenchReport(char *workload, int xfer, int ops, int bytes)
+{
+    struct timeval now;
+    int ticks;
+    double usecs;
+
+#ifndef FILESYS_STUB
+    fileSystem->Sync();
+#endif
+    gettimeofday(&now, NULL);
+    ticks = stats->totalTicks - startTicks;
+    usecs = (now.tv_sec - startTime.tv_sec) * 1000000.0
+		+ (now.tv_usec - startTime.tv_usec);
+    printf("BENCH workload=%s xfer=%d ops=%d bytes=%d ticks=%d reads=%d "
+	   "writes=%d wall_us=%.0f bytes_per_kticks=%.2f host_kbps=%.1f "
+	   "errors=%d\n", workload, xfer, ops, bytes, ticks,
+	   stats->numDiskReads - startReads, stats->numDiskWrites - startWrites,
+	   usecs, ticks > 0 ? bytes * 1000.0 / ticks : 0.0,
+	   usecs > 0 ? bytes / 1.024 / usecs * 1000.0 : 0.0, errors);
+}
+
+//----------------------------------------------------------------------
+// BenchRandom
+// 	Return a number from 0 to "limit" - 1.  We keep our own generator,
+//	rather than using Random, so that the same positions are used on
+//	every run, whatever "-rs" says.
+//----------------------------------------------------------------------
+
+static int
+BenchRandom(int limit)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % limit;
+}
+
+//----------------------------------------------------------------------
+// Fill
+// Check
+// 	Every file holds the same pattern, a function of the position
+//	of each byte, so that any part of a file can be written or checked
+//	on its own.  Check counts an error if the bytes don't match.
+//----------------------------------------------------------------------
+
+static void
+Fill(char *buffer, int numBytes, int position)
+{
+    for (int i = 0; i < numBytes; i++)
+	buffer[i] = 'a' + (position + i) % 26;
+}
+
+static void
+Check(char *buffer, int numBytes, int position)
+{
+    for (int i = 0; i < numBytes; i++)
+	if (buffer[i] != 'a' + (position + i) % 26) {
+	    errors++;
 	    return;
 	}
+}
+
+//----------------------------------------------------------------------
+// FileWrite
+// FileRead
+// 	Write "size" bytes of the file "name", from start to end, "xfer"
+//	bytes at a time; read it back the same way.  FileWrite creates
+//	the file empty if "create", so that it grows as it is written, or
+//	else expects it to exist already.  Return the number of transfers.
+//----------------------------------------------------------------------
+
+static int
+FileWrite(char *name, int size, int xfer, bool create)
+{
+    OpenFile *openFile;
+    char *buffer = new char[xfer];
+    int i, ops = 0;
+
+    if (create && !fileSystem->Create(name, 0)) {
+	printf("Perf test: can't create %s\n", name);
+	errors++;
+	delete [] buffer;
+	return 0;
+    }
+    if ((openFile = fileSystem->Open(name)) == NULL) {
+	printf("Perf test: unable to open %s\n", name);
+	errors++;
+	delete [] buffer;
+	return 0;
+    }
+    for (i = 0; i < size; i += xfer, ops++) {
+	int numBytes = min(xfer, size - i);
+
+	Fill(buffer, numBytes, i);
+	if (openFile->Write(buffer, numBytes) < numBytes)
+	    errors++;
     }
     delete openFile;	// close file
+    delete [] buffer;
+    return ops;
 }
 
-static void 
-FileRead()
+static int
+FileRead(char *name, int size, int xfer)
 {
-    OpenFile *openFile;    
-    char *buffer = new char[ContentSize];
-    int i, numBytes;
-
-    printf("Sequential read of %d byte file, in %d byte chunks\n", 
-	FileSize, ContentSize);
+    OpenFile *openFile;
+    char *buffer = new char[xfer];
+    int i, ops = 0;
 
-    if ((openFile = fileSystem->Open(FileName)) == NULL) {
-	printf("Perf test: unable to open file %s\n", FileName);
+    if ((openFile = fileSystem->Open(name)) == NULL) {
+	printf("Perf test: unable to open file %s\n", name);
+	errors++;
 	delete [] buffer;
-	return;
+	return 0;
     }
-    for (i = 0; i < FileSize; i += ContentSize) {
-        numBytes = openFile->Read(buffer, ContentSize);
-	if ((numBytes < 10) || strncmp(buffer, Contents, ContentSize)) {
-	    printf("Perf test: unable to read %s\n", FileName);
-	    delete openFile;
-	    delete [] buffer;
-	    return;
-	}
+    for (i = 0; i < size; i += xfer, ops++) {
+	int numBytes = min(xfer, size - i);
+
+	if (openFile->Read(buffer, numBytes) < numBytes)
+	    errors++;
+	else
+	    Check(buffer, numBytes, i);
     }
     delete [] buffer;
     delete openFile;	// close file
+    return ops;
+}
+
+//----------------------------------------------------------------------
+// RandomWrite
+// RandomRead
+// 	Write (read) NumOps transfers of "xfer" bytes each, at random
+//	positions in the file "name", which is "size" bytes long.
+//----------------------------------------------------------------------
+
+static void
+RandomWrite(char *name, int size, int xfer)
+{
+    OpenFile *openFile = fileSystem->Open(name);
+    char *buffer = new char[xfer];
+
+    ASSERT(openFile != NULL);
+    for (int i = 0; i < NumOps; i++) {
+	int position = BenchRandom(size - xfer + 1);
+
+	Fill(buffer, xfer, position);
+	if (openFile->WriteAt(buffer, xfer, position) < xfer)
+	    errors++;
+    }
+    delete openFile;
+    delete [] buffer;
+}
+
+static void
+RandomRead(char *name, int size, int xfer)
+{
+    OpenFile *openFile = fileSystem->Open(name);
+    char *buffer = new char[xfer];
+
+    ASSERT(openFile != NULL);
+    for (int i = 0; i < NumOps; i++) {
+	int position = BenchRandom(size - xfer + 1);
+
+	if (openFile->ReadAt(buffer, xfer, position) < xfer)
+	    errors++;
+	else
+	    Check(buffer, xfer, position);
+    }
+    delete openFile;
+    delete [] buffer;
+}
+
+//----------------------------------------------------------------------
+// Storm
+// 	Create a small file, write it, and delete it, NumStorm times.
+//----------------------------------------------------------------------
+
+static void
+Storm()
+{
+    for (int i = 0; i < NumStorm; i++) {
+	FileWrite("StormFile", SmallSize, SmallSize, TRUE);
+	if (!fileSystem->Remove("StormFile"))
+	    errors++;
+    }
+}
+
+//----------------------------------------------------------------------
+// SmallFiles
+// 	Do "what" to each of NumSmall small files in turn: 'c' to create
+//	and write them, 'r' to read them, 'd' to delete them.
+//----------------------------------------------------------------------
+
+static void
+SmallFiles(char what)
+{
+    char name[20];
+
+    for (int i = 0; i < NumSmall; i++) {
+	sprintf(name, "Small%d", i);
+	if (what == 'c')
+	    FileWrite(name, SmallSize, SmallSize, TRUE);
+	else if (what == 'r')
+	    FileRead(name, SmallSize, SmallSize);
+	else if (!fileSystem->Remove(name))
+	    errors++;
+    }
+}
+
+//----------------------------------------------------------------------
+// Reader
+// Writer
+// Concurrent
+// 	Run NumReaders threads reading the test file from start to end,
+//	alongside NumWriters threads each writing its own new file; wait
+//	for them all to finish.
+//----------------------------------------------------------------------
+
+static Semaphore *done;
+
+static void
+Reader(int which)
+{
+    FileRead(FileName, FileSize, transferSizes[1]);
+    done->V();
+}
+
+static void
+Writer(int which)
+{
+    char name[20];
+
+    sprintf(name, "Writer%d", which);
+    FileWrite(name, WriterSize, transferSizes[1], TRUE);
+    done->V();
+}
+
+static void
+Concurrent()
+{
+    char name[20];
+    int i;
+
+    done = new Semaphore("bench done", 0);
+    for (i = 0; i < NumWriters; i++)
+	(new Thread("bench writer"))->Fork(Writer, i);
+    for (i = 0; i < NumReaders; i++)
+	(new Thread("bench reader"))->Fork(Reader, i);
+    for (i = 0; i < NumReaders + NumWriters; i++)
+	done->P();
+    delete done;
+    for (i = 0; i < NumWriters; i++) {
+	sprintf(name, "Writer%d", i);
+	fileSystem->Remove(name);
+    }
 }
 
 void
 PerformanceTest()
 {
+    int i, ops, xfer;
+
     printf("Starting file system performance test:\n");
     stats->Print();
-    fileSystem->Create("a", 100);
-    fileSystem->externFileLength("a", 10000);
-    // FileWrite();
-    // FileRead();
-    // if (!fileSystem->Remove(FileName)) {
-    //   printf("Perf test: unable to remove %s\n", FileName);
-    //   return;
-    // }
-    // fileSystem->Create("a.c", 100, 0);
-    // fileSystem->Create("b", 100, 1);
-    // fileSystem->Create("lulu", 100, 0, "\/b");
-    // fileSystem->Create("yoyo", 100, 0,"\/b");
+    seed = 1;
+
+    for (i = 0; i < (int) (sizeof(transferSizes) / sizeof(int)); i++) {
+	xfer = transferSizes[i];
+	fileSystem->Remove(FileName);
+	BenchStart();
+	ops = FileWrite(FileName, FileSize, xfer, TRUE);
+	BenchReport("seqwrite", xfer, ops, FileSize);
+	BenchStart();
+	ops = FileRead(FileName, FileSize, xfer);
+	BenchReport("seqread", xfer, ops, FileSize);
+    }
+    for (i = 0; i < (int) (sizeof(transferSizes) / sizeof(int)); i++) {
+	xfer = transferSizes[i];
+	BenchStart();
+	RandomWrite(FileName, FileSize, xfer);
+	BenchReport("randwrite", xfer, NumOps, NumOps * xfer);
+	BenchStart();
+	RandomRead(FileName, FileSize, xfer);
+	BenchReport("randread", xfer, NumOps, NumOps * xfer);
+    }
+
+#ifndef FILESYS_STUB
+    xfer = transferSizes[1];
+    fileSystem->SetCompression(TRUE);
+    BenchStart();
+    ops = FileWrite(ZipName, FileSize, xfer, TRUE);
+    BenchReport("zseqwrite", xfer, ops, FileSize);
+    fileSystem->SetCompression(FALSE);
+    BenchStart();
+    ops = FileRead(ZipName, FileSize, xfer);
+    BenchReport("zseqread", xfer, ops, FileSize);
+    BenchStart();
+    RandomWrite(ZipName, FileSize, xfer);
+    BenchReport("zrandwrite", xfer, NumOps, NumOps * xfer);
+    BenchStart();
+    RandomRead(ZipName, FileSize, xfer);
+    BenchReport("zrandread", xfer, NumOps, NumOps * xfer);
+    fileSystem->Remove(ZipName);
+#endif
+
+    BenchStart();
+    Storm();
+    BenchReport("storm", SmallSize, NumStorm, NumStorm * SmallSize);
+
+    BenchStart();
+    SmallFiles('c');
+    BenchReport("smallcreate", SmallSize, NumSmall, NumSmall * SmallSize);
+    BenchStart();
+    SmallFiles('r');
+    BenchReport("smallread", SmallSize, NumSmall, NumSmall * SmallSize);
+    BenchStart();
+    SmallFiles('d');
+    BenchReport("smallremove", 0, NumSmall, 0);
 
+    BenchStart();
+    ops = FileWrite(LargeName, LargeSize, LargeChunk, TRUE);
+    BenchReport("largewrite", LargeChunk, ops, LargeSize);
+    BenchStart();
+    ops = FileRead(LargeName, LargeSize, LargeChunk);
+    BenchReport("largeread", LargeChunk, ops, LargeSize);
+    fileSystem->Remove(LargeName);
+
+    BenchStart();
+    Concurrent();
+    BenchReport("concurrent", transferSizes[1], 
+		NumReaders * divRoundUp(FileSize, transferSizes[1])
+		    + NumWriters * divRoundUp(WriterSize, transferSizes[1]),
+		NumReaders * FileSize + NumWriters * WriterSize);
+
+    if (!fileSystem->Remove(FileName))
+	printf("Perf test: unable to remove %s\n", FileName);
     stats->Print();
 }
-
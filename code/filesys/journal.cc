@@ -0,0 +1,437 @@
+// journal.cc
+//	Routines to log file system metadata updates, so that each
+//	update reaches the disk entirely or not at all.
+//
+//	Updates are collected into groups in memory.  A group is written
+//	to the log in one sequential burst (the sectors, then the
+//	descriptor that commits them) and then checkpointed, i.e. copied
+//	home, by a background thread.  Batching many operations into one
+//	group means the cost of the log write is shared between them.
+//
+//	The log holds at most one group.  Until a group has been
+//	checkpointed we keep a copy of it in memory, and reads of those
+//	sectors are answered from that copy; the same goes for the group
+//	still being filled.  Any write to a sector we hold, even outside
+//	Begin/End, is also logged, so the log never overwrites newer data.
+//
+//	Only the threads between Begin and End have their writes logged.
+//	Other threads writing at the same time -- file data, usually --
+//	write in place, unless the sector is one we hold, so they can't
+//	fill the group up and force an operation to be written home
+//	before it is complete.
+//
+//	The clean flag in the descriptor only changes with the lock held
+//	and no operation in progress, so it can never be set on disk
+//	while an update is half done.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "journal.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// JournalTimerHandler, JournalDaemon
+// 	Interrupt handler and thread body for the journal.  Need these to
+//	be C routines, because C++ can't handle pointers to member functions.
+//----------------------------------------------------------------------
+
+static void
+JournalTimerHandler(int arg)
+{
+    Journal *journal = (Journal *)arg;
+
+    journal->TimerExpired();
+}
+
+static void
+JournalDaemon(int arg)
+{
+    Journal *journal = (Journal *)arg;
+
+    journal->CommitDaemon();
+}
+
+//----------------------------------------------------------------------
+// FindSector
+// 	Return the position of "sector" in the list of logged sectors
+//	"targets", or -1 if it isn't there.
+//----------------------------------------------------------------------
+
+static int
+FindSector(int *targets, int numBlocks, int sector)
+{
+    for (int i = 0; i < numBlocks; i++)
+	if (targets[i] == sector)
+	    return i;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Journal::Journal
+// 	Initialize the journal.  If the disk is being formatted, write an
+//	empty descriptor, marked clean; otherwise read the clean flag, and
+//	replay any group left in the log by a crash.  Then start the
+//	thread that commits groups.
+//
+//	"format" -- should we initialize the log?
+//----------------------------------------------------------------------
+
+Journal::Journal(bool format)
+{
+    ASSERT(JournalSlots > TransactionReserve);
+    lock = new Lock("journal lock");
+    idle = new Condition("journal idle");
+    wakeup = new Semaphore("journal wakeup", 0);
+    active = 0;
+    operating = new List;
+    timerPending = FALSE;
+    sequence = 0;
+    numRunning = numCommitted = 0;
+    runningData = new char[JournalSlots * SectorSize];
+    committedData = new char[JournalSlots * SectorSize];
+
+    if (format) {
+	clean = TRUE;
+	WriteDescriptor(0, NULL);
+    } else
+	Recover();
+
+    Thread *t = new Thread("journal");
+    t->Fork(JournalDaemon, (int) this);
+}
+
+//----------------------------------------------------------------------
+// Journal::~Journal
+// 	De-allocate the journal.  Anything not yet committed is lost,
+//	just as if Nachos had crashed; use Sync first to avoid that.
+//----------------------------------------------------------------------
+
+Journal::~Journal()
+{
+    delete lock;
+    delete idle;
+    delete wakeup;
+    delete operating;
+    delete [] runningData;
+    delete [] committedData;
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteDescriptor
+// 	Write the log descriptor.  This is the commit point for a group.
+//
+//	"numBlocks" -- number of sectors in the log (0 to empty it)
+//	"targets" -- home locations of those sectors
+//----------------------------------------------------------------------
+
+void
+Journal::WriteDescriptor(int numBlocks, int *targets)
+{
+    JournalDescriptor *desc = new JournalDescriptor;
+
+    bzero((char *)desc, sizeof(JournalDescriptor));
+    desc->magic = JournalMagic;
+    desc->sequence = sequence;
+    desc->numBlocks = numBlocks;
+    desc->clean = clean;
+    for (int i = 0; i < numBlocks; i++)
+	desc->targets[i] = targets[i];
+    synchDisk->RawWriteSector(JournalStart, (char *)desc);
+    delete desc;
+}
+
+//----------------------------------------------------------------------
+// Journal::Recover
+// 	Called when the file system is mounted.  If the log holds a
+//	committed group, copy it home before anyone looks at the disk.
+//	A disk without a descriptor is treated as not cleanly unmounted.
+//----------------------------------------------------------------------
+
+void
+Journal::Recover()
+{
+    JournalDescriptor *desc = new JournalDescriptor;
+    char *buf = new char[SectorSize];
+
+    synchDisk->RawReadSector(JournalStart, (char *)desc);
+    clean = (desc->magic == JournalMagic && desc->clean);
+    if (desc->magic != JournalMagic) {
+	DEBUG('j', "No journal descriptor, starting an empty log.\n");
+	WriteDescriptor(0, NULL);
+    } else {
+	sequence = desc->sequence;
+	if (desc->numBlocks > 0) {
+	    DEBUG('j', "Replaying group %d, %d sectors.\n", sequence,
+		  desc->numBlocks);
+	    ASSERT(desc->numBlocks <= JournalSlots);
+	    for (int i = 0; i < desc->numBlocks; i++) {
+		synchDisk->RawReadSector(JournalStart + 1 + i, buf);
+		synchDisk->RawWriteSector(desc->targets[i], buf);
+	    }
+	    WriteDescriptor(0, NULL);
+	}
+    }
+    delete [] buf;
+    delete desc;
+}
+
+//----------------------------------------------------------------------
+// Journal::Begin
+// 	Start an operation that modifies file system metadata; every
+//	sector written until the matching End is logged.  If the current
+//	group is nearly full, commit it first, so that this operation
+//	fits entirely in the next one.
+//
+//	The first operation since the file system was mounted clean
+//	marks it not clean on disk, before changing anything.
+//----------------------------------------------------------------------
+
+void
+Journal::Begin()
+{
+    lock->Acquire();
+    if (clean) {
+	clean = FALSE;
+	WriteDescriptor(numCommitted, committedTargets);
+    }
+    if (active == 0 && numRunning + TransactionReserve > JournalSlots)
+	Commit();
+    active++;
+    operating->Append((void *)currentThread);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::End
+// 	Finish an operation started with Begin.  The operation's sectors
+//	are committed along with the rest of the group, later.
+//----------------------------------------------------------------------
+
+void
+Journal::End()
+{
+    lock->Acquire();
+    ASSERT(active > 0);
+    active--;
+    if (!operating->RemoveItem((void *)currentThread))
+	ASSERT(FALSE);			// End without Begin
+    if (active == 0)
+	idle->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Sync
+// 	Wait for any operations in progress, then commit and checkpoint
+//	the current group, so that everything is in place on disk.
+//----------------------------------------------------------------------
+
+void
+Journal::Sync()
+{
+    lock->Acquire();
+    while (active > 0)
+	idle->Wait(lock);
+    Commit();
+    Checkpoint();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Unmount
+// 	Sync, then mark the file system clean on disk, so that the next
+//	mount need not check it.  Nothing is written if there have been
+//	no updates since the last Unmount.
+//----------------------------------------------------------------------
+
+void
+Journal::Unmount()
+{
+    lock->Acquire();
+    while (active > 0)
+	idle->Wait(lock);
+    Commit();
+    Checkpoint();
+    if (!clean) {
+	DEBUG('j', "Marking the file system clean.\n");
+	clean = TRUE;
+	WriteDescriptor(0, NULL);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Absorb
+// 	Called by SynchDisk::WriteSector.  Log the sector if the calling
+//	thread is inside an operation, or if we already hold a copy of
+//	it.  Return FALSE
+//	if the caller should write the sector in place instead.
+//
+//	"sector" -- the disk sector being written
+//	"data" -- the new contents of the sector
+//----------------------------------------------------------------------
+
+bool
+Journal::Absorb(int sector, char *data)
+{
+    int i;
+
+    lock->Acquire();
+    i = FindSector(runningTargets, numRunning, sector);
+    if (i == -1) {
+	if (!operating->Contains((void *)currentThread)
+	    && FindSector(committedTargets, numCommitted, sector) == -1) {
+	    lock->Release();
+	    return FALSE;		// not metadata, write it in place
+	}
+	if (numRunning == JournalSlots) {
+	    if (active == 0)
+		Commit();
+	    else
+		WriteInPlace();		// operation too big for the log
+	}
+	i = numRunning++;
+	runningTargets[i] = sector;
+    }
+    bcopy(data, &runningData[i * SectorSize], SectorSize);
+    if (!timerPending) {
+	timerPending = TRUE;
+	interrupt->Schedule(JournalTimerHandler, (int) this,
+			    CommitInterval, DiskInt);
+    }
+    lock->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Journal::Lookup
+// 	Called by SynchDisk::ReadSector.  If we hold a copy of the sector
+//	that is newer than the one on disk, return it.
+//
+//	"sector" -- the disk sector being read
+//	"data" -- the buffer to hold the contents of the sector
+//----------------------------------------------------------------------
+
+bool
+Journal::Lookup(int sector, char *data)
+{
+    bool found = TRUE;
+    int i;
+
+    lock->Acquire();
+    if ((i = FindSector(runningTargets, numRunning, sector)) != -1)
+	bcopy(&runningData[i * SectorSize], data, SectorSize);
+    else if ((i = FindSector(committedTargets, numCommitted, sector)) != -1)
+	bcopy(&committedData[i * SectorSize], data, SectorSize);
+    else
+	found = FALSE;
+    lock->Release();
+    return found;
+}
+
+//----------------------------------------------------------------------
+// Journal::Commit
+// 	Write the current group to the log: first the sectors, in order,
+//	then the descriptor.  The previous group must be checkpointed
+//	first, since the log only has room for one.
+//
+//	Called with the lock held, and with no operation in progress
+//	(except in WriteInPlace).
+//----------------------------------------------------------------------
+
+void
+Journal::Commit()
+{
+    char *tmp;
+    int logSectors[JournalCapacity];
+
+    if (numRunning == 0)
+	return;
+    Checkpoint();
+    DEBUG('j', "Committing group %d, %d sectors.\n", sequence + 1, numRunning);
+    for (int i = 0; i < numRunning; i++)
+	logSectors[i] = JournalStart + 1 + i;
+    synchDisk->RawWriteSectors(numRunning, logSectors, runningData);
+    sequence++;
+    WriteDescriptor(numRunning, runningTargets);
+
+    tmp = committedData;		// the group is now in the log
+    committedData = runningData;
+    runningData = tmp;
+    for (int i = 0; i < numRunning; i++)
+	committedTargets[i] = runningTargets[i];
+    numCommitted = numRunning;
+    numRunning = 0;
+}
+
+//----------------------------------------------------------------------
+// Journal::Checkpoint
+// 	Copy the group in the log to its home locations, then mark the
+//	log empty.  Called with the lock held.
+//----------------------------------------------------------------------
+
+void
+Journal::Checkpoint()
+{
+    if (numCommitted == 0)
+	return;
+    DEBUG('j', "Checkpointing group %d.\n", sequence);
+    synchDisk->RawWriteSectors(numCommitted, committedTargets, committedData);
+    WriteDescriptor(0, NULL);
+    numCommitted = 0;
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteInPlace
+// 	An operation has logged more sectors than the log can hold.  Give
+//	up on making it atomic: checkpoint the previous group, then write
+//	the current one straight to its home locations.  Called with the
+//	lock held.
+//----------------------------------------------------------------------
+
+void
+Journal::WriteInPlace()
+{
+    DEBUG('j', "Group overflowed the log, writing %d sectors in place.\n",
+	  numRunning);
+    Checkpoint();
+    synchDisk->RawWriteSectors(numRunning, runningTargets, runningData);
+    numRunning = 0;
+}
+
+//----------------------------------------------------------------------
+// Journal::TimerExpired
+// 	Interrupt handler: the commit interval is up, so wake the
+//	background thread.
+//----------------------------------------------------------------------
+
+void
+Journal::TimerExpired()
+{
+    wakeup->V();
+}
+
+//----------------------------------------------------------------------
+// Journal::CommitDaemon
+// 	The background thread.  Each time the commit interval is up,
+//	wait for the operations in progress to finish, then commit the
+//	group and checkpoint it.
+//----------------------------------------------------------------------
+
+void
+Journal::CommitDaemon()
+{
+    for (;;) {
+	wakeup->P();
+	lock->Acquire();
+	while (active > 0)
+	    idle->Wait(lock);
+	Commit();
+	Checkpoint();
+	timerPending = FALSE;
+	lock->Release();
+    }
+}
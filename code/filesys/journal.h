@@ -0,0 +1,125 @@
+// journal.h
+//	Data structures for a write-ahead journal of file system metadata.
+//
+//	Operations that change file system metadata -- file headers,
+//	directories, the bitmap of free sectors -- are bracketed by
+//	Begin/End.  Sectors the thread writes in between are not written
+//	in place; they are kept in memory and later written, as a group,
+//	to a reserved region at the end of the disk (the "log").  Only
+//	once the group is safely in the log are the sectors copied to their
+//	real ("home") locations, a step known as checkpointing.
+//
+//	If Nachos crashes before a group is completely in the log, none
+//	of it is applied; if it crashes after, the group is copied home
+//	again when the file system is next mounted.  Either way, each
+//	operation happens entirely or not at all.
+//
+//	The log descriptor also serves as the file system's superblock:
+//	it records whether the file system was cleanly unmounted.  The
+//	flag is cleared, on disk, before the first update after a mount,
+//	and set again by Unmount once everything is in place; if Nachos
+//	stops in between, the next mount knows to check the file system.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "disk.h"
+#include "synch.h"
+
+// The log occupies the last track of the disk.  Its first sector holds
+// the descriptor (see below); the rest hold copies of logged sectors.
+#define JournalSectors		SectorsPerTrack
+#define JournalStart		(NumSectors - JournalSectors)
+
+#define JournalMagic		0x4a524e4c	// marks a valid descriptor
+
+// Number of logged sectors that one descriptor can describe
+#define JournalCapacity		((SectorSize - 4 * sizeof(int)) / sizeof(int))
+
+// Number of sectors the log can hold: what the descriptor can describe,
+// or what fits in the rest of the track, whichever is less
+#define JournalSlots		min((int) JournalCapacity, JournalSectors - 1)
+
+// A group is committed this many ticks after its first sector is logged,
+// unless it fills up first.
+#define CommitInterval		20000
+
+// Sectors we expect any one operation to log; if fewer than this many
+// slots are left in the group, it is committed before a new operation
+// may begin, so that operations do not straddle two groups.
+#define TransactionReserve	8
+
+// The following class defines the journal descriptor, kept in the
+// first sector of the log.  It is written after the logged sectors
+// themselves, so that a group only counts once all of it is in the log.
+
+class JournalDescriptor {
+  public:
+    int magic;				// JournalMagic
+    int sequence;			// Number of the group in the log
+    int numBlocks;			// Sectors logged; 0 if log is empty
+    int clean;				// No updates since the last Unmount
+    int targets[JournalCapacity];	// Home location of each sector
+};
+
+// The following class defines the journal itself.  One of these is
+// created when the file system is mounted; SynchDisk hands it every
+// sector written or read, so that it can capture metadata updates
+// and return the latest copy of any sector it is holding.
+
+class Journal {
+  public:
+    Journal(bool format);		// Initialize the log on disk if
+					// "format", otherwise replay it
+    ~Journal();
+
+    void Begin();			// Start a metadata operation
+    void End();				// Finish a metadata operation
+    void Sync();			// Commit and checkpoint everything
+    void Unmount();			// Sync, and mark the file system clean
+    bool IsClean() { return clean; }	// Was it cleanly unmounted?
+
+    bool Absorb(int sector, char *data);
+					// Called by SynchDisk to write a
+					// sector; TRUE if we logged it
+    bool Lookup(int sector, char *data);
+					// Called by SynchDisk to read a
+					// sector; TRUE if we have a copy
+
+    void CommitDaemon();		// Body of the background thread
+    void TimerExpired();		// Commit interval is up
+
+  private:
+    Lock *lock;				// Protects everything below
+    Condition *idle;			// Signalled when active drops to 0
+    Semaphore *wakeup;			// Wakes up the background thread
+    int active;				// Operations between Begin and End
+    List *operating;			// The threads running them (once
+					// for each operation)
+    bool timerPending;			// Commit has been scheduled
+    int sequence;			// Number of the last group committed
+    bool clean;				// Clean flag, as it is on disk
+
+    int numRunning;			// Sectors logged in the current group
+    int runningTargets[JournalCapacity];
+    char *runningData;
+
+    int numCommitted;			// Sectors in the log, not yet home
+    int committedTargets[JournalCapacity];
+    char *committedData;
+
+    void Recover();			// Copy a committed group home
+    void Commit();			// Write the current group to the log
+    void Checkpoint();			// Copy the logged group home
+    void WriteInPlace();		// Write the current group home,
+					//  bypassing the log
+    void WriteDescriptor(int numBlocks, int *targets);
+};
+
+#endif // JOURNAL_H
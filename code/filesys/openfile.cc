@@ -5,46 +5,167 @@
 //	the OpenFile data structure).
 //
 //	Also as in UNIX, for convenience, we keep the file header in
-//	memory while the file is open.
+//	memory while the file is open, in the file's inode (cf. filesys.h),
+//	which all the OpenFiles for the file share.  Reading or writing
+//	the file only updates the times in the in-memory header; it is
+//	written back when the file is closed (or flushed).
+//
+//	Read and Write are tuned for a file being read or written from
+//	start to finish in small pieces.  Write collects the pieces for
+//	one sector in a buffer (again in the inode), and writes the sector
+//	once it is full (or when the file is closed); Read notices when
+//	this OpenFile is being used to read the file in order, and asks
+//	for the next few sectors to be read into the disk cache before
+//	they are needed.
+//
+//	An OpenFile from FileSystem::Open is "shared": other threads may
+//	have the same file open, so every public operation locks the file
+//	for its duration, for reading or for writing as the case may be.
+//	The internal routines (DoReadAt, DoWriteAt, ...) assume the file
+//	is already locked.  Directories are opened by the file system
+//	itself, which does its own locking.
+//
+//	A compressed file (cf. filehdr.h) is read and written an extent
+//	at a time, through a buffer in the inode holding one extent,
+//	uncompressed.  Reads and writes just copy to or from the buffer;
+//	the extent is compressed and written out when the buffer is
+//	needed for another extent, or the file is closed.  Since even a
+//	read may change the buffer, every access to a compressed file
+//	locks it for writing.  If the disk fills up, data waiting in the
+//	buffer is lost.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
+#include "compress.h"
 #include "filehdr.h"
 #include "openfile.h"
 #include "system.h"
 #include "disk.h"
+#include <sys/time.h>
 #ifdef HOST_SPARC
 #include <strings.h>
 #endif
 
+//----------------------------------------------------------------------
+// HostTime
+// 	Return the time on the host, in seconds, for measuring how long
+//	compression takes.
+//----------------------------------------------------------------------
+
+static double
+HostTime()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
 //----------------------------------------------------------------------
 // OpenFile::OpenFile
-// 	Open a Nachos file for reading and writing.  Bring the file header
-//	into memory while the file is open.
+// 	Open a Nachos file for reading and writing.  The file system
+//	brings the file header, and the map of where its blocks are on
+//	disk, into memory, unless the file is already open (or was
+//	recently).
 //
 //	"sector" -- the location on disk of the file header for this file
+//	"fileInode" -- the file system's entry for the file, already
+//		counting this OpenFile
+//	"isShared" -- should we lock the file on each access?
 //----------------------------------------------------------------------
 
-OpenFile::OpenFile(int sector)
+OpenFile::OpenFile(int sector, bool isShared)
 { 
-    printf("Opening file with hdrSector %d\n", sector);
+    DEBUG('f', "Opening file with header at sector %d\n", sector);
+    shared = isShared;
     hdrSector = sector;
-    hdr = new FileHeader;
-    hdr->FetchFrom(sector);
+    inode = fileSystem->GetInode(sector);
     seekPosition = 0;
+    lastReadSector = -1;
+    readAheadNext = 0;
+}
+
+OpenFile::OpenFile(Inode *fileInode, bool isShared)
+{ 
+    shared = isShared;
+    inode = fileInode;
+    hdrSector = inode->sector;
+    seekPosition = 0;
+    lastReadSector = -1;
+    readAheadNext = 0;
 }
 
 //----------------------------------------------------------------------
 // OpenFile::~OpenFile
-// 	Close a Nachos file, de-allocating any in-memory data structures.
+// 	Close a Nachos file, writing back any changes; the file system
+//	keeps the inode until it needs the space.
 //----------------------------------------------------------------------
 
 OpenFile::~OpenFile()
 {
-    delete hdr;
+    Flush();
+    fileSystem->PutInode(inode);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Flush
+// 	Write out any data waiting in the write-behind buffer (or the
+//	extent buffer), then the file header, if reads or writes have
+//	changed the times in it since it was last written.
+//----------------------------------------------------------------------
+
+void
+OpenFile::Flush()
+{
+    if (inode->bufSector == -1 && !inode->dirty && !inode->extentDirty)
+	return;
+    BeginAccess(TRUE);
+    FlushBuffer();
+    (void) StoreExtent();			// stays buffered if the disk is full
+    if (inode->dirty) {
+	inode->hdr->WriteBack(hdrSector);
+	inode->dirty = FALSE;
+    }
+    EndAccess();
+}
+
+//----------------------------------------------------------------------
+// OpenFile::BeginAccess/EndAccess
+// 	Lock (unlock) the file around a read or write, if other threads
+//	may be using it.  A read locks the file for writing if it will
+//	have to flush the write-behind buffer first -- which someone may
+//	have filled while we were waiting for the lock -- or if the file
+//	is compressed.  If the buffer was filled while we waited, we
+//	upgrade to writing in place when we are the only reader, and only
+//	go back to the end of the queue when we are not.
+//
+//	"write" -- TRUE if the file will be changed
+//----------------------------------------------------------------------
+
+void
+OpenFile::BeginAccess(bool write)
+{
+    bool exclusive = write || inode->bufSector != -1
+			|| inode->hdr->IsCompressed();
+
+    if (!shared)
+	return;
+    fileSystem->LockFile(hdrSector, exclusive);
+    if (!exclusive && inode->bufSector != -1
+	&& !fileSystem->UpgradeFile(hdrSector)) {
+	fileSystem->UnlockFile(hdrSector);
+	fileSystem->LockFile(hdrSector, TRUE);
+    }
+}
+
+void
+OpenFile::EndAccess()
+{
+    if (shared)
+	fileSystem->UnlockFile(hdrSector);
 }
 
 //----------------------------------------------------------------------
@@ -67,40 +188,192 @@ OpenFile::Seek(int position)
 //	Return the number of bytes actually written or read, and as a
 //	side effect, increment the current position within the file.
 //
-//	Implemented using the more primitive ReadAt/WriteAt.
+//	Implemented using the more primitive ReadAt/WriteAt.  The
+//	access/modification time is updated in memory only (cf. Flush);
+//	as that changes the header, Read relocks the file for writing
+//	to do it, in the rare case the access time needs changing.
+//	Writes smaller than a sector are buffered (cf. BufferedWrite),
+//	and sequential reads trigger read-ahead (cf. ReadAhead).
 //
 //	"into" -- the buffer to contain the data to be read from disk 
 //	"from" -- the buffer containing the data to be written to disk 
 //	"numBytes" -- the number of bytes to transfer
+//
+//	Writing past the end of the file makes it longer; any gap
+//	between the old end and the new data is a hole (cf. Grow).
 //----------------------------------------------------------------------
 
 int
 OpenFile::Read(char *into, int numBytes)
 {
-   int result = ReadAt(into, numBytes, seekPosition);
+   BeginAccess(FALSE);
+   int result = DoReadAt(into, numBytes, seekPosition);
+   if (result > 0 && !inode->hdr->IsCompressed())
+       ReadAhead(seekPosition, result);
    seekPosition += result;
-   hdr->setLastAccessTime();
-   // printf("Setting lastAccessTime to %s\n", hdr->getLastAccessTime());
-   hdr->WriteBack(hdrSector);
+   bool touch = inode->hdr->accessTimeDue();
+   EndAccess();
+   if (touch) {				// other readers share the header
+       BeginAccess(TRUE);
+       if (inode->hdr->setLastAccessTime())
+	   inode->dirty = TRUE;
+       EndAccess();
+   }
    return result;
 }
 
 int
 OpenFile::Write(char *into, int numBytes)
 {
-   int result = WriteAt(into, numBytes, seekPosition);
-   seekPosition += result;
-   hdr->setLastModifiedTime();
-   // printf("Setting lastModifiedTime to %s\n", hdr->getLastModifiedTime());
-   hdr->WriteBack(hdrSector);
+   int result = 0, done;
+
+   BeginAccess(TRUE);
+   if (seekPosition + numBytes > MaxFileSize)
+       numBytes = MaxFileSize - seekPosition;	// write what fits
+   if (numBytes > 0)
+       Grow(seekPosition + numBytes, seekPosition);
+   if (inode->hdr->IsCompressed()) {		// already buffered
+       result = DoWriteAt(into, numBytes, seekPosition);
+       seekPosition += result;			// short if the disk is full
+   } else {
+       while (result < numBytes) {
+	   done = BufferedWrite(into + result, numBytes - result,
+				seekPosition);
+	   if (done == 0)
+	       break;
+	   result += done;
+	   seekPosition += done;
+       }
+   }
+   if (result > 0 && inode->hdr->setLastModifiedTime())
+       inode->dirty = TRUE;
+   EndAccess();
    return result;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::BufferedWrite
+// 	Write as much of a request as fits in the sector containing
+//	"position", and return the number of bytes written.  Whole
+//	sectors are written straight away; pieces of a sector are added
+//	to the write-behind buffer, which is written out once the sector
+//	is complete, or when we move on to some other part of the file.
+//
+//	We don't write past the end of the file; Write has already
+//	extended the file to hold the whole request.
+//
+//	A piece of a hole is buffered as a whole sector of zeros with the
+//	new data in it, so that flushing the buffer needn't read anything
+//	in.  The sector is allocated straight away, so that running out of
+//	disk space shows up now rather than when the buffer is flushed.
+//
+//	"from" -- the buffer containing the data to be written
+//	"numBytes" -- the number of bytes in the request
+//	"position" -- the offset within the file of the first byte
+//----------------------------------------------------------------------
+
+int
+OpenFile::BufferedWrite(char *from, int numBytes, int position)
+{
+    int sector = position / SectorSize;
+    int offset = position % SectorSize;
+    int fileLength = inode->hdr->FileLength();
+    char *writeBuffer = inode->writeBuffer;
+
+    if (numBytes > SectorSize - offset)
+	numBytes = SectorSize - offset;
+    if (position + numBytes > fileLength)
+	numBytes = fileLength - position;
+    if (numBytes <= 0)
+	return 0;
+
+    if (numBytes == SectorSize) {		// nothing to buffer
+	if (inode->bufSector == sector)
+	    inode->bufSector = -1;		// every byte is overwritten
+	return DoWriteAt(from, numBytes, position);
+    }
+
+    if (inode->bufSector != -1
+	&& (inode->bufSector != sector || offset != inode->bufHigh))
+	FlushBuffer();				// not a continuation
+    if (inode->bufSector == -1) {
+	if (ByteToSector(position) == 0) {	// a hole
+	    if (fileSystem->FillHoles(inode->hdr, hdrSector, sector, 1,
+				      &inode->blockMap[sector]) == 0)
+		return 0;			// disk full
+	    inode->dirty = FALSE;		// FillHoles wrote it
+	    bzero(writeBuffer, SectorSize);
+	    inode->bufLow = 0;
+	} else
+	    inode->bufLow = offset;
+	inode->bufSector = sector;
+    }
+    bcopy(from, &writeBuffer[offset], numBytes);
+    inode->bufHigh = offset + numBytes;
+    if (inode->bufLow == 0 && inode->bufHigh == SectorSize)
+	FlushBuffer();				// the sector is complete
+    return numBytes;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::FlushBuffer
+// 	Write the data in the write-behind buffer to disk.  If it covers
+//	the whole sector this is a single write; otherwise WriteAt reads
+//	in the rest of the sector first.
+//----------------------------------------------------------------------
+
+void
+OpenFile::FlushBuffer()
+{
+    int sector = inode->bufSector;
+
+    if (sector == -1)
+	return;
+    inode->bufSector = -1;		// so DoWriteAt doesn't flush us again
+    DoWriteAt(&inode->writeBuffer[inode->bufLow],
+	      inode->bufHigh - inode->bufLow,
+	      sector * SectorSize + inode->bufLow);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadAhead
+// 	Called after each Read.  If the file is being read in order, ask
+//	for the next ReadAheadWindow sectors to be read into the disk
+//	cache in the background, skipping those already asked for.
+//
+//	"position" -- the offset within the file of the first byte read
+//	"numBytes" -- the number of bytes read
+//----------------------------------------------------------------------
+
+void
+OpenFile::ReadAhead(int position, int numBytes)
+{
+    int first = position / SectorSize;
+    int last = (position + numBytes - 1) / SectorSize;
+    int fileSectors = divRoundUp(inode->hdr->FileLength(), SectorSize);
+    int i;
+
+    if (first != lastReadSector && first != lastReadSector + 1) {
+	lastReadSector = last;		// random access, don't bother
+	readAheadNext = last + 1;
+	return;
+    }
+    lastReadSector = last;
+    i = (readAheadNext > last + 1) ? readAheadNext : last + 1;
+    for (; i <= last + ReadAheadWindow && i < fileSectors; i++)
+	if (ByteToSector(i * SectorSize) != 0)	// nothing to read in a hole
+	    synchDisk->Prefetch(ByteToSector(i * SectorSize));
+    if (i > readAheadNext)
+	readAheadNext = i;
+}
+
 //----------------------------------------------------------------------
 // OpenFile::ReadAt/WriteAt
 // 	Read/write a portion of a file, starting at "position".
 //	Return the number of bytes actually written or read, but has
 //	no side effects (except that Write modifies the file, of course).
+//	ReadAt/WriteAt lock the file and call DoReadAt/DoWriteAt, which
+//	do the work.
 //
 //	There is no guarantee the request starts or ends on an even disk sector
 //	boundary; however the disk only knows how to read/write a whole disk
@@ -108,12 +381,14 @@ OpenFile::Write(char *into, int numBytes)
 //
 //	For ReadAt:
 //	   We read in all of the full or partial sectors that are part of the
-//	   request, but we only copy the part we are interested in.
+//	   request, but we only copy the part we are interested in.  Holes
+//	   are not read; they are all zeros.
 //	For WriteAt:
 //	   We must first read in any sectors that will be partially written,
 //	   so that we don't overwrite the unmodified portion.  We then copy
-//	   in the data that will be modified, and write back all the full
-//	   or partial sectors that are part of the request.
+//	   in the data that will be modified, allocate disk space for any
+//	   holes, and write back all the full or partial sectors that are
+//	   part of the request.  Writing past the end of the file extends it.
 //
 //	"into" -- the buffer to contain the data to be read from disk 
 //	"from" -- the buffer containing the data to be written to disk 
@@ -125,7 +400,29 @@ OpenFile::Write(char *into, int numBytes)
 int
 OpenFile::ReadAt(char *into, int numBytes, int position)
 {
-    int fileLength = hdr->FileLength();
+    int result;
+
+    BeginAccess(FALSE);
+    result = DoReadAt(into, numBytes, position);
+    EndAccess();
+    return result;
+}
+
+int
+OpenFile::WriteAt(char *from, int numBytes, int position)
+{
+    int result;
+
+    BeginAccess(TRUE);
+    result = DoWriteAt(from, numBytes, position);
+    EndAccess();
+    return result;
+}
+
+int
+OpenFile::DoReadAt(char *into, int numBytes, int position)
+{
+    int fileLength = inode->hdr->FileLength();
     int i, firstSector, lastSector, numSectors;
     char *buf;
 
@@ -135,6 +432,12 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
 	numBytes = fileLength - position;
     DEBUG('f', "Reading %d bytes at %d, from file of length %d.\n", 	
 			numBytes, position, fileLength);
+    if (inode->hdr->IsCompressed())
+	return CompressedReadAt(into, numBytes, position);
+    if (inode->bufSector != -1
+	&& position < (inode->bufSector + 1) * SectorSize
+	&& position + numBytes > inode->bufSector * SectorSize)
+	FlushBuffer();			// make sure we read the latest data
 
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
@@ -142,9 +445,15 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
 
     // read in all the full and partial sectors that we need
     buf = new char[numSectors * SectorSize];
-    for (i = firstSector; i <= lastSector; i++)	
-        synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]);
+    for (i = firstSector; i <= lastSector; i++) {
+	int sector = ByteToSector(i * SectorSize);
+
+	if (sector == 0)			// a hole
+	    bzero(&buf[(i - firstSector) * SectorSize], SectorSize);
+	else
+	    synchDisk->ReadSector(sector,
+				  &buf[(i - firstSector) * SectorSize]);
+    }
 
     // copy the part we want
     bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
@@ -153,23 +462,23 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
 }
 
 int
-OpenFile::WriteAt(char *from, int numBytes, int position)
+OpenFile::DoWriteAt(char *from, int numBytes, int position)
 {
-    int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    bool firstAligned, lastAligned;
+    int i, firstSector, lastSector, numSectors, allocated;
+    bool firstAligned, lastAligned, holes = FALSE;
     char *buf;
+    int *sectors;
 
-    if ((numBytes <= 0) || (position >= fileLength))
+    if ((numBytes <= 0) || (position >= MaxFileSize))
 	return 0;				// check request
-    if ((position + numBytes) > fileLength) {
-        BitMap *freeMap = new BitMap(NumSectors);
-        OpenFile *freeMapFile = new OpenFile(0);
-        freeMap->FetchFrom(freeMapFile);
-        hdr->externLength(freeMap, position+ numBytes - fileLength);
-    }
+    FlushBuffer();			// keep writes in order
+    if ((position + numBytes) > MaxFileSize)
+	numBytes = MaxFileSize - position;	// write what fits
+    Grow(position + numBytes, position);
     DEBUG('f', "Writing %d bytes at %d, from file of length %d.\n", 	
-			numBytes, position, fileLength);
+			numBytes, position, inode->hdr->FileLength());
+    if (inode->hdr->IsCompressed())
+	return CompressedWriteAt(from, numBytes, position);
 
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
@@ -182,22 +491,291 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
 
 // read in first and last sector, if they are to be partially modified
     if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);	
+        DoReadAt(buf, SectorSize, firstSector * SectorSize);	
     if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize], 
+        DoReadAt(&buf[(lastSector - firstSector) * SectorSize], 
 				SectorSize, lastSector * SectorSize);	
 
 // copy in the bytes we want to change 
     bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
 
-// write modified sectors back
-    for (i = firstSector; i <= lastSector; i++)	
-        synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]);
+// find disk space for any holes; if the disk is full, write what fits
+    for (i = firstSector; i <= lastSector; i++)
+	if (ByteToSector(i * SectorSize) == 0)
+	    holes = TRUE;
+    if (holes) {
+	allocated = fileSystem->FillHoles(inode->hdr, hdrSector, firstSector,
+				numSectors, &inode->blockMap[firstSector]);
+	inode->dirty = FALSE;			// FillHoles wrote it
+	if (allocated < numSectors) {
+	    numSectors = allocated;
+	    numBytes = min(numBytes,
+			   (firstSector + allocated) * SectorSize - position);
+	    if (numSectors == 0) {
+		delete [] buf;
+		return 0;
+	    }
+	}
+    }
+
+// write modified sectors back, all at once so that they can go to
+// several disks in parallel
+    sectors = new int[numSectors];
+    for (i = 0; i < numSectors; i++)	
+        sectors[i] = inode->blockMap[firstSector + i];
+    synchDisk->WriteSectors(numSectors, sectors, buf);
+    delete [] sectors;
     delete [] buf;
     return numBytes;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::CompressedReadAt/CompressedWriteAt
+// 	DoReadAt/DoWriteAt for a compressed file: copy the data out of
+//	(into) the extent buffer, one extent at a time.  The request has
+//	already been cut to the end of the file, which, for a write, has
+//	already been extended to hold it.  A write of a whole extent
+//	needn't read the old one in.
+//
+//	If the disk is too full to store the extent in the buffer, we
+//	can't move on to the next one, and return the bytes done so far.
+//----------------------------------------------------------------------
+
+int
+OpenFile::CompressedReadAt(char *into, int numBytes, int position)
+{
+    int done, count;
+
+    for (done = 0; done < numBytes; done += count) {
+	int offset = (position + done) % ExtentSize;
+
+	count = min(numBytes - done, ExtentSize - offset);
+	if (!LoadExtent((position + done) / ExtentSize, FALSE))
+	    break;
+	bcopy(&inode->extentBuffer[offset], into + done, count);
+    }
+    return done;
+}
+
+int
+OpenFile::CompressedWriteAt(char *from, int numBytes, int position)
+{
+    int done, count;
+
+    for (done = 0; done < numBytes; done += count) {
+	int offset = (position + done) % ExtentSize;
+
+	count = min(numBytes - done, ExtentSize - offset);
+	if (!LoadExtent((position + done) / ExtentSize, count == ExtentSize))
+	    break;
+	bcopy(from + done, &inode->extentBuffer[offset], count);
+	inode->extentDirty = TRUE;
+    }
+    return done;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::LoadExtent
+// 	Make the extent buffer hold extent "extent" of a compressed file,
+//	storing whatever it held before first.  Unless "overwrite" (the
+//	caller is about to replace all of it), read the extent in: the
+//	few sectors holding it compressed, uncompressing them, or if it is
+//	stored as is, each of its blocks, holes reading as zeros.
+//
+//	Compressed data that makes no sense -- perhaps the new version of
+//	the extent never made it to disk before a crash -- reads as zeros.
+//
+//	Return FALSE, leaving the buffer as it is, if what it held could
+//	not be stored.
+//----------------------------------------------------------------------
+
+bool
+OpenFile::LoadExtent(int extent, bool overwrite)
+{
+    int first = extent * ExtentBlocks;
+    int count = min(ExtentBlocks,
+		    divRoundUp(inode->hdr->FileLength(), SectorSize) - first);
+    int size = inode->extentSizes[extent];
+    char *buf = inode->extentBuffer;
+    int numSectors = (size == 0) ? count : divRoundUp(size, SectorSize);
+    char *data;
+    double start;
+
+    if (inode->bufExtent == extent)
+	return TRUE;
+    if (!StoreExtent())
+	return FALSE;
+    inode->bufExtent = extent;
+    bzero(buf, ExtentSize);
+    if (overwrite)
+	return TRUE;
+
+    data = (size == 0) ? buf : new char[numSectors * SectorSize];
+    for (int i = 0; i < numSectors; i++) {
+	int sector = ByteToSector((first + i) * SectorSize);
+
+	if (sector == 0)			// a hole
+	    bzero(&data[i * SectorSize], SectorSize);
+	else
+	    synchDisk->ReadSector(sector, &data[i * SectorSize]);
+    }
+    if (size == 0)
+	return TRUE;
+    start = HostTime();
+    if (Decompress(data, size, buf, ExtentSize) != ExtentSize) {
+	DEBUG('f', "Extent %d of file at sector %d is corrupt.\n", extent,
+	      hdrSector);
+	bzero(buf, ExtentSize);
+    }
+    stats->decompressUsecs += (int) ((HostTime() - start) * 1000000);
+    delete [] data;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::StoreExtent
+// 	If the extent in the buffer has changed, write it out: compressed,
+//	if that saves at least a sector, otherwise as is -- or not at all,
+//	if it is all zeros.  The file system first gives the extent just
+//	the sectors it needs.
+//
+//	Return FALSE if the disk is too full: the old version stays on
+//	disk, and the buffer stays dirty, to be stored once there is room.
+//----------------------------------------------------------------------
+
+bool
+OpenFile::StoreExtent()
+{
+    int extent = inode->bufExtent;
+    int first = extent * ExtentBlocks;
+    char *buf = inode->extentBuffer;
+    int count, size = 0, numSectors = 0;
+    int *sectors;
+    char *data;
+    double start;
+
+    if (extent == -1 || !inode->extentDirty)
+	return TRUE;
+    count = min(ExtentBlocks,
+		divRoundUp(inode->hdr->FileLength(), SectorSize) - first);
+    ByteToSector((first + count - 1) * SectorSize);	// map is up to date
+    sectors = &inode->blockMap[first];
+
+    data = new char[ExtentSize];
+    for (int i = 0; i < ExtentSize && numSectors == 0; i++)
+	if (buf[i] != 0)
+	    numSectors = count;			// not all zeros
+    if (numSectors > 0) {
+	start = HostTime();
+	size = Compress(buf, ExtentSize, data, (count - 1) * SectorSize);
+	stats->compressUsecs += (int) ((HostTime() - start) * 1000000);
+	if (size == -1)
+	    size = 0;				// store it as is
+	else {
+	    numSectors = divRoundUp(size, SectorSize);
+	    bzero(&data[size], numSectors * SectorSize - size);
+	}
+    }
+    DEBUG('f', "Storing extent %d in %d sectors, compressed size %d.\n",
+	  extent, numSectors, size);
+
+    if (!fileSystem->StoreExtent(inode->hdr, hdrSector, inode->extentSizes,
+				 extent, size, numSectors, sectors)) {
+	DEBUG('f', "Disk full, extent %d of file at sector %d not stored\n",
+	      extent, hdrSector);
+	delete [] data;
+	return FALSE;
+    }
+    if (numSectors > 0)
+	synchDisk->WriteSectors(numSectors, sectors, (size != 0) ? data : buf);
+    inode->extentDirty = FALSE;
+    inode->dirty = FALSE;			// StoreExtent wrote it
+    stats->numExtentsStored++;
+    stats->compressBytesIn += count * SectorSize;
+    stats->compressBytesOut += numSectors * SectorSize;
+    delete [] data;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Extend
+// 	Make the file "size" bytes longer, without writing anything: the
+//	new part of the file is a hole.  Return FALSE if the file would
+//	be too big.
+//----------------------------------------------------------------------
+
+bool
+OpenFile::Extend(int size)
+{
+    bool result;
+
+    BeginAccess(TRUE);
+    result = Grow(inode->hdr->FileLength() + size,
+		  inode->hdr->FileLength() + size);
+    EndAccess();
+    return result;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Grow
+// 	Make the file "length" bytes long, if it is shorter, for a write
+//	starting at "position".  No disk space is allocated (cf. DoWriteAt).
+//	The new header is written back with the next allocation, or when
+//	the file is closed.
+//
+//	The part of the old last sector past the end of the file may hold
+//	stale data, which would show through once it is inside the file;
+//	we clear it, unless the write is about to cover it anyway.  (The
+//	extents of a compressed file are always zero past the end.)
+//
+//	Return FALSE, leaving the file alone, if it would be too big.
+//----------------------------------------------------------------------
+
+bool
+OpenFile::Grow(int length, int position)
+{
+    int fileLength = inode->hdr->FileLength();
+    int end = divRoundUp(fileLength, SectorSize) * SectorSize;
+
+    if (length <= fileLength)
+	return TRUE;
+    if (length > MaxFileSize)
+	return FALSE;
+    if (position > fileLength && fileLength < end
+	&& !inode->hdr->IsCompressed() && ByteToSector(fileLength) != 0) {
+	char *zeros = new char[SectorSize];
+
+	bzero(zeros, SectorSize);
+	DoWriteAt(zeros, min(position, end) - fileLength, fileLength);
+	delete [] zeros;
+    }
+    inode->hdr->externLength(length - inode->hdr->FileLength());
+    inode->dirty = TRUE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ByteToSector
+// 	Return which disk sector is storing a particular byte within the
+//	file, or 0 if it falls in a hole, using the block map in the
+//	inode.  If the file has grown since the map was built, add the
+//	new blocks to it first.
+//
+//	"offset" is the location within the file of the byte in question
+//----------------------------------------------------------------------
+
+int
+OpenFile::ByteToSector(int offset)
+{
+    int block = offset / SectorSize;
+
+    if (block >= inode->mapSectors)
+	inode->mapSectors = inode->hdr->LoadBlockMap(inode->blockMap,
+						     inode->mapSectors);
+    ASSERT(block < inode->mapSectors);
+    return inode->blockMap[block];
+}
+
 //----------------------------------------------------------------------
 // OpenFile::Length
 // 	Return the number of bytes in the file.
@@ -206,5 +784,5 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
 int
 OpenFile::Length() 
 { 
-    return hdr->FileLength(); 
+    return inode->hdr->FileLength(); 
 }
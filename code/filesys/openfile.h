@@ -9,9 +9,11 @@
 //
 //	The other is the "real" implementation, that turns these
 //	operations into read and write disk sector requests. 
-//	In this baseline implementation of the file system, we don't 
-//	worry about concurrent accesses to the file system
-//	by different threads -- this is part of the assignment.
+//	Files opened through FileSystem::Open may be used by several
+//	threads at once: each read or write locks the file (cf. filesys.h).
+//	Everything about a file except the position in it is kept in an
+//	"inode", shared by all the OpenFiles for that file, so that they
+//	all see the same header and the same buffered data.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -64,11 +66,58 @@ class OpenFile {
 
 #else // FILESYS
 class FileHeader;
+class RWlock;
+
+// Number of sectors read ahead of a file being read sequentially
+#define ReadAheadWindow		4
+
+// The following class defines an entry in the file system's table of
+// files in use (its "inode table"), found by the sector of the file's
+// header: the in-memory copy of the header, and everything else shared
+// by the OpenFiles for the file, along with the reader/writer lock on
+// it.  An entry is kept while the file is open or its lock is held or
+// waited for; after that, it stays cached until the slot is needed for
+// some other file.
+
+class Inode {
+  public:
+    int sector;				// Header sector; -1 if entry is free
+    int refs;				// Number of OpenFiles for it
+    int lockers;			// Threads holding or waiting for lock
+    bool removed;			// Deleted while open; free it when
+					// the last OpenFile is closed
+    RWlock *lock;
+    int lastUse;			// For LRU replacement
+
+    bool loaded;			// Is the header below read in?
+    FileHeader *hdr;			// The file header
+    bool dirty;				// Header changed since last written
+    int *blockMap;			// Disk sector of each block of the
+					// file, so that we need not read the
+					// indirect blocks on every access
+    int mapSectors;			// Number of entries filled in
+
+    char *writeBuffer;			// Write-behind buffer for one sector
+    int bufSector;			// Sector of the file it holds, or -1
+    int bufLow, bufHigh;		// Range of bytes in it to be written
+
+    int *extentSizes;			// For a compressed file: compressed
+					// size of each extent (cf. filehdr.h)
+    char *extentBuffer;			// One extent, uncompressed
+    int bufExtent;			// Which extent it holds, or -1
+    bool extentDirty;			// Changed since it was last stored
+};
 
 class OpenFile {
   public:
-    OpenFile(int sector);		// Open a file whose header is located
-					// at "sector" on the disk
+    OpenFile(int sector, bool shared = FALSE);
+					// Open a file whose header is located
+					// at "sector" on the disk; "shared"
+					// if other threads may use the file
+    OpenFile(Inode *inode, bool shared = FALSE);
+					// Same, given its inode (for the file
+					// system to open the root directory,
+					// before "fileSystem" is set)
     ~OpenFile();			// Close the file
 
     void Seek(int position); 		// Set the position from which to 
@@ -89,14 +138,42 @@ class OpenFile {
 					// file (this interface is simpler 
 					// than the UNIX idiom -- lseek to 
 					// end of file, tell, lseek back 
-    int getFd() {return -1;}
-    
-    FileHeader *getHdr() {return hdr;}
+    bool Extend(int size);		// Add "size" bytes of zeros to the
+					// file, taking no disk space
+
+    FileHeader *getHdr() {return inode->hdr;}
+
+    void Flush();			// Write back any buffered data, and
+					// the header if the times in it
+					// have changed
 
   private:
     int hdrSector;
-    FileHeader *hdr;			// Header for this file 
+    Inode *inode;			// What we know about the file
     int seekPosition;	// Current position within the file
+    bool shared;			// Lock the file on each access
+
+    int lastReadSector;			// Last sector of the file read
+    int readAheadNext;			// First sector not yet read ahead
+
+    void BeginAccess(bool write);	// Lock the file, if shared
+    void EndAccess();			// Unlock it again
+    int DoReadAt(char *into, int numBytes, int position);
+    int DoWriteAt(char *from, int numBytes, int position);
+					// ReadAt/WriteAt, file already locked
+    int BufferedWrite(char *from, int numBytes, int position);
+    bool Grow(int length, int position);
+					// Extend the file for a write
+    void FlushBuffer();			// Write out the write-behind buffer
+    int CompressedReadAt(char *into, int numBytes, int position);
+    int CompressedWriteAt(char *from, int numBytes, int position);
+					// DoReadAt/DoWriteAt, compressed file
+    bool LoadExtent(int extent, bool overwrite);
+					// Bring an extent into the buffer
+    bool StoreExtent();			// Compress it and write it out;
+					// FALSE if the disk is full
+    int ByteToSector(int offset);	// Look up the block map
+    void ReadAhead(int position, int numBytes);
 };
 
 #endif // FILESYS
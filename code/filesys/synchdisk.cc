@@ -8,7 +8,17 @@
 //	Use a semaphore to synchronize the interrupt handlers with the
 //	pending requests.  And, because the physical disk can only
 //	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	exclusion.  When there are several disks, each has its own
+//	semaphore and lock, so requests to different disks overlap.
+//	Anyone holding more than one of the locks takes them in order,
+//	so that we can't deadlock.
+//
+//	On top of that we keep a small LRU cache of sectors.  Writes go
+//	straight to the disk (or the journal) and then update any cached
+//	copy.  Read-ahead requests reserve a cache entry and hand it to a
+//	background thread, which does the actual read; a ReadSector of a
+//	sector that is still being read waits for that read to finish
+//	rather than starting another one.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -16,6 +26,8 @@
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "journal.h"
+#include "system.h"
 
 //----------------------------------------------------------------------
 // DiskRequestDone
@@ -25,26 +37,85 @@
 
 static void
 DiskRequestDone (int arg)
+{
+    DiskUnit* unit = (DiskUnit *)arg;
+
+    unit->done->V();
+}
+
+//----------------------------------------------------------------------
+// DiskPrefetchDaemon
+// 	Body of the read-ahead thread; also a C routine, for the same
+//	reason.
+//----------------------------------------------------------------------
+
+static void
+DiskPrefetchDaemon (int arg)
 {
     SynchDisk* disk = (SynchDisk *)arg;
 
-    disk->RequestDone();
+    disk->PrefetchDaemon();
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::SynchDisk
-// 	Initialize the synchronous interface to the physical disk, in turn
-//	initializing the physical disk.
+// 	Initialize the synchronous interface to the physical disks, in turn
+//	initializing the physical disks, and start the read-ahead threads,
+//	one per disk so that all the disks can be reading ahead at once.
+//	Set the geometry of the volume the file system will see.
 //
 //	"name" -- UNIX file name to be used as storage for the disk data
-//	   (usually, "DISK")
+//	   (usually, "DISK"); with several disks, the files are "name.0",
+//	   "name.1", and so on
+//	"mapped" -- should the raw disks map those files into memory?
+//	"sectorsPerTrack", "tracks" -- new geometry for each disk, if any
+//	"arrayLevel" -- how to put the disks together
+//	"numDisks" -- how many disks there are
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk(char* name)
+SynchDisk::SynchDisk(char* name, bool mapped, int sectorsPerTrack, int tracks,
+		     DiskArrayLevel arrayLevel, int numDisks)
 {
-    semaphore = new Semaphore("synch disk", 0);
-    lock = new Lock("synch disk lock");
-    disk = new Disk(name, DiskRequestDone, (int) this);
+    char unitName[100];
+
+    ASSERT(numDisks >= 1 && (numDisks == 1 || arrayLevel != SingleDisk));
+    level = arrayLevel;
+    numUnits = numDisks;
+    units = new DiskUnit[numUnits];
+    for (int i = 0; i < numUnits; i++) {
+	if (numUnits == 1)
+	    strcpy(unitName, name);
+	else
+	    sprintf(unitName, "%s.%d", name, i);
+	units[i].done = new Semaphore("synch disk", 0);
+	units[i].lock = new Lock("synch disk lock");
+	units[i].users = 0;
+	units[i].disk = new Disk(unitName, DiskRequestDone, (int) &units[i],
+				 mapped, sectorsPerTrack, tracks);
+	ASSERT(units[i].disk->TrackSize() == units[0].disk->TrackSize()
+	       && units[i].disk->Tracks() == units[0].disk->Tracks());
+    }
+
+    // A striped volume has the same number of tracks as each disk; a
+    // track of the volume is made of that track on every disk.
+    diskSectorsPerTrack = units[0].disk->TrackSize();
+    if (level == Striped)
+	diskSectorsPerTrack *= numUnits;
+    diskNumTracks = units[0].disk->Tracks();
+    journal = NULL;
+
+    cache = new DiskCacheEntry[DiskCacheSize];
+    for (int i = 0; i < DiskCacheSize; i++)
+	cache[i].state = CacheEmpty;
+    cacheClock = 0;
+    cacheLock = new Lock("sector cache lock");
+    cacheReady = new Condition("sector cache ready");
+    prefetchQueue = new SynchList;
+
+    for (int i = 0; i < numUnits; i++) {
+	Thread *t = new Thread("read-ahead");
+	t->Fork(DiskPrefetchDaemon, (int) this);
+    }
 }
 
 //----------------------------------------------------------------------
@@ -55,15 +126,130 @@ SynchDisk::SynchDisk(char* name)
 
 SynchDisk::~SynchDisk()
 {
-    delete disk;
-    delete lock;
-    delete semaphore;
+    for (int i = 0; i < numUnits; i++) {
+	delete units[i].disk;
+	delete units[i].lock;
+	delete units[i].done;
+    }
+    delete [] units;
+    delete [] cache;
+    delete cacheLock;
+    delete cacheReady;
+    delete prefetchQueue;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Locate
+// 	Return the disk holding a sector of the volume, and where on that
+//	disk it is.  On a mirror, this is the first disk; see NearestMirror.
+//
+//	"sectorNumber" -- the sector of the volume
+//	"unitSector" -- set to the sector of the disk
+//----------------------------------------------------------------------
+
+DiskUnit *
+SynchDisk::Locate(int sectorNumber, int *unitSector)
+{
+    ASSERT(sectorNumber >= 0 && sectorNumber < NumSectors);
+    if (level == Striped) {
+	*unitSector = sectorNumber / numUnits;
+	return &units[sectorNumber % numUnits];
+    }
+    *unitSector = sectorNumber;
+    return &units[0];
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::NearestMirror
+// 	Return the copy of a sector that we can read soonest: one on a
+//	disk that nobody is using, if there is one, and then the one whose
+//	head is closest to it.
+//
+//	"sectorNumber" -- the sector to be read
+//----------------------------------------------------------------------
+
+DiskUnit *
+SynchDisk::NearestMirror(int sectorNumber)
+{
+    DiskUnit *best = &units[0];
+    int bestLatency = best->disk->ComputeLatency(sectorNumber, FALSE);
+
+    for (int i = 1; i < numUnits; i++) {
+	int latency = units[i].disk->ComputeLatency(sectorNumber, FALSE);
+
+	if (units[i].users < best->users
+		|| (units[i].users == best->users && latency < bestLatency)) {
+	    best = &units[i];
+	    bestLatency = latency;
+	}
+    }
+    return best;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::FindEntry
+// 	Return the cache entry for a sector, or NULL if it isn't cached.
+//	Called with the cache lock held.
+//----------------------------------------------------------------------
+
+DiskCacheEntry *
+SynchDisk::FindEntry(int sectorNumber)
+{
+    for (int i = 0; i < DiskCacheSize; i++)
+	if (cache[i].state != CacheEmpty && cache[i].sector == sectorNumber)
+	    return &cache[i];
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReserveEntry
+// 	Pick the least recently used entry that isn't being read into,
+//	and mark it as being read into for "sectorNumber".  Return NULL if
+//	every entry is busy.  Called with the cache lock held.
+//----------------------------------------------------------------------
+
+DiskCacheEntry *
+SynchDisk::ReserveEntry(int sectorNumber)
+{
+    DiskCacheEntry *victim = NULL;
+
+    for (int i = 0; i < DiskCacheSize; i++) {
+	if (cache[i].state == CacheReading)
+	    continue;
+	if (victim == NULL || cache[i].state == CacheEmpty
+		|| (victim->state != CacheEmpty
+		    && cache[i].lastUse < victim->lastUse))
+	    victim = &cache[i];
+    }
+    if (victim != NULL) {
+	victim->state = CacheReading;
+	victim->sector = sectorNumber;
+	victim->stale = FALSE;
+	victim->lastUse = ++cacheClock;
+    }
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::FinishRead
+// 	The read into a cache entry is done.  Keep the data, unless the
+//	sector was written in the meantime, and wake up anyone waiting for
+//	it.  Called with the cache lock held.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::FinishRead(DiskCacheEntry *entry)
+{
+    entry->state = entry->stale ? CacheEmpty : CacheValid;
+    cacheReady->Broadcast(cacheLock);
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::ReadSector
 // 	Read the contents of a disk sector into a buffer.  Return only
-//	after the data has been read.
+//	after the data has been read.  If the journal holds a copy of the
+//	sector that has not reached its home location yet, use that;
+//	otherwise use the cached copy, if there is one.
 //
 //	"sectorNumber" -- the disk sector to read
 //	"data" -- the buffer to hold the contents of the disk sector
@@ -72,16 +258,67 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    DiskCacheEntry *entry;
+
+    cacheLock->Acquire();
+    if (journal != NULL && journal->Lookup(sectorNumber, data)) {
+	cacheLock->Release();
+	return;
+    }
+    while ((entry = FindEntry(sectorNumber)) != NULL
+					&& entry->state == CacheReading)
+	cacheReady->Wait(cacheLock);	// being read already, wait for it
+    if (entry != NULL) {
+	bcopy(entry->data, data, SectorSize);
+	entry->lastUse = ++cacheClock;
+	cacheLock->Release();
+	return;
+    }
+
+    entry = ReserveEntry(sectorNumber);
+    cacheLock->Release();
+    if (entry == NULL) {		// cache is all busy, go around it
+	RawReadSector(sectorNumber, data);
+	return;
+    }
+    RawReadSector(sectorNumber, entry->data);
+    cacheLock->Acquire();
+    bcopy(entry->data, data, SectorSize);
+    FinishRead(entry);
+    cacheLock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::RawReadSector
+// 	Read the contents of a disk sector from the disk itself.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::RawReadSector(int sectorNumber, char* data)
+{
+    DiskUnit *unit;
+    int unitSector;
+
+    if (level == Mirrored) {
+	unit = NearestMirror(sectorNumber);
+	unitSector = sectorNumber;
+    } else
+	unit = Locate(sectorNumber, &unitSector);
+
+    unit->users++;
+    unit->lock->Acquire();		// only one disk I/O at a time
+    unit->disk->ReadRequest(unitSector, data);
+    unit->done->P();			// wait for interrupt
+    unit->lock->Release();
+    unit->users--;
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::WriteSector
 // 	Write the contents of a buffer into a disk sector.  Return only
-//	after the data has been written.
+//	after the data has been written -- or, for metadata, once the
+//	journal has taken a copy to log.  Then bring the cached copy of
+//	the sector, if any, up to date.
 //
 //	"sectorNumber" -- the disk sector to be written
 //	"data" -- the new contents of the disk sector
@@ -90,20 +327,176 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    WriteSectors(1, &sectorNumber, data);
 }
 
 //----------------------------------------------------------------------
-// SynchDisk::RequestDone
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// SynchDisk::WriteSectors
+// 	Write the contents of a buffer into several disk sectors, as for
+//	WriteSector, but sending the sectors that go to different disks
+//	to those disks at the same time.
+//
+//	"count" -- the number of sectors to write
+//	"sectorNumbers" -- the disk sectors to be written
+//	"data" -- the new contents of the sectors, one after the other
 //----------------------------------------------------------------------
 
 void
-SynchDisk::RequestDone()
-{ 
-    semaphore->V();
+SynchDisk::WriteSectors(int count, int *sectorNumbers, char* data)
+{
+    int *inPlace = new int[count];
+    char *inPlaceData = new char[count * SectorSize];
+    int numInPlace = 0;
+
+    for (int i = 0; i < count; i++) {
+	char *sectorData = &data[i * SectorSize];
+
+	if (journal == NULL || !journal->Absorb(sectorNumbers[i], sectorData)) {
+	    inPlace[numInPlace] = sectorNumbers[i];
+	    bcopy(sectorData, &inPlaceData[numInPlace * SectorSize], SectorSize);
+	    numInPlace++;
+	}
+    }
+    if (numInPlace > 0)
+	RawWriteSectors(numInPlace, inPlace, inPlaceData);
+    for (int i = 0; i < count; i++)
+	UpdateCache(sectorNumbers[i], &data[i * SectorSize]);
+    delete [] inPlace;
+    delete [] inPlaceData;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::UpdateCache
+// 	A sector has been written; bring the cached copy up to date.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::UpdateCache(int sectorNumber, char* data)
+{
+    DiskCacheEntry *entry;
+
+    cacheLock->Acquire();
+    entry = FindEntry(sectorNumber);
+    if (entry != NULL) {
+	if (entry->state == CacheReading)
+	    entry->stale = TRUE;	// the read may have the old data
+	else
+	    bcopy(data, entry->data, SectorSize);
+    }
+    cacheLock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::RawWriteSector
+// 	Write the contents of a buffer into a disk sector on the disk
+//	itself (on every disk, for a mirror).
+//----------------------------------------------------------------------
+
+void
+SynchDisk::RawWriteSector(int sectorNumber, char* data)
+{
+    RawWriteSectors(1, &sectorNumber, data);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::RawWriteSectors
+// 	Write several sectors on the disks themselves.  We go in rounds:
+//	in each round, we start the next request on every disk that has
+//	one, and then wait for all of them to finish, so the disks work
+//	at the same time.  On a mirror, every sector is written to every
+//	disk.  Each disk writes its sectors in the order given.
+//
+//	"count" -- the number of sectors to write
+//	"sectorNumbers" -- the disk sectors to be written
+//	"data" -- the new contents of the sectors, one after the other
+//----------------------------------------------------------------------
+
+void
+SynchDisk::RawWriteSectors(int count, int *sectorNumbers, char* data)
+{
+    int *next = new int[numUnits];	// next of "sectorNumbers" for each
+					// disk to look at
+    bool *started = new bool[numUnits];
+    int remaining = (level == Mirrored) ? count * numUnits : count;
+    int unitSector;
+
+    for (int u = 0; u < numUnits; u++) {
+	next[u] = 0;
+	units[u].users++;
+    }
+    while (remaining > 0) {
+	for (int u = 0; u < numUnits; u++) {	// start a request on each
+	    started[u] = FALSE;
+	    for (; next[u] < count; next[u]++) {
+		int i = next[u];
+
+		if (level != Mirrored
+			&& Locate(sectorNumbers[i], &unitSector) != &units[u])
+		    continue;		// sector is on another disk
+		if (level == Mirrored)
+		    unitSector = sectorNumbers[i];
+		units[u].lock->Acquire();
+		units[u].disk->WriteRequest(unitSector, &data[i * SectorSize]);
+		started[u] = TRUE;
+		next[u]++;
+		break;
+	    }
+	}
+	for (int u = 0; u < numUnits; u++)	// and wait for them all
+	    if (started[u]) {
+		units[u].done->P();
+		units[u].lock->Release();
+		remaining--;
+	    }
+    }
+    for (int u = 0; u < numUnits; u++)
+	units[u].users--;
+    delete [] next;
+    delete [] started;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Prefetch
+// 	Arrange for a sector to be read into the cache by the read-ahead
+//	thread, and return at once.  Nothing is done if the sector is
+//	already cached, or if the journal has a newer copy of it.
+//
+//	"sectorNumber" -- the disk sector to read ahead
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Prefetch(int sectorNumber)
+{
+    DiskCacheEntry *entry = NULL;
+    char *buf = new char[SectorSize];
+
+    cacheLock->Acquire();
+    if (FindEntry(sectorNumber) == NULL
+	    && (journal == NULL || !journal->Lookup(sectorNumber, buf)))
+	entry = ReserveEntry(sectorNumber);
+    cacheLock->Release();
+    delete [] buf;
+    if (entry != NULL) {
+	DEBUG('d', "Reading ahead sector %d\n", sectorNumber);
+	prefetchQueue->Append((void *)entry);
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::PrefetchDaemon
+// 	A read-ahead thread.  Fill each cache entry queued by Prefetch
+//	from the disk, in order.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::PrefetchDaemon()
+{
+    for (;;) {
+	DiskCacheEntry *entry = (DiskCacheEntry *)prefetchQueue->Remove();
+
+	RawReadSector(entry->sector, entry->data);
+	cacheLock->Acquire();
+	FinishRead(entry);
+	cacheLock->Release();
+    }
 }
@@ -13,6 +13,44 @@
 
 #include "disk.h"
 #include "synch.h"
+#include "synchlist.h"
+
+class Journal;
+
+// How the disks under a SynchDisk are put together: a single disk; disks
+// with consecutive sectors spread round-robin across them ("striped",
+// RAID-0); or disks that all hold the same data ("mirrored", RAID-1).
+enum DiskArrayLevel { SingleDisk, Striped, Mirrored };
+
+// The following class defines one of the disks under a SynchDisk,
+// along with what it takes to wait for its requests to finish.
+
+class DiskUnit {
+  public:
+    Disk *disk;				// Raw disk device
+    Semaphore *done;			// To synchronize requesting thread
+					// with the interrupt handler
+    Lock *lock;				// Only one request at a time
+    int users;				// Threads using or waiting for it
+};
+
+// Number of sectors kept in the sector cache
+#define DiskCacheSize		16
+
+// State of an entry in the sector cache
+enum CacheState { CacheEmpty, CacheReading, CacheValid };
+
+// The following class defines an entry in the sector cache: a copy of
+// one disk sector, or a buffer that a read is in the middle of filling.
+
+class DiskCacheEntry {
+  public:
+    CacheState state;
+    int sector;				// Which sector this is a copy of
+    bool stale;				// Sector was written while being read
+    int lastUse;			// For LRU replacement
+    char data[SectorSize];
+};
 
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
@@ -24,12 +62,25 @@
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
 // returning.
+//
+// The sectors may be spread over several disks, each with its own head
+// and interrupt, that work at the same time: consecutive sectors are
+// striped across the disks, or every disk keeps a copy of every sector.
+// Writes of several sectors at once (WriteSectors) keep all the disks
+// busy, and a read from a mirror goes to the disk that can get to the
+// sector soonest.
+//
+// Recently read sectors are kept in a small cache, and a thread may ask
+// for a sector to be read into the cache in the background (Prefetch),
+// so that a later ReadSector of it does not have to wait for the disk.
 class SynchDisk {
   public:
-    SynchDisk(char* name);    		// Initialize a synchronous disk,
-					// by initializing the raw Disk.
+    SynchDisk(char* name, bool mapped = FALSE, int sectorsPerTrack = 0,
+	      int tracks = 0, DiskArrayLevel arrayLevel = SingleDisk,
+	      int numDisks = 1);	// Initialize a synchronous disk,
+					// by initializing the raw Disks.
     ~SynchDisk();			// De-allocate the synch disk data
-    
+
     void ReadSector(int sectorNumber, char* data);
     					// Read/write a disk sector, returning
     					// only once the data is actually read 
@@ -37,17 +88,43 @@ class SynchDisk {
     					// Disk::ReadRequest/WriteRequest and
 					// then wait until the request is done.
     void WriteSector(int sectorNumber, char* data);
-    
-    void RequestDone();			// Called by the disk device interrupt
-					// handler, to signal that the
-					// current disk operation is complete.
+    void WriteSectors(int count, int *sectorNumbers, char* data);
+					// Write several sectors, using
+					// all the disks at once
+
+    void RawReadSector(int sectorNumber, char* data);
+    void RawWriteSector(int sectorNumber, char* data);
+    void RawWriteSectors(int count, int *sectorNumbers, char* data);
+					// Same, but bypassing the journal
+					// and the sector cache
+    void SetJournal(Journal *j) { journal = j; }
+					// Route reads and writes through
+					// the file system journal
+
+    void Prefetch(int sectorNumber);	// Start reading a sector into the
+					// cache, without waiting for it
+
+    void PrefetchDaemon();		// Body of the read-ahead threads
 
   private:
-    Disk *disk;		  		// Raw disk device
-    Semaphore *semaphore; 		// To synchronize requesting thread 
-					// with the interrupt handler
-    Lock *lock;		  		// Only one read/write request
-					// can be sent to the disk at a time
+    DiskUnit *units;			// The raw disks
+    int numUnits;
+    DiskArrayLevel level;		// How they are put together
+    Journal *journal;			// Metadata log, if any
+
+    DiskCacheEntry *cache;		// The sector cache
+    int cacheClock;			// Logical time, for LRU
+    Lock *cacheLock;			// Protects the cache
+    Condition *cacheReady;		// Signalled when a read completes
+    SynchList *prefetchQueue;		// Entries for the read-ahead threads
+					// to fill
+
+    DiskUnit *Locate(int sectorNumber, int *unitSector);
+    DiskUnit *NearestMirror(int sectorNumber);
+    void UpdateCache(int sectorNumber, char* data);
+    DiskCacheEntry *FindEntry(int sectorNumber);
+    DiskCacheEntry *ReserveEntry(int sectorNumber);
+    void FinishRead(DiskCacheEntry *entry);
 };
 
 #endif // SYNCHDISK_H
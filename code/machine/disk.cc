@@ -19,11 +19,21 @@
 
 // We put this at the front of the UNIX file representing the
 // disk, to make it less likely we will accidentally treat a useful file 
-// as a disk (which would probably trash the file's contents).
-#define MagicNumber 	0x456789ab
+// as a disk (which would probably trash the file's contents).  It is
+// followed by the geometry of the disk: the sector size, the number of
+// sectors per track and the number of tracks.
+#define MagicNumber 	0x456789ac
+#define HeaderSize 	(4 * sizeof(int))
+
+// Disks made before the geometry was recorded hold just this magic
+// number, and have the default geometry.
+#define OldMagicNumber 	0x456789ab
 #define MagicSize 	sizeof(int)
 
-#define DiskSize 	(MagicSize + (NumSectors * SectorSize))
+#define DiskSize 	(headerSize + (numTracks * trackSize * SectorSize))
+
+int diskSectorsPerTrack = DefaultSectorsPerTrack;
+int diskNumTracks = DefaultNumTracks;
 
 // dummy procedure because we can't take a pointer of a member function
 static void DiskDone(int arg) { ((Disk *)arg)->HandleInterrupt(); }
@@ -32,17 +42,22 @@ static void DiskDone(int arg) { ((Disk *)arg)->HandleInterrupt(); }
 // Disk::Disk()
 // 	Initialize a simulated disk.  Open the UNIX file (creating it
 //	if it doesn't exist), and check the magic number to make sure it's 
-// 	ok to treat it as Nachos disk storage.
+// 	ok to treat it as Nachos disk storage.  The geometry of the disk
+//	is taken from the front of the file, unless a new one is given.
 //
 //	"name" -- text name of the file simulating the Nachos disk
 //	"callWhenDone" -- interrupt handler to be called when disk read/write
 //	   request completes
 //	"callArg" -- argument to pass the interrupt handler
+//	"mapped" -- should the UNIX file be mapped into memory?
+//	"sectorsPerTrack", "tracks" -- geometry to give the disk, or 0 to
+//	   keep the one it has (or use the default, for a new disk)
 //----------------------------------------------------------------------
 
-Disk::Disk(char* name, VoidFunctionPtr callWhenDone, int callArg)
+Disk::Disk(char* name, VoidFunctionPtr callWhenDone, int callArg, bool mapped,
+	   int sectorsPerTrack, int tracks)
 {
-    int magicNum;
+    int header[HeaderSize / sizeof(int)];
     int tmp = 0;
 
     DEBUG('d', "Initializing the disk, 0x%x 0x%x\n", callWhenDone, callArg);
@@ -52,29 +67,64 @@ Disk::Disk(char* name, VoidFunctionPtr callWhenDone, int callArg)
     bufferInit = 0;
     
     fileno = OpenForReadWrite(name, FALSE);
-    if (fileno >= 0) {		 	// file exists, check magic number 
-	Read(fileno, (char *) &magicNum, MagicSize);
-	ASSERT(magicNum == MagicNumber);
-    } else {				// file doesn't exist, create it
-        fileno = OpenForWrite(name);
-	magicNum = MagicNumber;  
-	WriteFile(fileno, (char *) &magicNum, MagicSize); // write magic number
+    if (fileno >= 0 && sectorsPerTrack == 0) {	// file exists, check magic number 
+	Read(fileno, (char *) header, MagicSize);
+	if (header[0] == OldMagicNumber) {
+	    headerSize = MagicSize;
+	    trackSize = DefaultSectorsPerTrack;
+	    numTracks = DefaultNumTracks;
+	} else {
+	    ASSERT(header[0] == MagicNumber);
+	    Read(fileno, (char *) &header[1], HeaderSize - MagicSize);
+	    ASSERT(header[1] == SectorSize);	// compiled for another size
+	    headerSize = HeaderSize;
+	    trackSize = header[2];
+	    numTracks = header[3];
+	}
+    } else {				// create the file, or start it over
+	if (fileno < 0)
+	    fileno = OpenForWrite(name);
+	if (sectorsPerTrack == 0) {
+	    sectorsPerTrack = DefaultSectorsPerTrack;
+	    tracks = DefaultNumTracks;
+	}
+	ASSERT(sectorsPerTrack > 0 && tracks > 0);
+	headerSize = HeaderSize;
+	trackSize = sectorsPerTrack;
+	numTracks = tracks;
+	header[0] = MagicNumber;
+	header[1] = SectorSize;
+	header[2] = sectorsPerTrack;
+	header[3] = tracks;
+	Lseek(fileno, 0, 0);
+	WriteFile(fileno, (char *) header, HeaderSize); // write magic number
+							// and geometry
 
 	// need to write at end of file, so that reads will not return EOF
         Lseek(fileno, DiskSize - sizeof(int), 0);	
 	WriteFile(fileno, (char *)&tmp, sizeof(int));  
     }
+    DEBUG('d', "Disk %s has %d tracks of %d sectors of %d bytes\n",
+	  name, numTracks, trackSize, SectorSize);
+    image = NULL;
+    if (mapped) {
+	image = MapFile(fileno, DiskSize);
+	if (image == NULL)
+	    DEBUG('d', "Can't map %s, using read and write instead\n", name);
+    }
     active = FALSE;
 }
 
 //----------------------------------------------------------------------
 // Disk::~Disk()
 // 	Clean up disk simulation, by closing the UNIX file representing the
-//	disk.
+//	disk (writing it back first, if it is mapped).
 //----------------------------------------------------------------------
 
 Disk::~Disk()
 {
+    if (image != NULL)
+	UnmapFile(image, DiskSize);
     Close(fileno);
 }
 
@@ -100,7 +150,8 @@ PrintSector (bool writing, int sector, char *data)
 //----------------------------------------------------------------------
 // Disk::ReadRequest/WriteRequest
 // 	Simulate a request to read/write a single disk sector
-//	   Do the read/write immediately to the UNIX file
+//	   Do the read/write immediately to the UNIX file (or to
+//	      memory, if the file is mapped)
 //	   Set up an interrupt handler to be called later,
 //	      that will notify the caller when the simulator says
 //	      the operation has completed.
@@ -118,11 +169,15 @@ Disk::ReadRequest(int sectorNumber, char* data)
     int ticks = ComputeLatency(sectorNumber, FALSE);
 
     ASSERT(!active);				// only one request at a time
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT((sectorNumber >= 0) && (sectorNumber < numTracks * trackSize));
     
     DEBUG('d', "Reading from sector %d\n", sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    Read(fileno, data, SectorSize);
+    if (image != NULL)
+	bcopy(image + SectorSize * sectorNumber + headerSize, data, SectorSize);
+    else {
+	Lseek(fileno, SectorSize * sectorNumber + headerSize, 0);
+	Read(fileno, data, SectorSize);
+    }
     if (DebugIsEnabled('d'))
 	PrintSector(FALSE, sectorNumber, data);
     
@@ -138,11 +193,15 @@ Disk::WriteRequest(int sectorNumber, char* data)
     int ticks = ComputeLatency(sectorNumber, TRUE);
 
     ASSERT(!active);
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT((sectorNumber >= 0) && (sectorNumber < numTracks * trackSize));
     
     DEBUG('d', "Writing to sector %d\n", sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    WriteFile(fileno, data, SectorSize);
+    if (image != NULL)
+	bcopy(data, image + SectorSize * sectorNumber + headerSize, SectorSize);
+    else {
+	Lseek(fileno, SectorSize * sectorNumber + headerSize, 0);
+	WriteFile(fileno, data, SectorSize);
+    }
     if (DebugIsEnabled('d'))
 	PrintSector(TRUE, sectorNumber, data);
     
@@ -179,8 +238,8 @@ Disk::HandleInterrupt ()
 int
 Disk::TimeToSeek(int newSector, int *rotation) 
 {
-    int newTrack = newSector / SectorsPerTrack;
-    int oldTrack = lastSector / SectorsPerTrack;
+    int newTrack = newSector / trackSize;
+    int oldTrack = lastSector / trackSize;
     int seek = abs(newTrack - oldTrack) * SeekTime;
 				// how long will seek take?
     int over = (stats->totalTicks + seek) % RotationTime; 
@@ -202,10 +261,10 @@ Disk::TimeToSeek(int newSector, int *rotation)
 int 
 Disk::ModuloDiff(int to, int from)
 {
-    int toOffset = to % SectorsPerTrack;
-    int fromOffset = from % SectorsPerTrack;
+    int toOffset = to % trackSize;
+    int fromOffset = from % trackSize;
 
-    return ((toOffset - fromOffset) + SectorsPerTrack) % SectorsPerTrack;
+    return ((toOffset - fromOffset) + trackSize) % trackSize;
 }
 
 //----------------------------------------------------------------------
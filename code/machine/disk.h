@@ -45,19 +45,51 @@
 // disks these days now come with a track buffer.
 //
 // The track buffer simulation can be disabled by compiling with -DNOTRACKBUF
+//
+// Optionally, the UNIX file can be mapped into memory (cf. "nachos -mmap"),
+// so that reading or writing a sector is a memory copy rather than two
+// system calls.  This changes how long Nachos takes to run, but not the
+// simulated time.
+
+//
+// The number of tracks, and of sectors per track, are chosen when the
+// disk is created (cf. "nachos -f -geometry"), and recorded at the front
+// of the UNIX file.  SectorsPerTrack, NumTracks and NumSectors describe
+// the volume the file system runs on, which may be made of several
+// disks (cf. synchdisk.h).  The sector size is fixed when Nachos is compiled,
+// since the file system's data structures are laid out to fill a sector;
+// to change it, compile with eg. -DDISK_SECTOR_SIZE=4096.
+
+#ifndef DISK_SECTOR_SIZE
+#define DISK_SECTOR_SIZE	128
+#endif
 
-#define SectorSize 		128	// number of bytes per disk sector
-#define SectorsPerTrack 	32	// number of sectors per disk track 
-#define NumTracks 		32	// number of tracks per disk
+#define SectorSize 		DISK_SECTOR_SIZE
+					// number of bytes per disk sector
+#define DefaultSectorsPerTrack	32	// geometry of a new disk, unless
+#define DefaultNumTracks	32	// another one is asked for
+
+extern int diskSectorsPerTrack;		// geometry of the volume in use
+extern int diskNumTracks;
+
+#define SectorsPerTrack 	diskSectorsPerTrack
+					// number of sectors per disk track 
+#define NumTracks 		diskNumTracks
+					// number of tracks per disk
 #define NumSectors 		(SectorsPerTrack * NumTracks)
 					// total # of sectors per disk
 
 class Disk {
   public:
-    Disk(char* name, VoidFunctionPtr callWhenDone, int callArg);
+    Disk(char* name, VoidFunctionPtr callWhenDone, int callArg,
+	 bool mapped = FALSE, int sectorsPerTrack = 0, int tracks = 0);
     					// Create a simulated disk.  
 					// Invoke (*callWhenDone)(callArg) 
 					// every time a request completes.
+					// If "mapped", map the UNIX file
+					// into memory.  If a geometry is
+					// given, (re)initialize the disk
+					// with it.
     ~Disk();				// Deallocate the disk.
     
     void ReadRequest(int sectorNumber, char* data);
@@ -75,8 +107,15 @@ class Disk {
 					// newSector will take: 
 					// (seek + rotational delay + transfer)
 
+    int TrackSize() { return trackSize; }	// Geometry of this disk
+    int Tracks() { return numTracks; }
+
   private:
     int fileno;				// UNIX file number for simulated disk 
+    char *image;			// The UNIX file, if mapped; else NULL
+    int headerSize;			// Bytes before the first sector
+    int trackSize;			// Sectors per track
+    int numTracks;			// Tracks on the disk
     VoidFunctionPtr handler;		// Interrupt handler, to be invoked 
 					// when any disk request finishes
     int handlerArg;			// Argument to interrupt handler 
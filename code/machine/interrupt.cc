@@ -28,7 +28,8 @@
 
 static char *intLevelNames[] = { "off", "on"};
 static char *intTypeNames[] = { "timer", "disk", "console write", 
-			"console read", "network send", "network recv"};
+			"console read", "network send", "network recv",
+			"alarm"};
 
 //----------------------------------------------------------------------
 // PendingInterrupt::PendingInterrupt
@@ -63,6 +64,7 @@ Interrupt::Interrupt()
     pending = new List();
     inHandler = FALSE;
     yieldOnReturn = FALSE;
+    switchOnReturn = FALSE;
     status = SystemMode;
 }
 
@@ -183,6 +185,12 @@ Interrupt::OneTick()
 	currentThread->Yield();
 	status = old;
     }
+    if (switchOnReturn) {		// likewise for moving on to the 
+	switchOnReturn = FALSE;		// next CPU
+ 	status = SystemMode;
+	scheduler->SwitchCPU();
+	status = old;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -203,6 +211,20 @@ Interrupt::YieldOnReturn()
     yieldOnReturn = TRUE; 
 }
 
+//----------------------------------------------------------------------
+// Interrupt::SwitchCPUOnReturn
+// 	Called from within the timer interrupt handler, to give the next
+//	simulated CPU its turn once the handler returns.  The interrupted
+//	thread is left running on its own CPU.
+//----------------------------------------------------------------------
+
+void
+Interrupt::SwitchCPUOnReturn()
+{ 
+    ASSERT(inHandler == TRUE);  
+    switchOnReturn = TRUE; 
+}
+
 //----------------------------------------------------------------------
 // Interrupt::Idle
 // 	Routine called when there is nothing in the ready queue.
@@ -249,6 +271,7 @@ Interrupt::Halt()
 {
     printf("Machine halting!\n\n");
     stats->Print();
+    scheduler->PrintCPUs();
     Cleanup();     // Never returns.
 }
 
@@ -50,7 +50,7 @@ enum MachineStatus {IdleMode, SystemMode, UserMode};
 // In Nachos, we support a hardware timer device, a disk, a console
 // display and keyboard, and a network.
 enum IntType { TimerInt, DiskInt, ConsoleWriteInt, ConsoleReadInt, 
-				NetworkSendInt, NetworkRecvInt};
+				NetworkSendInt, NetworkRecvInt, AlarmInt};
 
 // The following class defines an interrupt that is scheduled
 // to occur in the future.  The internal data structures are
@@ -94,6 +94,8 @@ class Interrupt {
     
     void YieldOnReturn();		// cause a context switch on return 
 					// from an interrupt handler
+    void SwitchCPUOnReturn();		// likewise, move on to the next
+					// simulated CPU
 
     MachineStatus getStatus() { return status; } // idle, kernel, user
     void setStatus(MachineStatus st) { status = st; }
@@ -119,6 +121,7 @@ class Interrupt {
     bool inHandler;		// TRUE if we are running an interrupt handler
     bool yieldOnReturn; 	// TRUE if we are to context switch
 				// on return from the interrupt handler
+    bool switchOnReturn;	// TRUE if we are to switch CPUs, too
     MachineStatus status;	// idle, kernel mode, user mode
 
     // these functions are internal to the interrupt simulation code
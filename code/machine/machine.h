@@ -29,9 +29,13 @@
 
 // Definitions related to the size, and format of user memory
 
-#define PageSize 	SectorSize 	// set the page size equal to
-					// the disk sector size, for
-					// simplicity
+// The page size need not match the disk sector size; to change it,
+// compile with eg. -DUSER_PAGE_SIZE=4096.
+#ifndef USER_PAGE_SIZE
+#define USER_PAGE_SIZE	128
+#endif
+
+#define PageSize 	USER_PAGE_SIZE
 
 #define NumPhysPages    32
 #define MemorySize 	(NumPhysPages * PageSize)
@@ -24,6 +24,54 @@ Statistics::Statistics()
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
     tlbMissCnt = 0;
     memoryUseRate = 0;
+    numExtentsStored = compressBytesIn = compressBytesOut = 0;
+    compressUsecs = decompressUsecs = 0;
+    numCPUSwitches = numSteals = numLockAcquires = numLockWaits = 0;
+    numDeadlocks = 0;
+    numContextSwitches = 0;
+    numWaits = totalWaitTicks = maxWaitTicks = 0;
+    for (int i = 0; i < WaitBuckets; i++)
+	waitHistogram[i] = 0;
+}
+
+//----------------------------------------------------------------------
+// Statistics::RecordWait
+// 	Note that a thread spent "ticks" on a ready list before it got to
+//	run.  The waits are kept in a histogram by powers of two, so that
+//	Print can tell about the long ones, not just the average.
+//----------------------------------------------------------------------
+
+void
+Statistics::RecordWait(int ticks)
+{
+    int bucket = 0;
+
+    while (bucket < WaitBuckets - 1 && (1 << bucket) <= ticks)
+	bucket++;
+    waitHistogram[bucket]++;
+    numWaits++;
+    totalWaitTicks += ticks;
+    if (ticks > maxWaitTicks)
+	maxWaitTicks = ticks;
+}
+
+//----------------------------------------------------------------------
+// Statistics::WaitPercentile
+// 	Return a bound on how long "percent" of the ready waits took:
+//	the top of the histogram bucket that reaches that many.
+//----------------------------------------------------------------------
+
+int
+Statistics::WaitPercentile(int percent)
+{
+    int seen = 0;
+
+    for (int i = 0; i < WaitBuckets; i++) {
+	seen += waitHistogram[i];
+	if (seen * 100 >= numWaits * percent)
+	    return (i == WaitBuckets - 1) ? maxWaitTicks : (1 << i);
+    }
+    return maxWaitTicks;
 }
 
 //----------------------------------------------------------------------
@@ -45,4 +93,19 @@ Statistics::Print()
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
     printf("Memory Use Rate: %.2f\%\n", 100 * memoryUseRate);
+    if (numExtentsStored > 0)
+	printf("Compression: extents %d, %d bytes stored in %d (%.1f%%), "
+	       "usecs compressing %d, uncompressing %d\n", numExtentsStored,
+	       compressBytesIn, compressBytesOut,
+	       100.0 * compressBytesOut / compressBytesIn, compressUsecs,
+	       decompressUsecs);
+    if (numLockWaits > 0)
+	printf("Locks: acquires %d, waits %d, deadlocks %d\n",
+	       numLockAcquires, numLockWaits, numDeadlocks);
+    if (numContextSwitches > 0)
+	printf("Context switches: %d\n", numContextSwitches);
+    if (numWaits > 0)
+	printf("Ready waits: %d, mean %d, p50 < %d, p99 < %d, max %d ticks\n",
+	       numWaits, totalWaitTicks / numWaits, WaitPercentile(50),
+	       WaitPercentile(99), maxWaitTicks);
 }
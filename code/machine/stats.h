@@ -13,6 +13,8 @@
 
 #include "copyright.h"
 
+#define WaitBuckets	32	// one for each power of two
+
 // The following class defines the statistics that are to be kept
 // about Nachos behavior -- how much time (ticks) elapsed, how
 // many user instructions executed, etc.
@@ -37,8 +39,27 @@ class Statistics {
     int numPacketsRecvd;	// number of packets received over the network
     float memoryUseRate;
     int tlbMissCnt;
+    int numExtentsStored;	// extents of compressed files written out
+    int compressBytesIn;	// their size, uncompressed
+    int compressBytesOut;	// the disk space they took
+    int compressUsecs;		// host time spent compressing, and
+    int decompressUsecs;	// uncompressing, in microseconds
+    int numCPUSwitches;		// times the host moved to another CPU
+    int numSteals;		// threads taken from another CPU's queue
+    int numLockAcquires;	// Lock::Acquire calls, and how many of
+    int numLockWaits;		// them had to wait
+    int numDeadlocks;		// waits that would have closed a cycle
+    int numContextSwitches;	// times the CPU changed threads
+    int numWaits;		// times a thread waited on a ready list,
+    int totalWaitTicks;		// for how long in all,
+    int maxWaitTicks;		// and at most
+    int waitHistogram[WaitBuckets];	// how many waits were less than
+				// 1, 2, 4, 8, ... ticks long
     Statistics(); 		// initialize everything to zero
 
+    void RecordWait(int ticks);	// a thread waited "ticks" to run
+    int WaitPercentile(int percent);	// how long the shortest "percent"
+				// of the waits were, at most
     void Print();		// print collected statistics
 };
 
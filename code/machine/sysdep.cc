@@ -265,6 +265,37 @@ Unlink(char *name)
     return unlink(name);
 }
 
+//----------------------------------------------------------------------
+// MapFile
+// 	Map the first "size" bytes of an open file into memory, shared,
+//	so that stores to the memory change the file.  Return NULL if the
+//	file can't be mapped.
+//----------------------------------------------------------------------
+
+char *
+MapFile(int fd, int size)
+{
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (addr == MAP_FAILED)
+	return NULL;
+    return (char *) addr;
+}
+
+//----------------------------------------------------------------------
+// UnmapFile
+// 	Write a mapped file back to disk, and unmap it.  Abort on error.
+//----------------------------------------------------------------------
+
+void
+UnmapFile(char *addr, int size)
+{
+    int retVal = msync(addr, size, MS_SYNC);
+    ASSERT(retVal >= 0);
+    retVal = munmap(addr, size);
+    ASSERT(retVal >= 0);
+}
+
 //----------------------------------------------------------------------
 // OpenSocket
 // 	Open an interprocess communication (IPC) connection.  For now, 
@@ -468,7 +499,10 @@ Random()
 //	the end of the array.  Particularly useful for catching overflow
 //	beyond fixed-size thread execution stacks.
 //
-//	Note: Just return the useful part!
+//	Note: Just return the useful part!  The array is mapped a page
+//	at a time, so that the boundary pages can be protected; a "size"
+//	that is not a whole number of pages leaves a gap before the upper
+//	boundary page.
 //
 //	"size" -- amount of useful space needed (in bytes)
 //----------------------------------------------------------------------
@@ -477,16 +511,21 @@ char *
 AllocBoundedArray(int size)
 {
     int pgSize = getpagesize();
-    char *ptr = new char[pgSize * 2 + size];
-
-    //mprotect(ptr, pgSize, 0);
-    //mprotect(ptr + pgSize + size, pgSize, 0);
+    int mapped = divRoundUp(size, pgSize) * pgSize;
+    char *ptr = (char *) mmap(NULL, pgSize * 2 + mapped,
+			      PROT_READ | PROT_WRITE | PROT_EXEC,
+			      MAP_PRIVATE | MAP_ANON, -1, 0);
+
+    ASSERT(ptr != (char *) MAP_FAILED);
+    mprotect(ptr, pgSize, PROT_NONE);
+    mprotect(ptr + pgSize + mapped, pgSize, PROT_NONE);
     return ptr + pgSize;
 }
 
 //----------------------------------------------------------------------
 // DeallocBoundedArray
-// 	Deallocate an array of integers, unprotecting its two boundary pages.
+// 	Deallocate an array returned by AllocBoundedArray, along with its
+//	two boundary pages.
 //
 //	"ptr" -- the array to be deallocated
 //	"size" -- amount of useful space in the array (in bytes)
@@ -496,8 +535,7 @@ void
 DeallocBoundedArray(char *ptr, int size)
 {
     int pgSize = getpagesize();
+    int mapped = divRoundUp(size, pgSize) * pgSize;
 
-    mprotect(ptr - pgSize, pgSize, PROT_READ | PROT_WRITE | PROT_EXEC);
-    mprotect(ptr + size, pgSize, PROT_READ | PROT_WRITE | PROT_EXEC);
-    delete [] (ptr - pgSize);
+    munmap(ptr - pgSize, pgSize * 2 + mapped);
 }
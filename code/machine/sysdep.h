@@ -29,6 +29,11 @@ extern int Tell(int fd);
 extern void Close(int fd);
 extern bool Unlink(char *name);
 
+// Map an open file into memory, so that it can be read and written
+// with memcpy; and write the changes back and unmap it again
+extern char *MapFile(int fd, int size);
+extern void UnmapFile(char *addr, int size);
+
 // Interprocess communication operations, for simulating the network
 extern int OpenSocket();
 extern void CloseSocket(int sockID);
@@ -130,6 +130,14 @@ Yield:
 	j	$31
 	.end Yield
 
+	.globl Sleep
+	.ent	Sleep
+Sleep:
+	addiu $2,$0,SC_Sleep
+	syscall
+	j	$31
+	.end Sleep
+
 /* dummy function to keep gcc happy */
         .globl  __main
         .ent    __main
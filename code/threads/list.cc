@@ -127,6 +127,48 @@ List::Remove()
     return SortedRemove(NULL);  // Same as SortedRemove, but ignore the key
 }
 
+//----------------------------------------------------------------------
+// List::RemoveItem
+//      Remove "item" from wherever it is on the list.
+//
+// Returns:
+//	TRUE if it was on the list (the first occurrence is removed),
+//	FALSE if it wasn't.
+//----------------------------------------------------------------------
+
+bool
+List::RemoveItem(void *item)
+{
+    ListElement *prev = NULL, *ptr;
+
+    for (ptr = first; ptr != NULL; prev = ptr, ptr = ptr->next)
+	if (ptr->item == item) {
+	    if (prev == NULL)
+		first = ptr->next;
+	    else
+		prev->next = ptr->next;
+	    if (last == ptr)
+		last = prev;
+	    delete ptr;
+	    return TRUE;
+	}
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// List::Contains
+//	Return TRUE if "item" is on the list.
+//----------------------------------------------------------------------
+
+bool
+List::Contains(void *item)
+{
+    for (ListElement *ptr = first; ptr != NULL; ptr = ptr->next)
+	if (ptr->item == item)
+	    return TRUE;
+    return FALSE;
+}
+
 //----------------------------------------------------------------------
 // List::Mapcar
 //	Apply a function to each item on the list, by walking through  
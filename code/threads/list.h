@@ -48,6 +48,9 @@ class List {
     void Prepend(void *item, int key); 	// Put item at the beginning of the list
     void Append(void *item); 	// Put item at the end of the list
     void *Remove(); 	 	// Take item off the front of the list
+    bool RemoveItem(void *item);	// Take item off the list, wherever
+					// it is
+    bool Contains(void *item);		// Is item on the list?
 
     void Mapcar(VoidFunctionPtr func);	// Apply "func" to every element 
 					// on the list
@@ -8,16 +8,22 @@
 //
 // 	Most of this file is not needed until later assignments.
 //
-// Usage: nachos -d <debugflags> -rs <random seed #>
+// Usage: nachos -d <debugflags> -rs <random seed #> -smp <# CPUs>
+//		-sched <priority|stride|cfs> -deadlock <report|requester|lowest>
 //		-s -x <nachos file> -c <consoleIn> <consoleOut>
-//		-f -cp <unix file> <nachos file>
-//		-p <nachos file> -r <nachos file> -l -D -t
+//		-f -geometry <sectors per track> <tracks> -mmap
+//		-stripe <# disks> -mirror <# disks>
+//		-compress -cp <unix file> <nachos file>
+//		-p <nachos file> -r <nachos file> -mkdir <nachos dir> -l -D -t
 //              -n <network reliability> -m <machine id>
 //              -o <other machine id>
 //              -z
 //
 //    -d causes certain debugging messages to be printed (cf. utility.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
+//    -smp simulates a multiprocessor (cf. scheduler.h)
+//    -sched chooses the scheduling policy (cf. policy.h)
+//    -deadlock chooses what Lock::Acquire does about deadlocks (cf. synch.h)
 //    -z prints the copyright message
 //
 //  USER_PROGRAM
@@ -27,10 +33,17 @@
 //
 //  FILESYS
 //    -f causes the physical disk to be formatted
+//    -geometry gives the disk a new shape, when formatting it
+//    -stripe spreads the file system across several disks (RAID-0)
+//    -mirror keeps a copy of the file system on each of several disks
+//	(RAID-1); either must be given every time the disks are used
+//    -mmap maps the file simulating the disk into memory
+//    -compress stores files created after it compressed
 //    -cp copies a file from UNIX to Nachos
 //    -p prints a Nachos file to stdout
-//    -r removes a Nachos file from the file system
-//    -l lists the contents of the Nachos directory
+//    -r removes a Nachos file (or directory) from the file system
+//    -mkdir creates an empty Nachos directory
+//    -l lists every file in the Nachos file system
 //    -D prints the contents of the entire file system 
 //    -t tests the performance of the Nachos file system
 //
@@ -130,7 +143,9 @@ main(int argc, char **argv)
 	}
 #endif // USER_PROGRAM
 #ifdef FILESYS
-	if (!strcmp(*argv, "-cp")) { 		// copy from UNIX to Nachos
+	if (!strcmp(*argv, "-compress")) {	// compress new files
+	    fileSystem->SetCompression(TRUE);
+	} else if (!strcmp(*argv, "-cp")) { 	// copy from UNIX to Nachos
 	    ASSERT(argc > 2);
 	    Copy(*(argv + 1), *(argv + 2));
 	    argCount = 3;
@@ -142,6 +157,10 @@ main(int argc, char **argv)
 	    ASSERT(argc > 1);
 	    fileSystem->Remove(*(argv + 1));
 	    argCount = 2;
+	} else if (!strcmp(*argv, "-mkdir")) {	// create Nachos directory
+	    ASSERT(argc > 1);
+	    fileSystem->Create(*(argv + 1), 0, DirectoryFileType);
+	    argCount = 2;
 	} else if (!strcmp(*argv, "-l")) {	// list Nachos directory
             fileSystem->List();
 	} else if (!strcmp(*argv, "-D")) {	// print entire filesystem
@@ -162,6 +181,10 @@ main(int argc, char **argv)
 #endif // NETWORK
     }
 
+#ifdef FILESYS
+    fileSystem->Unmount();		// done with the disk; if this isn't
+					// reached, the next run checks it
+#endif
     currentThread->Finish();	// NOTE: if the procedure "main" 
 				// returns, then the program "nachos"
 				// will exit (as any other normal program
@@ -0,0 +1,257 @@
+// policy.cc
+//	Routines for the scheduling policies: the ready threads of one
+//	CPU, and how to choose among them.
+//
+//	Virtual time is kept in units of 1/VirtualTimeScale of a tick for
+//	a thread with one ticket, so that a thread with the default
+//	priority advances VirtualTimeScale / DefaultPriority per tick.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "policy.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// PriorityQueue::PriorityQueue
+// 	Initialize an empty queue, for the priority aging policy.
+//----------------------------------------------------------------------
+
+PriorityQueue::PriorityQueue()
+{
+    list = new List;
+    numReady = 0;
+}
+
+PriorityQueue::~PriorityQueue()
+{
+    delete list;
+}
+
+//----------------------------------------------------------------------
+// PriorityQueue::Insert, PriorityQueue::Remove
+// 	Put a thread at the end of the queue; take the first one off.
+//	The priorities only count when deciding whether to preempt.
+//----------------------------------------------------------------------
+
+void
+PriorityQueue::Insert(Thread *thread)
+{
+    list->Append((void *)thread);
+    numReady++;
+}
+
+Thread *
+PriorityQueue::Remove()
+{
+    Thread *thread = (Thread *)list->SortedRemove(NULL);
+
+    if (thread != NULL)
+	numReady--;
+    return thread;
+}
+
+static void
+SimpleAdjust(int arg)
+{
+    ListElement *ptr = (ListElement *)arg;
+    Thread *t = (Thread *)(ptr->item);
+    if (t != NULL) {
+          t->incPriority();
+          ptr->key = -t->getPriority();
+    }
+}
+
+//----------------------------------------------------------------------
+// PriorityQueue::ShouldPreempt
+// 	If the running thread has used up its time quantum, age the
+//	priorities: it loses a point, and every ready thread gains one.
+//	Return TRUE if the first ready thread's priority is now higher.
+//----------------------------------------------------------------------
+
+bool
+PriorityQueue::ShouldPreempt(Thread *current)
+{
+    int key;
+    Thread *first;
+
+    // check TimeQuantum, if current hasn't been executed for enough time, just return
+    if (current->getTickCount() < current->getTimeQuantum())
+        return FALSE;
+    // current's timeQuantum is used up, it's time to adjust threads' priorities
+    current->decPriority();
+    if (list->IsEmpty())
+        return FALSE;
+    list->MyMapcar((VoidFunctionPtr) SimpleAdjust);
+    first = (Thread *)list->SortedRemove(&key);
+    list->Prepend((void *)first, key);
+    return -key > current->getPriority();
+}
+
+//----------------------------------------------------------------------
+// PriorityQueue::Blocked
+// 	A thread that goes to sleep gets a boost, for when it wakes up.
+//----------------------------------------------------------------------
+
+void
+PriorityQueue::Blocked(Thread *thread)
+{
+    thread->setPriority(WakeUpPriority);
+}
+
+void
+PriorityQueue::Print()
+{
+    list->Mapcar((VoidFunctionPtr) ThreadPrint);
+}
+
+//----------------------------------------------------------------------
+// VirtualTimeQueue::VirtualTimeQueue
+// 	Initialize an empty queue, sorted by virtual time.
+//----------------------------------------------------------------------
+
+VirtualTimeQueue::VirtualTimeQueue()
+{
+    tree = new RBTree;
+    numReady = 0;
+    minVirtualTime = 0;
+}
+
+VirtualTimeQueue::~VirtualTimeQueue()
+{
+    delete tree;
+}
+
+//----------------------------------------------------------------------
+// VirtualTimeQueue::Tickets
+// 	Return a thread's share of the CPU, relative to the other threads:
+//	its priority, but at least one.
+//----------------------------------------------------------------------
+
+int
+VirtualTimeQueue::Tickets(Thread *thread)
+{
+    return (thread->getPriority() < 1) ? 1 : thread->getPriority();
+}
+
+//----------------------------------------------------------------------
+// VirtualTimeQueue::Insert
+// 	Put a thread on the queue, at the virtual time the policy gives
+//	it.  Called before the thread's status becomes READY, so that the
+//	policy can tell a thread that has just been created or woken up
+//	from one that has been preempted.
+//----------------------------------------------------------------------
+
+void
+VirtualTimeQueue::Insert(Thread *thread)
+{
+    thread->setVirtualTime(Placement(thread));
+    tree->Insert((void *)thread, thread->getVirtualTime());
+    numReady++;
+}
+
+//----------------------------------------------------------------------
+// VirtualTimeQueue::Remove
+// 	Take the thread with the lowest virtual time off the queue.
+//----------------------------------------------------------------------
+
+Thread *
+VirtualTimeQueue::Remove()
+{
+    int key;
+    Thread *thread = (Thread *)tree->RemoveMin(&key);
+
+    if (thread == NULL)
+	return NULL;
+    numReady--;
+    if (key > minVirtualTime)
+	minVirtualTime = key;
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// VirtualTimeQueue::Charge
+// 	Advance a thread's virtual time for "ticks" of running, in
+//	inverse proportion to its tickets.
+//----------------------------------------------------------------------
+
+void
+VirtualTimeQueue::Charge(Thread *thread, int ticks)
+{
+    thread->setVirtualTime(thread->getVirtualTime() +
+			   ticks * VirtualTimeScale / Tickets(thread));
+}
+
+void
+VirtualTimeQueue::Print()
+{
+    tree->Mapcar((VoidFunctionPtr) ThreadPrint);
+}
+
+//----------------------------------------------------------------------
+// StrideQueue::Placement
+// 	A thread keeps its pass, unless that is behind every other thread
+//	on the CPU: a new thread, or one that has been asleep, starts even
+//	with the rest.
+//----------------------------------------------------------------------
+
+int
+StrideQueue::Placement(Thread *thread)
+{
+    if (thread->getVirtualTime() < minVirtualTime)
+	return minVirtualTime;
+    return thread->getVirtualTime();
+}
+
+//----------------------------------------------------------------------
+// StrideQueue::ShouldPreempt
+// 	Every thread runs for its time quantum, if anyone is waiting.
+//----------------------------------------------------------------------
+
+bool
+StrideQueue::ShouldPreempt(Thread *current)
+{
+    return current->getTickCount() >= current->getTimeQuantum()
+	&& !tree->IsEmpty();
+}
+
+//----------------------------------------------------------------------
+// CFSQueue::Placement
+// 	Like stride, except that a thread that wakes up may be up to
+//	CFSSleeperCredit behind the rest, so that threads that mostly
+//	wait (for I/O, say) get to run as soon as they can.  A new thread
+//	gets no credit, so that forking can't be used to get ahead.
+//----------------------------------------------------------------------
+
+int
+CFSQueue::Placement(Thread *thread)
+{
+    int floor = minVirtualTime;
+
+    if (thread->getStatus() == BLOCKED)
+	floor -= CFSSleeperCredit;
+    if (thread->getVirtualTime() < floor)
+	return floor;
+    return thread->getVirtualTime();
+}
+
+//----------------------------------------------------------------------
+// CFSQueue::ShouldPreempt
+// 	The running thread yields once its virtual time, counting the
+//	time it has run so far, is CFSGranularity ahead of the first
+//	ready thread.
+//----------------------------------------------------------------------
+
+bool
+CFSQueue::ShouldPreempt(Thread *current)
+{
+    int first;
+    int now = current->getVirtualTime() +
+	current->getTickCount() * VirtualTimeScale / Tickets(current);
+
+    if (tree->Min(&first) == NULL)
+	return FALSE;
+    return now - first >= CFSGranularity;
+}
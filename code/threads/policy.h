@@ -0,0 +1,139 @@
+// policy.h
+//	Data structures for the scheduling policies: the ways the
+//	scheduler can choose which ready thread runs next, and when the
+//	running thread should give up the CPU.
+//
+//	Each policy is a kind of ReadyQueue, holding the threads that are
+//	ready to run on one CPU.  The policy is chosen when Nachos starts
+//	("nachos -sched priority|stride|cfs"):
+//
+//	priority -- the original Nachos scheme: when a thread uses up its
+//		time quantum, it loses a point of priority and every ready
+//		thread gains one, and it is preempted if the first ready
+//		thread now has a higher priority.  Threads that wake up get
+//		WakeUpPriority.
+//
+//	stride -- proportional share: each thread holds "tickets" (its
+//		priority), and its "pass" advances by the time it runs
+//		divided by its tickets.  The thread with the lowest pass
+//		runs next, for one time quantum.  A thread that wakes up
+//		is moved up to the lowest pass of the CPU, so that it
+//		can't make up for time spent asleep.
+//
+//	cfs -- like Linux's Completely Fair Scheduler: the same virtual
+//		time as stride, but the running thread keeps the CPU until
+//		its virtual time is CFSGranularity ahead of the lowest, and
+//		a thread that wakes up gets up to CFSSleeperCredit of
+//		virtual time back, so that it runs soon.
+//
+//	Stride and cfs keep their threads in a red-black tree, sorted by
+//	virtual time, so that both putting a thread on the queue and
+//	taking the next one off take time proportional to the log of the
+//	number of ready threads.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef POLICY_H
+#define POLICY_H
+
+#include "copyright.h"
+#include "list.h"
+#include "rbtree.h"
+#include "thread.h"
+
+enum SchedPolicy { PriorityPolicy, StridePolicy, CFSPolicy };
+
+#define VirtualTimeScale	64	// virtual time of one tick, for a
+					// thread with one ticket
+#define CFSGranularity	(TimerTicks * VirtualTimeScale / DefaultPriority)
+					// how far ahead the running thread
+					// may get, under cfs
+#define CFSSleeperCredit	CFSGranularity
+					// virtual time given back to a
+					// thread that wakes up, under cfs
+
+// The following class defines the operations every policy provides,
+// on the ready threads of one CPU.  Interrupts are disabled whenever
+// they are called.
+
+class ReadyQueue {
+  public:
+    virtual ~ReadyQueue() {}
+
+    virtual void Insert(Thread *thread) = 0;	// thread is ready to run
+    virtual Thread *Remove() = 0;		// take off the thread to run
+						// next; NULL if empty
+    virtual bool ShouldPreempt(Thread *current) = 0;
+						// on a timer interrupt: should
+						// the running thread yield?
+    virtual void Charge(Thread *thread, int ticks) {}
+						// thread has just run for
+						// "ticks", and is switched out
+    virtual void Blocked(Thread *thread) {}	// thread is going to sleep
+    virtual void Print() = 0;			// print the ready threads
+
+    int NumReady() { return numReady; }
+
+  protected:
+    int numReady;
+};
+
+// The original priority aging scheme, on a List.
+
+class PriorityQueue : public ReadyQueue {
+  public:
+    PriorityQueue();
+    ~PriorityQueue();
+
+    void Insert(Thread *thread);
+    Thread *Remove();
+    bool ShouldPreempt(Thread *current);
+    void Blocked(Thread *thread);
+    void Print();
+
+  private:
+    List *list;
+};
+
+// What stride and cfs have in common: threads sorted by virtual time.
+
+class VirtualTimeQueue : public ReadyQueue {
+  public:
+    VirtualTimeQueue();
+    ~VirtualTimeQueue();
+
+    void Insert(Thread *thread);
+    Thread *Remove();
+    void Charge(Thread *thread, int ticks);
+    void Print();
+
+  protected:
+    RBTree *tree;
+    int minVirtualTime;		// lowest virtual time of any thread on
+				// this CPU; never goes back
+
+    int Tickets(Thread *thread);	// its share of the CPU
+    virtual int Placement(Thread *thread) = 0;
+					// virtual time to give a thread
+					// being put on the queue
+};
+
+class StrideQueue : public VirtualTimeQueue {
+  public:
+    bool ShouldPreempt(Thread *current);
+
+  private:
+    int Placement(Thread *thread);
+};
+
+class CFSQueue : public VirtualTimeQueue {
+  public:
+    bool ShouldPreempt(Thread *current);
+
+  private:
+    int Placement(Thread *thread);
+};
+
+#endif // POLICY_H
@@ -0,0 +1,386 @@
+// rbtree.cc
+//	Routines to manage a red-black tree, following Cormen, Leiserson
+//	and Rivest, "Introduction to Algorithms", chapter 14.
+//
+//	The rules that keep the tree balanced: every node is red or
+//	black; the root is black; a red node has no red children; and
+//	every path from a node down to a missing child passes through the
+//	same number of black nodes.  So no path from the root is more than
+//	twice as long as any other.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "rbtree.h"
+
+//----------------------------------------------------------------------
+// RBTree::RBTree
+//	Initialize a tree, so that it is empty.
+//----------------------------------------------------------------------
+
+RBTree::RBTree()
+{
+    nil = new RBNode;
+    nil->item = NULL;
+    nil->red = FALSE;
+    nil->left = nil->right = nil->parent = nil;
+    root = nil;
+    numItems = 0;
+    nextSeq = 0;
+}
+
+//----------------------------------------------------------------------
+// RBTree::~RBTree
+//	De-allocate the tree -- but not the items in it.
+//----------------------------------------------------------------------
+
+RBTree::~RBTree()
+{
+    Free(root);
+    delete nil;
+}
+
+void
+RBTree::Free(RBNode *x)
+{
+    if (x == nil)
+	return;
+    Free(x->left);
+    Free(x->right);
+    delete x;
+}
+
+//----------------------------------------------------------------------
+// RBTree::Less
+//	Return TRUE if node x sorts before node y: by key, and then by
+//	the order they were inserted in.
+//----------------------------------------------------------------------
+
+bool
+RBTree::Less(RBNode *x, RBNode *y)
+{
+    if (x->key != y->key)
+	return x->key < y->key;
+    return (int) (x->seq - y->seq) < 0;	// works across wrap-around
+}
+
+//----------------------------------------------------------------------
+// RBTree::RotateLeft, RBTree::RotateRight
+//	Turn the subtree x(a, y(b, c)) -- node x, with left subtree a and
+//	right child y, whose subtrees are b and c -- into y(x(a, b), c),
+//	keeping the order of the nodes (RotateLeft); RotateRight is the
+//	reverse.
+//----------------------------------------------------------------------
+
+void
+RBTree::RotateLeft(RBNode *x)
+{
+    RBNode *y = x->right;
+
+    x->right = y->left;
+    if (y->left != nil)
+	y->left->parent = x;
+    Replace(x, y);
+    y->left = x;
+    x->parent = y;
+}
+
+void
+RBTree::RotateRight(RBNode *x)
+{
+    RBNode *y = x->left;
+
+    x->left = y->right;
+    if (y->right != nil)
+	y->right->parent = x;
+    Replace(x, y);
+    y->right = x;
+    x->parent = y;
+}
+
+//----------------------------------------------------------------------
+// RBTree::Replace
+//	Hang node y (and its subtree) from the parent of node x, in x's
+//	place.
+//----------------------------------------------------------------------
+
+void
+RBTree::Replace(RBNode *x, RBNode *y)
+{
+    if (x->parent == nil)
+	root = y;
+    else if (x == x->parent->left)
+	x->parent->left = y;
+    else
+	x->parent->right = y;
+    y->parent = x->parent;
+}
+
+//----------------------------------------------------------------------
+// RBTree::Insert
+//	Put an item into the tree, in order by "key".
+//
+//	"item" is the thing to put in the tree.
+//	"key" is what the tree is sorted by.
+//----------------------------------------------------------------------
+
+void
+RBTree::Insert(void *item, int key)
+{
+    RBNode *z = new RBNode;
+    RBNode *y = nil, *x = root;
+
+    z->item = item;
+    z->key = key;
+    z->seq = nextSeq++;
+    while (x != nil) {			// find where it goes
+	y = x;
+	x = Less(z, x) ? x->left : x->right;
+    }
+    z->parent = y;
+    if (y == nil)
+	root = z;
+    else if (Less(z, y))
+	y->left = z;
+    else
+	y->right = z;
+    z->left = z->right = nil;
+    z->red = TRUE;
+    FixInsert(z);
+    numItems++;
+}
+
+//----------------------------------------------------------------------
+// RBTree::FixInsert
+//	Restore the rules after the red node z has been added, which may
+//	have a red parent.
+//----------------------------------------------------------------------
+
+void
+RBTree::FixInsert(RBNode *z)
+{
+    while (z->parent->red) {
+	RBNode *grand = z->parent->parent;
+
+	if (z->parent == grand->left) {
+	    RBNode *uncle = grand->right;
+
+	    if (uncle->red) {		// push the red up the tree
+		z->parent->red = FALSE;
+		uncle->red = FALSE;
+		grand->red = TRUE;
+		z = grand;
+	    } else {
+		if (z == z->parent->right) {
+		    z = z->parent;
+		    RotateLeft(z);
+		}
+		z->parent->red = FALSE;
+		grand->red = TRUE;
+		RotateRight(grand);
+	    }
+	} else {			// the same, left and right swapped
+	    RBNode *uncle = grand->left;
+
+	    if (uncle->red) {
+		z->parent->red = FALSE;
+		uncle->red = FALSE;
+		grand->red = TRUE;
+		z = grand;
+	    } else {
+		if (z == z->parent->left) {
+		    z = z->parent;
+		    RotateRight(z);
+		}
+		z->parent->red = FALSE;
+		grand->red = TRUE;
+		RotateLeft(grand);
+	    }
+	}
+    }
+    root->red = FALSE;
+}
+
+//----------------------------------------------------------------------
+// RBTree::Leftmost
+//	Return the node with the smallest key, or nil.
+//----------------------------------------------------------------------
+
+RBNode *
+RBTree::Leftmost()
+{
+    RBNode *x = root;
+
+    if (x == nil)
+	return nil;
+    while (x->left != nil)
+	x = x->left;
+    return x;
+}
+
+//----------------------------------------------------------------------
+// RBTree::Min, RBTree::RemoveMin
+//	Return the item with the smallest key (the first inserted, if
+//	there are several), and remove it from the tree (RemoveMin).
+//	Return NULL if the tree is empty.
+//
+//	"keyPtr" is where to store the item's key (if not NULL).
+//----------------------------------------------------------------------
+
+void *
+RBTree::Min(int *keyPtr)
+{
+    RBNode *x = Leftmost();
+
+    if (x == nil)
+	return NULL;
+    if (keyPtr != NULL)
+	*keyPtr = x->key;
+    return x->item;
+}
+
+void *
+RBTree::RemoveMin(int *keyPtr)
+{
+    RBNode *x = Leftmost();
+    void *item;
+
+    if (x == nil)
+	return NULL;
+    if (keyPtr != NULL)
+	*keyPtr = x->key;
+    item = x->item;
+    Delete(x);
+    numItems--;
+    return item;
+}
+
+//----------------------------------------------------------------------
+// RBTree::Delete
+//	Take node z out of the tree, and de-allocate it.
+//----------------------------------------------------------------------
+
+void
+RBTree::Delete(RBNode *z)
+{
+    RBNode *y = z, *x;
+    bool removedRed = y->red;
+
+    if (z->left == nil) {
+	x = z->right;
+	Replace(z, x);
+    } else if (z->right == nil) {
+	x = z->left;
+	Replace(z, x);
+    } else {				// move z's successor into its place
+	y = z->right;
+	while (y->left != nil)
+	    y = y->left;
+	removedRed = y->red;
+	x = y->right;
+	if (y->parent == z)
+	    x->parent = y;		// (even if x is nil)
+	else {
+	    Replace(y, x);
+	    y->right = z->right;
+	    y->right->parent = y;
+	}
+	Replace(z, y);
+	y->left = z->left;
+	y->left->parent = y;
+	y->red = z->red;
+    }
+    delete z;
+    if (!removedRed)
+	FixDelete(x);
+}
+
+//----------------------------------------------------------------------
+// RBTree::FixDelete
+//	Restore the rules after a black node has been removed from above
+//	node x, so that paths through x are one black node short.
+//----------------------------------------------------------------------
+
+void
+RBTree::FixDelete(RBNode *x)
+{
+    while (x != root && !x->red) {
+	if (x == x->parent->left) {
+	    RBNode *w = x->parent->right;	// x's sibling
+
+	    if (w->red) {
+		w->red = FALSE;
+		x->parent->red = TRUE;
+		RotateLeft(x->parent);
+		w = x->parent->right;
+	    }
+	    if (!w->left->red && !w->right->red) {
+		w->red = TRUE;
+		x = x->parent;
+	    } else {
+		if (!w->right->red) {
+		    w->left->red = FALSE;
+		    w->red = TRUE;
+		    RotateRight(w);
+		    w = x->parent->right;
+		}
+		w->red = x->parent->red;
+		x->parent->red = FALSE;
+		w->right->red = FALSE;
+		RotateLeft(x->parent);
+		x = root;
+	    }
+	} else {			// the same, left and right swapped
+	    RBNode *w = x->parent->left;
+
+	    if (w->red) {
+		w->red = FALSE;
+		x->parent->red = TRUE;
+		RotateRight(x->parent);
+		w = x->parent->left;
+	    }
+	    if (!w->right->red && !w->left->red) {
+		w->red = TRUE;
+		x = x->parent;
+	    } else {
+		if (!w->left->red) {
+		    w->right->red = FALSE;
+		    w->red = TRUE;
+		    RotateLeft(w);
+		    w = x->parent->left;
+		}
+		w->red = x->parent->red;
+		x->parent->red = FALSE;
+		w->left->red = FALSE;
+		RotateRight(x->parent);
+		x = root;
+	    }
+	}
+    }
+    x->red = FALSE;
+}
+
+//----------------------------------------------------------------------
+// RBTree::Mapcar
+//	Apply a function to each item in the tree, in order by key.
+//
+//	"func" is the procedure to apply to each item.
+//----------------------------------------------------------------------
+
+void
+RBTree::Mapcar(VoidFunctionPtr func)
+{
+    Walk(root, func);
+}
+
+void
+RBTree::Walk(RBNode *x, VoidFunctionPtr func)
+{
+    if (x == nil)
+	return;
+    Walk(x->left, func);
+    (*func)((int) x->item);
+    Walk(x->right, func);
+}
@@ -0,0 +1,67 @@
+// rbtree.h
+//	Data structures to keep items sorted by an integer key, as a
+//	red-black tree: a binary tree kept balanced enough that inserting
+//	an item, or removing the one with the smallest key, takes time
+//	proportional to the log of the number of items.  (A sorted List
+//	takes time proportional to the number of items.)
+//
+//	Items with equal keys come out in the order they went in.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include "copyright.h"
+#include "utility.h"
+
+// The following class defines one item in a tree.
+
+class RBNode {
+  public:
+    void *item;			// pointer to the item in the tree
+    int key;			// what the tree is sorted by
+    unsigned int seq;		// insertion order, to break ties
+    bool red;			// color of the node
+    RBNode *left, *right, *parent;
+};
+
+// The following class defines a red-black tree.
+
+class RBTree {
+  public:
+    RBTree();			// initialize an empty tree
+    ~RBTree();			// de-allocate the tree
+
+    void Insert(void *item, int key);	// put item into the tree
+    void *RemoveMin(int *keyPtr);	// remove the item with the smallest
+					// key, NULL if the tree is empty;
+					// set *keyPtr to its key
+    void *Min(int *keyPtr);		// likewise, but leave it there
+    bool IsEmpty() { return root == nil; }
+    int NumItems() { return numItems; }
+    void Mapcar(VoidFunctionPtr func);	// apply "func" to every item, in
+					// order
+
+  private:
+    RBNode *root;
+    RBNode *nil;		// stands for every missing child, so
+				// that the leaves needn't be checked for
+    int numItems;
+    unsigned int nextSeq;	// given to the next item inserted
+
+    bool Less(RBNode *x, RBNode *y);	// does x sort before y?
+    RBNode *Leftmost();
+    void RotateLeft(RBNode *x);
+    void RotateRight(RBNode *x);
+    void Replace(RBNode *x, RBNode *y);	// put y where x is in the tree
+    void Delete(RBNode *z);
+    void FixInsert(RBNode *z);
+    void FixDelete(RBNode *x);
+    void Walk(RBNode *x, VoidFunctionPtr func);
+    void Free(RBNode *x);
+};
+
+#endif // RBTREE_H
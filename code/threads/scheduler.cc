@@ -11,8 +11,19 @@
 //	end up calling FindNextToRun(), and that would put us in an 
 //	infinite loop.
 //
-// 	Very simple implementation -- no priorities, straight FIFO.
-//	Might need to be improved in later assignments.
+//	Which ready thread runs next is up to the scheduling policy
+//	(cf. policy.h), which gets a ReadyQueue for each CPU.  The
+//	scheduler tells it how long each thread ran, and keeps track of
+//	how long each thread waited on a ready list.
+//
+//	With several simulated CPUs, "currentThread" and "readyList" are
+//	those of the CPU the host is running; a thread is put back on the
+//	ready list of the CPU it last ran on.  The CPUs take turns, but
+//	disabling interrupts still keeps every other CPU from running, so
+//	the synchronization routines need no change -- they behave as if
+//	there were one big kernel lock.  What the simulation does show is
+//	how often threads on different CPUs wait for each other's Locks,
+//	and how much work has to be moved between CPUs.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -24,12 +35,38 @@
 
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
-// 	Initialize the list of ready but not running threads to empty.
+// 	Initialize the list of ready but not running threads to empty,
+//	for each of "cpus" simulated CPUs.  We start out on CPU 0.
+//
+//	"policy" is how to choose among the ready threads.
 //----------------------------------------------------------------------
 
-Scheduler::Scheduler()
+Scheduler::Scheduler(int cpus, SchedPolicy policy)
 { 
-    readyList = new List; 
+    numCPUs = cpus;
+    readyLists = new ReadyQueue *[numCPUs];
+    running = new Thread *[numCPUs];
+    busyTicks = new int[numCPUs];
+    for (int i = 0; i < numCPUs; i++) {
+	switch (policy) {
+	  case StridePolicy:
+	    readyLists[i] = new StrideQueue;
+	    break;
+	  case CFSPolicy:
+	    readyLists[i] = new CFSQueue;
+	    break;
+	  default:
+	    readyLists[i] = new PriorityQueue;
+	    break;
+	}
+	running[i] = NULL;
+	busyTicks[i] = 0;
+    }
+    lastSwitch = 0;
+    SetCPU(0);
+    zombieList = new List;
+    sleepers = new List;
+    alarmAt = -1;
 } 
 
 //----------------------------------------------------------------------
@@ -39,13 +76,35 @@ Scheduler::Scheduler()
 
 Scheduler::~Scheduler()
 { 
-    delete readyList; 
+    for (int i = 0; i < numCPUs; i++)
+	delete readyLists[i];
+    delete [] readyLists;
+    delete [] running;
+    delete [] busyTicks;
+    delete zombieList;
+    delete sleepers;
 } 
 
+//----------------------------------------------------------------------
+// Scheduler::SetCPU
+// 	Make "which" the CPU the host is running.
+//----------------------------------------------------------------------
+
+void
+Scheduler::SetCPU (int which)
+{
+    cpu = which;
+    readyList = readyLists[cpu];
+}
+
 //----------------------------------------------------------------------
 // Scheduler::ReadyToRun
 // 	Mark a thread as ready, but not running.
-//	Put it on the ready list, for later scheduling onto the CPU.
+//	Put it on the ready list, for later scheduling onto the CPU:
+//	that of the CPU it last ran on, or for a new thread, this one.
+//	If it is the running thread, giving up the CPU, charge it for the
+//	time it has run first, so that the policy puts it in the right
+//	place.
 //
 //	"thread" is the thread to be put on the ready list.
 //----------------------------------------------------------------------
@@ -55,8 +114,13 @@ Scheduler::ReadyToRun (Thread *thread)
 {
     DEBUG('t', "Putting thread %s on ready list.\n", thread->getName());
 
+    if (thread->getCPU() == -1)
+	thread->setCPU(cpu);
+    if (thread == currentThread)
+	Charge(thread);
+    readyLists[thread->getCPU()]->Insert(thread);
     thread->setStatus(READY);
-    readyList->Append((void *)thread);
+    thread->setReadySince(stats->totalTicks);
 }
 
 //----------------------------------------------------------------------
@@ -70,7 +134,95 @@ Scheduler::ReadyToRun (Thread *thread)
 Thread *
 Scheduler::FindNextToRun ()
 {
-    return (Thread *)readyList->SortedRemove(NULL);
+    return TakeReady(cpu);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::TakeReady
+// 	Dequeue the first thread on the ready list of CPU "which".  If
+//	there is none, steal the first thread of the CPU with the most
+//	ready threads, which from now on belongs to "which".  Return NULL
+//	if no CPU has a ready thread.
+//----------------------------------------------------------------------
+
+Thread *
+Scheduler::TakeReady (int which)
+{
+    Thread *thread = readyLists[which]->Remove();
+    int victim = -1;
+
+    if (thread != NULL)
+	return thread;
+    for (int i = 0; i < numCPUs; i++)
+	if (readyLists[i]->NumReady() > 0 && (victim == -1 ||
+		readyLists[i]->NumReady() > readyLists[victim]->NumReady()))
+	    victim = i;
+    if (victim == -1)
+	return NULL;
+    thread = readyLists[victim]->Remove();
+    thread->setCPU(which);
+    stats->numSteals++;
+    DEBUG('t', "CPU %d steals thread \"%s\" from CPU %d\n", which,
+	  thread->getName(), victim);
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::FindOtherCPU
+// 	Called when the thread on this CPU has blocked or finished, and
+//	there is nothing else for this CPU to run, even by stealing.  The
+//	CPU goes idle; move on to the next CPU with a thread to run, and
+//	return it.  Return NULL if every CPU is idle (always, if there is
+//	only one CPU).
+//----------------------------------------------------------------------
+
+Thread *
+Scheduler::FindOtherCPU ()
+{
+    running[cpu] = NULL;
+    for (int i = 1; i < numCPUs; i++) {
+	int which = (cpu + i) % numCPUs;
+
+	if (running[which] != NULL) {
+	    SetCPU(which);
+	    return running[which];
+	}
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::SwitchCPU
+// 	Leave the current thread running on this CPU, and move on to the
+//	next CPU that is running a thread, or can find one to run.  Called
+//	on return from a timer interrupt, so that each CPU gets a turn.
+//
+//	Like Thread::Yield, we disable interrupts, and on return re-set
+//	them to their original state.
+//----------------------------------------------------------------------
+
+void
+Scheduler::SwitchCPU ()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    running[cpu] = currentThread;
+    currentThread->setCPU(cpu);
+    for (int i = 1; i < numCPUs; i++) {
+	int which = (cpu + i) % numCPUs;
+	Thread *nextThread = running[which];
+
+	if (nextThread == NULL)
+	    nextThread = TakeReady(which);
+	if (nextThread != NULL) {
+	    DEBUG('t', "Switching from CPU %d to CPU %d\n", cpu, which);
+	    stats->numCPUSwitches++;
+	    SetCPU(which);
+	    Run(nextThread);
+	    break;
+	}
+    }
+    (void) interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
@@ -102,6 +254,23 @@ Scheduler::Run (Thread *nextThread)
     oldThread->CheckOverflow();		    // check if the old thread
 					    // had an undetected stack overflow
 
+    busyTicks[oldThread->getCPU() == -1 ? 0 : oldThread->getCPU()] +=
+	stats->totalTicks - lastSwitch;
+    lastSwitch = stats->totalTicks;
+    if (oldThread->getStatus() != READY)	// else charged already
+	Charge(oldThread);
+    running[cpu] = nextThread;
+    nextThread->setCPU(cpu);
+    if (oldThread->getStatus() != RUNNING)	// not just changing CPUs
+	stats->numContextSwitches++;
+    if (nextThread->getReadySince() != -1) {
+	int waited = stats->totalTicks - nextThread->getReadySince();
+
+	nextThread->addWait(waited);
+	nextThread->setReadySince(-1);
+	stats->RecordWait(waited);
+    }
+
     currentThread = nextThread;		    // switch to the next thread
     currentThread->setStatus(RUNNING);      // nextThread is now running
     currentThread->clearTickCount();  // clear nextThread's tickCount
@@ -120,21 +289,15 @@ Scheduler::Run (Thread *nextThread)
     
     DEBUG('t', "Now in thread \"%s\"\n", currentThread->getName());
 
-    for (int i = 0; i < MAX_THREAD_NUM; ++i)
-        if (threadTable[i] != NULL && threadTable[i]->getStatus() == ZOMBIE)
-        {
-            if (threadTable[i] != threadToBeDestroyed)
-                delete threadTable[i];
-            threadTable[i] = NULL;
-        }
     // If the old thread gave up the processor because it was finishing,
     // we need to delete its carcass.  Note we cannot delete the thread
     // before now (for example, in Thread::Finish()), because up to this
-    // point, we were still running on the old thread's stack!
-    if (threadToBeDestroyed != NULL) {
-        delete threadToBeDestroyed;
-        threadToBeDestroyed = NULL;
-    }
+    // point, we were still running on the old thread's stack!  Other
+    // threads may have finished since we last got here, too -- a thread
+    // that has just been forked starts out in ThreadRoot, not here.
+    Thread *zombie;
+    while ((zombie = (Thread *)zombieList->Remove()) != NULL)
+        delete zombie;
     
 #ifdef USER_PROGRAM
     if (currentThread->space != NULL) {		// if there is an address space
@@ -145,42 +308,179 @@ Scheduler::Run (Thread *nextThread)
 }
 
 //----------------------------------------------------------------------
-// Scheduler::Print
-// 	Print the scheduler state -- in other words, the contents of
-//	the ready list.  For debugging.
+// Scheduler::AddZombie
+// 	Note that a thread has finished, so that it will be deleted the
+//	next time Run returns, in some other thread.
+//
+//	"thread" is the thread that has finished.
 //----------------------------------------------------------------------
+
 void
-Scheduler::Print()
+Scheduler::AddZombie (Thread *thread)
 {
-    printf("Ready list contents:\n");
-    readyList->Mapcar((VoidFunctionPtr) ThreadPrint);
+    thread->setStatus(ZOMBIE);
+    zombieList->Append((void *)thread);
 }
 
-int
-Scheduler::PeekPriority()
+//----------------------------------------------------------------------
+// Scheduler::Charge
+// 	Tell the policy how long "thread" has run since it was last
+//	dispatched, now that it is giving up the CPU.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Charge (Thread *thread)
 {
-    int ans;
-    Thread *first = (Thread *)readyList->SortedRemove(&ans);
-    if (first!=NULL)
-        readyList->Prepend((void *)first, ans);
-    return -ans;
+    int ran = stats->totalTicks - lastScheduleTime;
+    int which = (thread->getCPU() == -1) ? cpu : thread->getCPU();
+
+    thread->addCPUTicks(ran);
+    readyLists[which]->Charge(thread, ran);
 }
 
+//----------------------------------------------------------------------
+// Scheduler::ShouldPreempt
+// 	Called on a timer interrupt: return TRUE if the running thread
+//	should yield the CPU, according to the policy.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::ShouldPreempt ()
+{
+    return readyList->ShouldPreempt(currentThread);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Blocked
+// 	Let the policy know that "thread" is going to sleep.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Blocked (Thread *thread)
+{
+    readyList->Blocked(thread);
+}
+
+//----------------------------------------------------------------------
+// SleepAlarm
+// 	Interrupt handler for the alarm set for the first sleeping thread.
+//----------------------------------------------------------------------
+
+static void
+SleepAlarm(int dummy)
+{
+    scheduler->WakeSleepers();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::WakeAt
+// 	Arrange for "thread", which is about to go to sleep, to be woken
+//	up at time "when".  If it is also waiting on a queue (a Semaphore,
+//	say), it is taken off that first, and marked as having timed out
+//	-- unless it has left the queue by then, and is ready already.
+//
+//	The alarm is only moved if the thread wakes up before the first
+//	of the others.
+//
+//	"waitQueue" is what thread is waiting on, or NULL if nothing
+//----------------------------------------------------------------------
+
+void
+Scheduler::WakeAt (Thread *thread, int when, List *waitQueue)
+{
+    ASSERT(interrupt->getLevel() == IntOff);
+    thread->setTimedOut(FALSE);
+    thread->setTimedQueue(waitQueue);
+    sleepers->SortedInsert((void *)thread, when);
+    if (alarmAt == -1 || when < alarmAt) {
+	alarmAt = when;
+	interrupt->Schedule(SleepAlarm, 0, when - stats->totalTicks,
+			    AlarmInt);
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::CancelWake
+// 	Called once "thread" is running again: forget its wake up time,
+//	if it was woken some other way first.  Return TRUE if it was.
+//
+//	An alarm already pending for it is left; when it goes off, it
+//	finds no one due, and does nothing.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::CancelWake (Thread *thread)
+{
+    thread->setTimedQueue(NULL);
+    return sleepers->RemoveItem((void *)thread);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::WakeSleepers
+// 	Called when an alarm goes off: wake up every sleeping thread whose
+//	time has come, and set the alarm for the next one.
+//----------------------------------------------------------------------
+
 void
-SimpleAdjust(int arg)
+Scheduler::WakeSleepers ()
 {
-    ListElement *ptr = (ListElement *)arg;
-    Thread *t = (Thread *)(ptr->item);
-    if (t != NULL) {
-          t->incPriority();
-          ptr->key = -t->getPriority();
+    Thread *thread;
+    int when;
+
+    if (alarmAt <= stats->totalTicks)
+	alarmAt = -1;			// this is it going off
+    while ((thread = (Thread *)sleepers->SortedRemove(&when)) != NULL) {
+	if (when > stats->totalTicks) {
+	    sleepers->Prepend((void *)thread, when);
+	    break;
+	}
+	if (thread->getTimedQueue() == NULL
+	    || thread->getTimedQueue()->RemoveItem((void *)thread)) {
+	    DEBUG('t', "Waking up thread \"%s\"\n", thread->getName());
+	    thread->setTimedOut(TRUE);
+	    ReadyToRun(thread);
+	}
+	thread->setTimedQueue(NULL);
+    }
+    if (thread != NULL && (alarmAt == -1 || when < alarmAt)) {
+	alarmAt = when;
+	interrupt->Schedule(SleepAlarm, 0, when - stats->totalTicks,
+			    AlarmInt);
     }
 }
 
+//----------------------------------------------------------------------
+// Scheduler::Print
+// 	Print the scheduler state -- in other words, the contents of
+//	the ready list.  For debugging.
+//----------------------------------------------------------------------
 void
-Scheduler::AdjustPriority()
+Scheduler::Print()
 {
-    if (readyList->IsEmpty())
-        return;
-    readyList->MyMapcar((VoidFunctionPtr) SimpleAdjust);
-}
\ No newline at end of file
+    for (int i = 0; i < numCPUs; i++) {
+	if (numCPUs > 1)
+	    printf("CPU %d: ", i);
+	printf("Ready list contents:\n");
+	readyLists[i]->Print();
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::PrintCPUs
+// 	Print how much of the time each simulated CPU spent running
+//	threads, if there is more than one.
+//----------------------------------------------------------------------
+
+void
+Scheduler::PrintCPUs()
+{
+    if (numCPUs == 1)
+	return;
+    busyTicks[cpu] += stats->totalTicks - lastSwitch;
+    lastSwitch = stats->totalTicks;
+    printf("CPUs: %d, busy ticks", numCPUs);
+    for (int i = 0; i < numCPUs; i++)
+	printf(" %d", busyTicks[i]);
+    printf(", switches %d, steals %d\n", stats->numCPUSwitches,
+	   stats->numSteals);
+}
@@ -2,6 +2,23 @@
 //	Data structures for the thread dispatcher and scheduler.
 //	Primarily, the list of threads that are ready to run.
 //
+//	The scheduler can also simulate a multiprocessor ("nachos -smp n").
+//	Each simulated CPU has its own ready list, and the thread it is
+//	running.  The host runs one CPU at a time, moving on to the next
+//	one at each timer interrupt, or when a CPU runs out of work; a CPU
+//	whose own list is empty steals a thread from the CPU with the
+//	longest one.
+//
+//	How the threads on each ready list are ordered, and when the
+//	running thread is preempted, is up to the scheduling policy (cf.
+//	policy.h).
+//
+//	The scheduler also keeps the threads that are asleep until a given
+//	time (Thread::SleepFor, and the timed waits in synch.cc), sorted
+//	by when they wake up.  Only the first of them has an alarm pending
+//	in the interrupt queue, however many threads are asleep, and none
+//	of them uses the CPU until then.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -12,6 +29,7 @@
 #include "copyright.h"
 #include "list.h"
 #include "thread.h"
+#include "policy.h"
 
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
@@ -19,20 +37,56 @@
 
 class Scheduler {
   public:
-    Scheduler();			// Initialize list of ready threads 
+    Scheduler(int cpus = 1, SchedPolicy policy = PriorityPolicy);
+					// Initialize list of ready threads,
+					// for each of "cpus" processors
     ~Scheduler();			// De-allocate ready list
 
     void ReadyToRun(Thread* thread);	// Thread can be dispatched.
     Thread* FindNextToRun();		// Dequeue first thread on the ready 
 					// list, if any, and return thread.
+    Thread* FindOtherCPU();		// This CPU has nothing to run: move
+					// on to one that does, and return
+					// its thread (NULL if none)
+    void SwitchCPU();			// Move on to the next CPU (on a
+					// timer interrupt)
     void Run(Thread* nextThread);	// Cause nextThread to start running
+    void AddZombie(Thread* thread);	// Thread has finished; delete it
+					// once we are off its stack
+    bool ShouldPreempt();		// Should the running thread yield,
+					// on a timer interrupt?
+    void Blocked(Thread* thread);	// Thread is going to sleep
+    void WakeAt(Thread* thread, int when, List *waitQueue);
+					// Wake thread up at time "when",
+					// taking it off waitQueue if need be
+    bool CancelWake(Thread* thread);	// Thread woke up some other way
+    void WakeSleepers();		// Wake the threads that are due (on
+					// the alarm)
     void Print();			// Print contents of ready list
-    void AdjustPriority();
-    int PeekPriority();
+    void PrintCPUs();			// Print how busy each CPU was
+    int getNumCPUs() { return numCPUs; }
     
   private:
-    List *readyList;  		// queue of threads that are ready to run,
-				// but not running
+    int numCPUs;		// simulated processors
+    int cpu;			// the one the host is running now
+    ReadyQueue **readyLists;	// for each CPU, a queue of threads that
+				// are ready to run, but not running
+    Thread **running;		// the thread on each CPU, NULL if idle
+    int *busyTicks;		// time each CPU has spent running threads
+    int lastSwitch;		// when the host last changed threads
+    ReadyQueue *readyList;	// the ready list of this CPU
+    List *zombieList;		// threads that have finished, but not
+				// yet been deleted
+    List *sleepers;		// threads waiting for a time, sorted by
+				// the time
+    int alarmAt;		// when the alarm for the first of them
+				// goes off, -1 if none is pending
+
+    Thread *TakeReady(int which);	// Dequeue a thread for CPU "which",
+					// stealing one if it has none
+    void SetCPU(int which);		// Make CPU "which" the host's
+    void Charge(Thread *thread);	// Account for the time thread has
+					// run since it was dispatched
 };
 
 #endif // SCHEDULER_H
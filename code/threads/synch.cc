@@ -17,6 +17,19 @@
 // re-set the interrupt state back to its original value (whether
 // that be disabled or enabled).
 //
+// Waking up a waiter can hand it what it was waiting for directly: V
+// gives its unit to the thread it wakes rather than adding it to the
+// value, and Signal moves the thread from the condition onto the
+// lock's queue, rather than waking it up only to wait in Acquire.  A
+// Lock created with "handoff" also makes the thread that Release wakes
+// the owner.  Then a woken thread can't lose the race to a thread that
+// gets in first ("barging") and have to go back to sleep.
+//
+// Locks don't hand off unless asked to: a thread that releases a lock
+// and soon wants it back would then always have to wait for the
+// waiter to run first (a "convoy").  Barging lets it take the lock
+// back without a context switch.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -25,6 +38,27 @@
 #include "synch.h"
 #include "system.h"
 
+//----------------------------------------------------------------------
+// StartTimeout, StopTimeout
+// 	Put a time limit on a wait.  StartTimeout arranges for the current
+//	thread, about to sleep on "queue", to be taken off it and woken up
+//	"ticks" from now, by the scheduler's list of sleepers.  Once it is
+//	running again, StopTimeout returns TRUE if that is why.
+//----------------------------------------------------------------------
+
+static void
+StartTimeout(List *queue, int ticks)
+{
+    scheduler->WakeAt(currentThread, stats->totalTicks + ticks, queue);
+}
+
+static bool
+StopTimeout()
+{
+    (void) scheduler->CancelWake(currentThread);
+    return currentThread->hasTimedOut();
+}
+
 //----------------------------------------------------------------------
 // Semaphore::Semaphore
 // 	Initialize a semaphore, so that it can be used for synchronization.
@@ -57,6 +91,9 @@ Semaphore::~Semaphore()
 //	value and decrementing must be done atomically, so we
 //	need to disable interrupts before checking the value.
 //
+//	If we have to wait, the V that wakes us up hands us its unit, so
+//	there is nothing to decrement.
+//
 //	Note that Thread::Sleep assumes that interrupts are disabled
 //	when it is called.
 //----------------------------------------------------------------------
@@ -66,22 +103,50 @@ Semaphore::P()
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
     
-    while (value == 0) { 			// semaphore not available
+    if (value > 0)				// semaphore available, 
+	value--;				// consume its value
+    else {					// not available
 	queue->Append((void *)currentThread);	// so go to sleep
 	currentThread->Sleep();
     } 
-    value--; 					// semaphore available, 
-						// consume its value
     
     (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
 }
 
+//----------------------------------------------------------------------
+// Semaphore::TimedP
+// 	Like P, but give up if the semaphore isn't available within
+//	"ticks" (at once, if "ticks" is not positive).  Return TRUE if
+//	the value was decremented.
+//----------------------------------------------------------------------
+
+bool
+Semaphore::TimedP(int ticks)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    bool gotIt = TRUE;
+
+    if (value > 0)
+	value--;
+    else if (ticks <= 0)
+	gotIt = FALSE;
+    else {
+	queue->Append((void *)currentThread);
+	StartTimeout(queue, ticks);
+	currentThread->Sleep();
+	gotIt = !StopTimeout();
+    }
+    (void) interrupt->SetLevel(oldLevel);
+    return gotIt;
+}
+
 //----------------------------------------------------------------------
 // Semaphore::V
-// 	Increment semaphore value, waking up a waiter if necessary.
-//	As with P(), this operation must be atomic, so we need to disable
-//	interrupts.  Scheduler::ReadyToRun() assumes that threads
-//	are disabled when it is called.
+// 	Increment semaphore value, or if there is a waiter, wake it up
+//	and give it the unit instead.  As with P(), this operation must
+//	be atomic, so we need to disable interrupts.
+//	Scheduler::ReadyToRun() assumes that interrupts are disabled
+//	when it is called.
 //----------------------------------------------------------------------
 
 void
@@ -93,86 +158,268 @@ Semaphore::V()
     thread = (Thread *)queue->Remove();
     if (thread != NULL)	   // make thread ready, consuming the V immediately
 	scheduler->ReadyToRun(thread);
-    value++;
+    else
+	value++;
     (void) interrupt->SetLevel(oldLevel);
 }
 
 // Dummy functions -- so we can compile our later assignments 
 // Note -- without a correct implementation of Condition::Wait(), 
 // the test case in the network assignment won't work!
-Lock::Lock(char* debugName)
+Lock::Lock(char* debugName, bool handoffOnRelease)
 {
     name = debugName;
+    handoff = handoffOnRelease;
     value = 1; // FREE
+    owner = NULL;
     queue = new List;
+    victims = new List;
 }
 
 Lock::~Lock()
 {
     delete queue;
+    delete victims;
 }
 
-void clearAllMarked()
-{
-    for (int i = 0; i < MAX_THREAD_NUM; ++i)
-        if (threadTable[i] != NULL)
-            threadTable[i]->clearMarked();
-}
-bool DeadLockDetect()
-{
-    int i;
-    for (i = 0; i < MAX_THREAD_NUM; ++i)
-        if (threadTable[i] != NULL && threadTable[i]->getWaitingLock() != NULL) {
-            Thread *cur = threadTable[i];
-            Lock *lock = (Lock *)cur->getWaitingLock();
-            cur->mark();
-            while (lock != NULL) {
-                cur = lock->getOwner();
-                if (cur == NULL)
-                    break;
-                if (cur->isMarked())
-                    return true;
-                cur->mark();
-                lock = (Lock *)cur->getWaitingLock();
-            }
-            clearAllMarked();
-        }
-    return false;
+//----------------------------------------------------------------------
+// Lock::BestWaiter
+// 	Return the thread waiting for the lock with the highest priority
+//	(the one that has waited longest, if there is a tie), or NULL.
+//----------------------------------------------------------------------
+
+static Thread *bestWaiter;
+
+static void FindBestWaiter(int arg)
+{
+    Thread *t = (Thread *)arg;
+    if (bestWaiter == NULL || t->getPriority() > bestWaiter->getPriority())
+        bestWaiter = t;
+}
+
+Thread *Lock::BestWaiter()
+{
+    bestWaiter = NULL;
+    queue->Mapcar((VoidFunctionPtr) FindBestWaiter);
+    return bestWaiter;
+}
+
+//----------------------------------------------------------------------
+// Lock::Donate
+// 	"donor" has just started waiting for the lock: lend its priority
+//	to the owner, and if the owner is waiting for another lock, on to
+//	that lock's owner, and so on.  Priorities only go up along the
+//	chain, so this stops even if the chain is a deadlock.
+//----------------------------------------------------------------------
+
+void Lock::Donate(Thread *donor)
+{
+    Lock *lock = this;
+
+    while (lock != NULL && lock->owner != NULL
+           && lock->owner->getPriority() < donor->getPriority()) {
+        DEBUG('t', "Thread \"%s\" lends priority %d to \"%s\" for %s\n",
+              donor->getName(), donor->getPriority(),
+              lock->owner->getName(), lock->getName());
+        lock->owner->setDonatedPriority(donor->getPriority());
+        donor = lock->owner;
+        lock = (Lock *)donor->getWaitingLock();
+    }
 }
 
+//----------------------------------------------------------------------
+// LockDonation
+// 	Mapcar helper for Lock::Release: the highest priority lent to a
+//	thread through the locks it still holds.
+//----------------------------------------------------------------------
+
+static int maxDonation;
+
+static void LockDonation(int arg)
+{
+    Thread *t = ((Lock *)arg)->BestWaiter();
+    if (t != NULL && t->getPriority() > maxDonation)
+        maxDonation = t->getPriority();
+}
+
+//----------------------------------------------------------------------
+// Lock::FindDeadlock
+// 	The current thread is about to wait for the lock.  Follow the
+//	wait-for graph from here: the lock's owner, the lock that thread
+//	is waiting for, its owner, and so on.  If the chain comes back to
+//	the current thread, waiting would deadlock; return the lock on the
+//	cycle that the DeadlockPolicy says to take away from its owner.
+//	Otherwise return NULL.
+//
+//	The walk is bounded by the number of threads, in case the chain
+//	runs into an old deadlock that was only reported.
+//----------------------------------------------------------------------
+
+DeadlockPolicy Lock::deadlockPolicy = DeadlockReport;
+
+Lock *Lock::FindDeadlock()
+{
+    Lock *lock = this;
+    Lock *lowest = NULL;        // the lock of the lowest-priority owner
+
+    for (int steps = threadTable->NumSlots(); steps > 0; steps--) {
+        Thread *holder = lock->owner;
+
+        if (holder == NULL)
+            return NULL;
+        if (lowest == NULL || holder->getBasePriority()
+                < lowest->owner->getBasePriority())
+            lowest = lock;
+        if (holder == currentThread)
+            return (deadlockPolicy == DeadlockBreakLowest) ? lowest : lock;
+        lock = (Lock *)holder->getWaitingLock();
+        if (lock == NULL)
+            return NULL;
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// Lock::Grant
+// 	Make "thread" the owner of the lock.  If it was waiting for it,
+//	the threads still waiting now lend their priority to it instead.
+//	If the lock was once taken away from it, that is forgotten: its
+//	next Release is for real.
+//----------------------------------------------------------------------
+
+void Lock::Grant(Thread *thread)
+{
+    Thread *next = BestWaiter();
+
+    (void) victims->RemoveItem((void *)thread);
+    thread->setWaitingLock(NULL);
+    thread->getHeldLocks()->Append((void *)this);
+    if (next != NULL && next->getPriority() > thread->getPriority())
+        thread->setDonatedPriority(next->getPriority());
+    owner = thread;
+    value = 0;                  // set the value to be BUSY
+}
+
+//----------------------------------------------------------------------
+// Lock::Enqueue
+// 	Make "thread", which is asleep, wait for the lock, just as if it
+//	had called Acquire.  Used by Condition::Signal, so that the thread
+//	is only woken up when the signaller releases the lock.
+//----------------------------------------------------------------------
+
+void Lock::Enqueue(Thread *thread)
+{
+    queue->Append((void *)thread);
+    thread->setWaitingLock((void *)this);
+    Donate(thread);
+}
+
+//----------------------------------------------------------------------
+// Lock::Acquire
+// 	Wait until the lock is FREE, then make it ours.  If the lock
+//	hands off, Release makes us the owner before waking us up.
+//----------------------------------------------------------------------
+
 void Lock::Acquire()
 {
     // disable interrupts
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
-    while (value == 0) {            // lock is BUSY
+    ASSERT(!isHeldByCurrentThread());   // would wait for itself
+    stats->numLockAcquires++;
+    if (value == 0)
+        stats->numLockWaits++;      // contended
+    while (value == 0 && owner != currentThread) {  // lock is BUSY
         queue->Append((void *)currentThread);   // so go to sleep
         currentThread->setWaitingLock((void *)this);
-        if (DeadLockDetect()) {
-            Lock *lock = (Lock *)currentThread->getHoldLock();
-            if (lock != NULL) {
-                printf("%s has to release %s and finish\n", currentThread->getName(), lock->getName());
-                lock->Release();
+        Donate(currentThread);
+        Lock *lock = FindDeadlock();
+        if (lock != NULL) {
+            stats->numDeadlocks++;
+            if (deadlockPolicy == DeadlockReport)
+                DEBUG('t', "\"%s\" waiting for %s would deadlock\n",
+                      currentThread->getName(), getName());
+            else {
+                DEBUG('t', "Taking %s away from \"%s\" to break a deadlock\n",
+                      lock->getName(), lock->owner->getName());
+                lock->ReleaseFor(lock->owner, TRUE);
             }
         }
         currentThread->Sleep();
     }
-    currentThread->setWaitingLock(NULL);
-    currentThread->setHoldLock(this);
-    owner = currentThread;   // lock is FREE, get the lock
-    value = 0;                 // and set the value to be BUSY
+    if (owner != currentThread)     // else handed to us by Release
+        Grant(currentThread);   // lock is FREE, get the lock
     (void) interrupt->SetLevel(oldLevel);   // re-enable interrupts
 }
 
+//----------------------------------------------------------------------
+// Lock::TryAcquire
+// 	Get the lock if it is FREE, but don't wait for it.  Return TRUE
+//	if we got it.
+//----------------------------------------------------------------------
+
+bool Lock::TryAcquire()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    bool gotIt = (value == 1);
+
+    ASSERT(!isHeldByCurrentThread());
+    stats->numLockAcquires++;
+    if (gotIt)
+        Grant(currentThread);
+    (void) interrupt->SetLevel(oldLevel);
+    return gotIt;
+}
+
+//----------------------------------------------------------------------
+// Lock::Release
+// 	Give up the lock.  If it was taken away from us to break a
+//	deadlock, someone else may hold it by now: do nothing.
+//----------------------------------------------------------------------
+
 void Lock::Release()
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
-    ASSERT(isHeldByCurrentThread());
+    if (isHeldByCurrentThread())
+        ReleaseFor(currentThread, FALSE);
+    else if (victims->RemoveItem((void *)currentThread))
+        DEBUG('t', "\"%s\" releases %s, already taken away\n",
+              currentThread->getName(), getName());
+    else
+        ASSERT(FALSE);              // never held it
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Lock::ReleaseFor
+// 	Release the lock, as if "holder" had released it: take back the
+//	priority lent to "holder" for it, set it FREE, and wake up the
+//	waiter with the highest priority, if any -- handing it the lock,
+//	if the lock hands off.  Called with interrupts disabled, by
+//	Release or to break a deadlock.
+//
+//	"stolen" -- TRUE when breaking a deadlock: "holder" will still
+//		call Release, which must then do nothing
+//----------------------------------------------------------------------
+
+void Lock::ReleaseFor(Thread *holder, bool stolen)
+{
     Thread *thread;
-    thread = (Thread *)queue->Remove();
-    if (thread != NULL)    // make thread ready
-        scheduler->ReadyToRun(thread);
+
+    if (stolen)
+        victims->Append((void *)holder);
+    holder->getHeldLocks()->RemoveItem((void *)this);
+    maxDonation = 0;        // give back what was lent for this lock
+    holder->getHeldLocks()->Mapcar((VoidFunctionPtr) LockDonation);
+    holder->setDonatedPriority(maxDonation);
+    owner = NULL;   // so deadlock detection doesn't follow a stale owner
     value = 1; // set the value to FREE
-    (void) interrupt->SetLevel(oldLevel);
+    thread = BestWaiter();
+    if (thread != NULL) {  // make thread ready
+        queue->RemoveItem((void *)thread);
+        if (handoff)
+            Grant(thread);
+        scheduler->ReadyToRun(thread);
+    }
 }
 
 bool Lock::isHeldByCurrentThread()
@@ -191,6 +438,13 @@ Condition::~Condition()
     delete queue;
 }
 
+//----------------------------------------------------------------------
+// Condition::Wait
+// 	Release the lock and go to sleep, until Signal moves us to the
+//	lock's queue and Release wakes us up (and perhaps hands us the
+//	lock).
+//----------------------------------------------------------------------
+
 void Condition::Wait(Lock* conditionLock)
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
@@ -198,18 +452,49 @@ void Condition::Wait(Lock* conditionLock)
     conditionLock->Release();
     queue->Append((void *)currentThread);
     currentThread->Sleep();   //go to sleep
-    conditionLock->Acquire();
+    if (!conditionLock->isHeldByCurrentThread())
+        conditionLock->Acquire();
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Condition::TimedWait
+// 	Wait, as above, but for no more than "ticks": return TRUE if we
+//	were signalled, FALSE if we gave up.  Either way, we hold the
+//	lock again when we return.
+//----------------------------------------------------------------------
+
+bool Condition::TimedWait(Lock* conditionLock, int ticks)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    bool signalled;
+
+    ASSERT(conditionLock->isHeldByCurrentThread());
+    conditionLock->Release();
+    queue->Append((void *)currentThread);
+    StartTimeout(queue, (ticks > 0) ? ticks : 1);
+    currentThread->Sleep();
+    signalled = !StopTimeout();
+    if (!conditionLock->isHeldByCurrentThread())
+        conditionLock->Acquire();
     (void) interrupt->SetLevel(oldLevel);
+    return signalled;
 }
 
+//----------------------------------------------------------------------
+// Condition::Signal
+// 	Move a waiter, if any, to the lock's queue.  We hold the lock, so
+//	waking it up now would only have it go back to sleep in Acquire.
+//----------------------------------------------------------------------
+
 void Condition::Signal(Lock* conditionLock)
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
     ASSERT(conditionLock->isHeldByCurrentThread());
     Thread *thread;
     thread = (Thread *)queue->Remove();
-    if (thread != NULL)    // make thread ready
-        scheduler->ReadyToRun(thread);
+    if (thread != NULL)    // have it wait for the lock
+        conditionLock->Enqueue(thread);
     (void) interrupt->SetLevel(oldLevel);
 }
 
@@ -219,9 +504,9 @@ void Condition::Broadcast(Lock* conditionLock)
     ASSERT(conditionLock->isHeldByCurrentThread());
     Thread *thread;
     thread = (Thread *)queue->Remove();
-    while (thread != NULL)    // make all threads in queue ready
+    while (thread != NULL)    // have all threads in queue wait for the lock
     {
-        scheduler->ReadyToRun(thread);
+        conditionLock->Enqueue(thread);
         thread = (Thread *)queue->Remove();
     }
     (void) interrupt->SetLevel(oldLevel);
@@ -265,66 +550,224 @@ void Barrier::Wait()
     (void) interrupt->SetLevel(oldLevel);
 }
 
-RWlock::RWlock(char *debugName)
+//----------------------------------------------------------------------
+// RWlock::RWlock
+// 	Initialize a reader/writer lock, so that it is free.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//	"pref" is who gets the lock first, when several are waiting.
+//----------------------------------------------------------------------
+
+// A thread waiting for a reader/writer lock, and what for
+class RWWaiter {
+  public:
+    Thread *thread;
+    bool write;
+};
+
+RWlock::RWlock(char *debugName, RWPreference pref)
 {
     name = debugName;
-    readerQueue = new List;
-    writerQueue = new List;
+    preference = pref;
+    queue = new List;
+    numWaiting = waitingWriters = 0;
     status = NOP;
+    readers = 0;
 }
 
 RWlock::~RWlock()
 {
-    delete readerQueue;
-    delete writerQueue;
+    delete queue;
+}
+
+//----------------------------------------------------------------------
+// RWlock::CanRead
+// 	Return TRUE if a thread that wants to read may go in now, rather
+//	than wait behind the threads that are waiting already.
+//----------------------------------------------------------------------
+
+bool RWlock::CanRead()
+{
+    if (status == WRITING)
+        return FALSE;
+    switch (preference) {
+      case PreferWriters:
+        return waitingWriters == 0;
+      case PreferReaders:
+        return TRUE;
+      default:
+        return numWaiting == 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// RWlock::Wait
+// 	Wait at the end of the queue, until LetIn gives us the lock.
+//	Interrupts are disabled.
+//
+//	"write" -- TRUE to wait for the lock for writing
+//----------------------------------------------------------------------
+
+void RWlock::Wait(bool write)
+{
+    RWWaiter waiter;            // on our stack, which is safe while we sleep
+
+    waiter.thread = currentThread;
+    waiter.write = write;
+    queue->Append((void *)&waiter);
+    numWaiting++;
+    if (write)
+        waitingWriters++;
+    DEBUG('t', "Thread \"%s\" waits for %s to %s\n", currentThread->getName(),
+          name, write ? "write" : "read");
+    currentThread->Sleep();
 }
 
+//----------------------------------------------------------------------
+// RWlock::LetIn
+// 	Give the lock to waiters, and wake them up: the first waiting
+//	writer, or the waiting readers -- all of them, or (if "write" is
+//	FALSE and the lock is FIFO) those ahead of the first writer.
+//	The order of the others in the queue is kept.
+//
+//	"write" -- TRUE to let in a writer, FALSE for readers
+//----------------------------------------------------------------------
+
+void RWlock::LetIn(bool write)
+{
+    List *rest = new List;      // the ones we don't let in
+    RWWaiter *waiter;
+    bool blocked = FALSE;       // passed a waiter we can't let in
+    int count = 0;
+
+    while ((waiter = (RWWaiter *)queue->Remove()) != NULL) {
+        if (waiter->write == write && !blocked) {
+            numWaiting--;
+            if (write) {
+                waitingWriters--;
+                status = WRITING;
+                blocked = TRUE;             // only one writer
+            } else {
+                status = READING;
+                readers++;
+            }
+            count++;
+            scheduler->ReadyToRun(waiter->thread);
+        } else {
+            if (!write && preference == PreferFIFO)
+                blocked = TRUE;             // readers behind a writer wait
+            rest->Append((void *)waiter);
+        }
+    }
+    delete queue;
+    queue = rest;
+    DEBUG('t', "%s lets in %d %s\n", name, count, write ? "writer" : "readers");
+}
+
+//----------------------------------------------------------------------
+// RWlock::rdlock, RWlock::wrlock
+// 	Wait until the lock can be held for reading (writing), and hold
+//	it.  If we have to wait, whoever lets us in gives us the lock.
+//----------------------------------------------------------------------
+
 void RWlock::rdlock()
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
-    while (status == WRITING || !writerQueue->IsEmpty())
-    {
-        printf("Thread \"%s\" (tid: %d) is blocked.\n",
-            currentThread->getName(), currentThread->getTID());
-        readerQueue->Append((void *)currentThread);   // go to sleep
-        currentThread->Sleep();
-    }
-    status = READING;
+    if (CanRead()) {
+        status = READING;
+        readers++;
+    } else
+        Wait(FALSE);
     (void) interrupt->SetLevel(oldLevel);
 }
 
 void RWlock::wrlock()
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
-    while (status == READING || status == WRITING)
-    {
-        printf("Thread \"%s\" (tid: %d) is blocked.\n",
-            currentThread->getName(), currentThread->getTID());
-        writerQueue->Append((void *)currentThread);   // go to sleep
-        currentThread->Sleep();
-    }
-    status = WRITING;
+    if (status == NOP)          // (no one waits while it is free)
+        status = WRITING;
+    else
+        Wait(TRUE);
     (void) interrupt->SetLevel(oldLevel);
 }
 
+//----------------------------------------------------------------------
+// RWlock::unlock
+// 	Stop holding the lock.  When the last holder leaves, let in the
+//	waiters the preference says go next.
+//----------------------------------------------------------------------
+
 void RWlock::unlock()
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
-    Thread *thread;
-    if (!writerQueue->IsEmpty()) // if any writer
-    {
-        thread = (Thread *)writerQueue->Remove();
-        scheduler->ReadyToRun(thread);
+    ASSERT(status != NOP);
+    if (status == READING && --readers > 0) {  // other readers still in
+        (void) interrupt->SetLevel(oldLevel);
+        return;
     }
-    else
-    {
-        thread = (Thread *)readerQueue->Remove();
-        while (thread != NULL)
-        {
-            scheduler->ReadyToRun(thread);
-            thread = (Thread *)readerQueue->Remove();
+    status = NOP;
+    if (numWaiting > 0) {
+        RWWaiter *first = (RWWaiter *)queue->Remove();
+
+        queue->Prepend((void *)first, 0);   // just looking
+        switch (preference) {
+          case PreferWriters:
+            LetIn(waitingWriters > 0);
+            break;
+          case PreferReaders:
+            LetIn(waitingWriters == numWaiting);
+            break;
+          default:
+            LetIn(first->write);
+            break;
         }
     }
-    status = NOP;
     (void) interrupt->SetLevel(oldLevel);
-}
\ No newline at end of file
+}
+
+//----------------------------------------------------------------------
+// RWlock::TryUpgrade
+// 	Called by a thread holding the lock for reading: if it is the
+//	only reader, hold the lock for writing instead, and return TRUE.
+//	No other writer can get in between, as there could if it unlocked
+//	and called wrlock.  Otherwise return FALSE, still reading.
+//----------------------------------------------------------------------
+
+bool RWlock::TryUpgrade()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    bool alone = (status == READING && readers == 1);
+
+    ASSERT(status == READING);
+    if (alone) {
+        status = WRITING;
+        readers = 0;
+    }
+    (void) interrupt->SetLevel(oldLevel);
+    return alone;
+}
+
+//----------------------------------------------------------------------
+// RWlock::Downgrade
+// 	Called by the thread holding the lock for writing: hold it for
+//	reading instead, and let in the waiting readers that could come
+//	in now if they were new.
+//----------------------------------------------------------------------
+
+void RWlock::Downgrade()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    ASSERT(status == WRITING);
+    status = READING;
+    readers = 1;
+    if (numWaiting > waitingWriters) {      // some readers waiting
+        RWWaiter *first = (RWWaiter *)queue->Remove();
+
+        queue->Prepend((void *)first, 0);   // just looking
+        if (preference == PreferReaders
+            || (preference == PreferWriters && waitingWriters == 0)
+            || (preference == PreferFIFO && !first->write))
+            LetIn(FALSE);
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
@@ -44,6 +44,8 @@ class Semaphore {
     
     void P();	 // these are the only operations on a semaphore
     void V();	 // they are both *atomic*
+    bool TimedP(int ticks);	// P, unless it takes more than "ticks";
+				// return TRUE if it didn't
     
   private:
     char* name;        // useful for debugging
@@ -62,27 +64,71 @@ class Semaphore {
 // In addition, by convention, only the thread that acquired the lock
 // may release it.  As with semaphores, you can't read the lock value
 // (because the value might change immediately after you read it).  
+//
+// A lock created with "handoff" gives itself straight to the thread
+// that Release wakes up, so that no other thread can take it first.
+//
+// A thread waiting in Acquire lends its priority to the lock's owner,
+// if that is higher, and so on along the chain of owners that are
+// themselves waiting for locks; Release hands the lock to the waiter
+// with the highest priority, and takes back what was lent for it.
+//
+// Each thread waiting in Acquire is an edge of a "wait-for" graph, from
+// itself to the lock's owner.  A deadlock is a cycle in the graph, and
+// any new cycle must go through the newest edge, so Acquire only has to
+// follow the chain of owners from the lock it is about to wait for.
+// What happens when it finds one is up to the DeadlockPolicy.
+
+// What to do about a deadlock: just report it (the default), or break
+// it by taking a lock on the cycle away from one of the threads -- the
+// one whose Acquire closed the cycle, or the one with the lowest
+// priority of its own.  The thread that loses a lock carries on as if
+// it still held it; its Release of the lock does nothing, but it can't
+// Wait on a condition with it (isHeldByCurrentThread tells it which).
+enum DeadlockPolicy { DeadlockReport, DeadlockBreakRequester,
+		      DeadlockBreakLowest };
 
 class Lock {
   public:
-    Lock(char* debugName);  		// initialize lock to be FREE
+    Lock(char* debugName, bool handoff = FALSE);
+					// initialize lock to be FREE
     ~Lock();				// deallocate lock
     char* getName() { return name; }	// debugging assist
 
     void Acquire(); // these are the only operations on a lock
     void Release(); // they are both *atomic*
+    bool TryAcquire();	// Acquire, if the lock is FREE; return TRUE
+			// if it was
 
     bool isHeldByCurrentThread();	// true if the current thread
 					// holds this lock.  Useful for
 					// checking in Release, and in
 					// Condition variable ops below.
     Thread* getOwner() {return owner;}
+    Thread* BestWaiter();		// the waiter with the highest
+					// priority, NULL if none
+
+    static DeadlockPolicy deadlockPolicy;	// for every lock; the
+					// default is DeadlockReport
 
   private:
     char* name;		// for debugging
     int value;       // lock value, 1 or 0 (FREE or BUSY)
     Thread *owner;   // a pointer to the lock's owner
+    bool handoff;    // does Release give the lock to the waiter?
     List *queue;     // threads waiting in Acquire() for the value to be 1
+    List *victims;   // threads it was taken from, that haven't Released
+
+    friend class Condition;
+
+    void Donate(Thread *donor);	// lend donor's priority to the owner
+    void Grant(Thread *thread);	// make thread the owner
+    void Enqueue(Thread *thread);	// have thread wait for the lock
+    Lock *FindDeadlock();	// would waiting for this lock close a
+				// cycle?  If so, return the lock on it
+				// that the policy picks to break
+    void ReleaseFor(Thread *holder, bool stolen);
+				// Release, on behalf of "holder"
 };
 
 // The following class defines a "condition variable".  A condition
@@ -131,6 +177,9 @@ class Condition {
     void Signal(Lock *conditionLock);   // conditionLock must be held by
     void Broadcast(Lock *conditionLock);// the currentThread for all of 
 					// these operations
+    bool TimedWait(Lock *conditionLock, int ticks);
+					// Wait, unless it takes more than
+					// "ticks"; return TRUE if signalled
 
   private:
     char* name;
@@ -151,21 +200,60 @@ private:
     List *queue;
 };
 
+// The following class defines a reader/writer lock.  Any number of
+// threads may hold it for reading at once, or one thread for writing.
+//
+//	rdlock, wrlock -- wait until the lock can be held for reading
+//		(writing), then hold it
+//
+//	unlock -- stop holding it, waking up waiters if they can now have
+//		it
+//
+//	TryUpgrade -- a reader that is the only one becomes the writer,
+//		without letting anyone in between; FALSE if there are
+//		other readers
+//
+//	Downgrade -- the writer becomes a reader, letting in any readers
+//		that were waiting (if the preference allows)
+//
+// Which waiters get the lock, when it is set free, is up to the lock's
+// preference:
+//
+//	PreferWriters -- a waiting writer goes first; readers wait
+//		while a writer is waiting, even if readers hold the lock
+//	PreferReaders -- readers go first, and join those already
+//		reading; writers can starve
+//	PreferFIFO -- in the order they came, with each run of readers
+//		at the head of the queue let in together
+//
+// Like a Lock that hands off, waiters are woken up holding the lock.
+
 enum RWlockStatus {NOP, WRITING, READING};
+enum RWPreference {PreferWriters, PreferReaders, PreferFIFO};
 
 class RWlock {
 public:
-    RWlock(char *debugName);
+    RWlock(char *debugName, RWPreference pref = PreferWriters);
     ~RWlock();
     char* getName() {return name;}
     void rdlock();
     void wrlock();
     void unlock();
+    bool TryUpgrade();			// reader -> writer, if alone
+    void Downgrade();			// writer -> reader
 
 private:
     char *name;
+    RWPreference preference;
     RWlockStatus status;
-    List *readerQueue;
-    List *writerQueue;
+    int readers;			// number holding it for reading
+    List *queue;			// RWWaiters, in the order they came
+    int numWaiting;			// how many there are, and how
+    int waitingWriters;			// many of them are writers
+
+    bool CanRead();			// may a new reader go in now?
+    void Wait(bool write);		// wait to be let in
+    void LetIn(bool write);		// let in waiters: readers, writers,
+					// or whoever is first
 };
 #endif // SYNCH_H
@@ -11,9 +11,8 @@
 // This defines *all* of the global data structures used by Nachos.
 // These are all initialized and de-allocated by this file.
 
-Thread *threadTable[MAX_THREAD_NUM];
+ThreadTable *threadTable;		// every thread, by thread ID
 Thread *currentThread;			// the thread we are running now
-Thread *threadToBeDestroyed;  		// the thread that just finished
 Scheduler *scheduler;			// the ready list
 Interrupt *interrupt;			// interrupt status
 Statistics *stats;			// performance metrics
@@ -74,16 +73,12 @@ MyTimerInterruptHandler(int dummy)
 {
     if (interrupt->getStatus() == IdleMode)
         return;
+    if (scheduler->getNumCPUs() > 1)
+        interrupt->SwitchCPUOnReturn(); // give the next CPU its turn
     currentThread->refreshTickCount();
 
-    // check TimeQuantum, if currentThread hasn't been executed for enough time, just return
-    if (currentThread->getTickCount() < currentThread->getTimeQuantum())
-        return;
-    // currentThread's timeQuantum is used up, it's time to adjust threads' priorities
-    currentThread->decPriority();
-    scheduler->AdjustPriority(); // adjust priority of the threads in ready list
-    int nextThreadPriority = scheduler->PeekPriority();
-    if (nextThreadPriority > currentThread->getPriority())
+    // the scheduling policy decides whether currentThread has run long enough
+    if (scheduler->ShouldPreempt())
         interrupt->YieldOnReturn(); // hints that it should re-schedule
 }
 //----------------------------------------------------------------------
@@ -102,6 +97,8 @@ Initialize(int argc, char **argv)
     int argCount;
     char* debugArgs = "";
     bool randomYield = FALSE;
+    int numCPUs = 1;		// simulated processors
+    SchedPolicy policy = PriorityPolicy;	// how to choose threads
 
 #ifdef USER_PROGRAM
     bool debugUserProg = FALSE;	// single step user program
@@ -109,6 +106,13 @@ Initialize(int argc, char **argv)
 #ifdef FILESYS_NEEDED
     bool format = FALSE;	// format disk
 #endif
+#ifdef FILESYS
+    bool mapDisk = FALSE;	// map the disk file into memory
+    int sectorsPerTrack = 0;	// disk geometry, when formatting
+    int tracks = 0;
+    DiskArrayLevel diskLevel = SingleDisk;	// how many disks, and
+    int numDisks = 1;				// how they're used
+#endif
 #ifdef NETWORK
     double rely = 1;		// network reliability
     int netname = 0;		// UNIX socket name
@@ -129,6 +133,32 @@ Initialize(int argc, char **argv)
 						// number generator
 	    randomYield = TRUE;
 	    argCount = 2;
+	} else if (!strcmp(*argv, "-smp")) {
+	    ASSERT(argc > 1);
+	    numCPUs = atoi(*(argv + 1));
+	    ASSERT(numCPUs > 0);
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-deadlock")) {
+	    ASSERT(argc > 1);
+	    if (!strcmp(*(argv + 1), "report"))
+		Lock::deadlockPolicy = DeadlockReport;
+	    else if (!strcmp(*(argv + 1), "lowest"))
+		Lock::deadlockPolicy = DeadlockBreakLowest;
+	    else {
+		ASSERT(!strcmp(*(argv + 1), "requester"));
+		Lock::deadlockPolicy = DeadlockBreakRequester;
+	    }
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-sched")) {
+	    ASSERT(argc > 1);
+	    if (!strcmp(*(argv + 1), "stride"))
+		policy = StridePolicy;
+	    else if (!strcmp(*(argv + 1), "cfs"))
+		policy = CFSPolicy;
+	    else {
+		ASSERT(!strcmp(*(argv + 1), "priority"));
+	    }
+	    argCount = 2;
 	}
 #ifdef USER_PROGRAM
 	if (!strcmp(*argv, "-s"))
@@ -138,6 +168,21 @@ Initialize(int argc, char **argv)
 	if (!strcmp(*argv, "-f"))
 	    format = TRUE;
 #endif
+#ifdef FILESYS
+	if (!strcmp(*argv, "-mmap"))
+	    mapDisk = TRUE;
+	else if (!strcmp(*argv, "-geometry")) {
+	    ASSERT(argc > 2);
+	    sectorsPerTrack = atoi(*(argv + 1));
+	    tracks = atoi(*(argv + 2));
+	    argCount = 3;
+	} else if (!strcmp(*argv, "-stripe") || !strcmp(*argv, "-mirror")) {
+	    ASSERT(argc > 1);
+	    diskLevel = (!strcmp(*argv, "-stripe")) ? Striped : Mirrored;
+	    numDisks = atoi(*(argv + 1));
+	    argCount = 2;
+	}
+#endif
 #ifdef NETWORK
 	if (!strcmp(*argv, "-l")) {
 	    ASSERT(argc > 1);
@@ -154,15 +199,13 @@ Initialize(int argc, char **argv)
     DebugInit(debugArgs);			// initialize DEBUG messages
     stats = new Statistics();			// collect statistics
     interrupt = new Interrupt;			// start up interrupt handling
-    scheduler = new Scheduler();		// initialize the ready queue
+    scheduler = new Scheduler(numCPUs, policy);	// initialize the ready queues
     lastScheduleTime = 0;
     timer = new Timer(MyTimerInterruptHandler, 0, false);
  //    if (randomYield)				// start the timer (if needed)
 	// timer = new Timer(TimerInterruptHandler, 0, randomYield);
 
-    threadToBeDestroyed = NULL;
-    for (int i = 0; i < MAX_THREAD_NUM; ++i)
-        threadTable[i] = NULL;
+    threadTable = new ThreadTable;
     for (int i = 0; i < MAX_MESSAGE_QUEUE_NUM; ++i)
         messageQueue[i] = NULL;
     for (int i = 0; i < MAX_MESSAGE_QUEUE_NUM * 100; ++i)
@@ -182,7 +225,12 @@ Initialize(int argc, char **argv)
 #endif
 
 #ifdef FILESYS
-    synchDisk = new SynchDisk("DISK");
+#ifdef FILESYS_NEEDED
+    if (!format)			// only a fresh disk can change shape
+	sectorsPerTrack = tracks = 0;
+#endif
+    synchDisk = new SynchDisk("DISK", mapDisk, sectorsPerTrack, tracks,
+			      diskLevel, numDisks);
 #endif
 
 #ifdef FILESYS_NEEDED
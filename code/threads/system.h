@@ -8,12 +8,12 @@
 #ifndef SYSTEM_H
 #define SYSTEM_H
 
-#define MAX_THREAD_NUM 128
 #define MAX_MESSAGE_QUEUE_NUM 10
 
 #include "copyright.h"
 #include "utility.h"
 #include "thread.h"
+#include "threadtable.h"
 #include "scheduler.h"
 #include "interrupt.h"
 #include "stats.h"
@@ -26,9 +26,8 @@ extern void Initialize(int argc, char **argv); 	// Initialization,
 extern void Cleanup();				// Cleanup, called when
 						// Nachos is done.
 
-extern Thread* threadTable[MAX_THREAD_NUM];
+extern ThreadTable *threadTable;		// every thread, by thread ID
 extern Thread *currentThread;			// the thread holding the CPU
-extern Thread *threadToBeDestroyed;  		// the thread that just finished
 extern Scheduler *scheduler;			// the ready list
 extern Interrupt *interrupt;			// interrupt status
 extern Statistics *stats;			// performance metrics
@@ -25,6 +25,47 @@
 					// execution stack, for detecting 
 					// stack overflows
 
+// Stacks of the default size, from threads that have finished, ready
+// to be used again.  Each keeps the guard pages AllocBoundedArray put
+// around it.
+static List *stackPool = NULL;
+static int numPooledStacks = 0;
+
+//----------------------------------------------------------------------
+// GetStack
+// 	Return a stack of "size" words: one from the pool, if it is the
+//	default size and the pool has one, otherwise a new one.
+//----------------------------------------------------------------------
+
+static int *
+GetStack(int size)
+{
+    if (size == StackSize && numPooledStacks > 0) {
+	numPooledStacks--;
+	return (int *) stackPool->Remove();
+    }
+    return (int *) AllocBoundedArray(size * sizeof(int));
+}
+
+//----------------------------------------------------------------------
+// PutStack
+// 	Give back the stack of a thread that has finished: keep it in the
+//	pool, if it is the default size and the pool isn't full, otherwise
+//	free it.
+//----------------------------------------------------------------------
+
+static void
+PutStack(int *stack, int size)
+{
+    if (size == StackSize && numPooledStacks < MaxPooledStacks) {
+	if (stackPool == NULL)
+	    stackPool = new List;
+	stackPool->Append((void *) stack);
+	numPooledStacks++;
+    } else
+	DeallocBoundedArray((char *) stack, size * sizeof(int));
+}
+
 //----------------------------------------------------------------------
 // Thread::Thread
 // 	Initialize a thread control block, so that we can then call
@@ -38,6 +79,7 @@ Thread::Thread(char* threadName)
     name = threadName;
     stackTop = NULL;
     stack = NULL;
+    stackSize = StackSize;
     status = JUST_CREATED;
     priority = DefaultPriority;
     timeQuantum = 10;
@@ -46,15 +88,16 @@ Thread::Thread(char* threadName)
     tid = -1;
     joinList = new List;
     waitingLock = NULL;
-    holdLock = NULL;
-    marked = 0;
-    for (int i = 0; i < MAX_THREAD_NUM; ++i)
-        if (threadTable[i] == NULL)
-        {
-            tid = i;
-            threadTable[i] = this;
-            break;
-        }
+    heldLocks = new List;
+    timedOut = FALSE;
+    timedQueue = NULL;
+    donatedPriority = 0;
+    cpu = -1;
+    virtualTime = 0;
+    cpuTicks = 0;
+    readySince = -1;
+    waitTicks = numWaits = maxWait = 0;
+    tid = threadTable->Add(this);	// -1 if there are too many threads
 #ifdef USER_PROGRAM
     space = NULL;
 #endif
@@ -78,14 +121,17 @@ Thread::~Thread()
 
     ASSERT(this != currentThread);
     if (stack != NULL)
-	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+	PutStack(stack, stackSize);
     delete joinList;
+    delete heldLocks;
     if (tid != -1)
-        threadTable[tid] = NULL;
+        threadTable->Remove(tid);
     #ifdef USER_PROGRAM
+    if (space != NULL) {		// kernel threads have no address space
         space->refCnt--;
         if (space->refCnt <= 0)
             delete space;
+    }
     #endif
 }
 
@@ -172,7 +218,7 @@ Thread::CheckOverflow()
 {
     if (stack != NULL)
 #ifdef HOST_SNAKE			// Stacks grow upward on the Snakes
-	ASSERT(stack[StackSize - 1] == STACK_FENCEPOST);
+	ASSERT(stack[stackSize - 1] == STACK_FENCEPOST);
 #else
 	ASSERT((int) *stack == (int) STACK_FENCEPOST);
 #endif
@@ -185,12 +231,13 @@ Thread::CheckOverflow()
 //
 // 	NOTE: we don't immediately de-allocate the thread data structure 
 //	or the execution stack, because we're still running in the thread 
-//	and we're still on the stack!  Instead, we set "threadToBeDestroyed", 
-//	so that Scheduler::Run() will call the destructor, once we're
-//	running in the context of a different thread.
+//	and we're still on the stack!  Instead, we put ourselves on the
+//	scheduler's list of zombies, so that Scheduler::Run() will call
+//	the destructor, once we're running in the context of a different
+//	thread.
 //
 // 	NOTE: we disable interrupts, so that we don't get a time slice 
-//	between setting threadToBeDestroyed, and going to sleep.
+//	between becoming a zombie, and going to sleep.
 //----------------------------------------------------------------------
 
 //
@@ -202,8 +249,7 @@ Thread::Finish (int arg)
     
     DEBUG('t', "Finishing thread \"%s\"\n", getName());
     
-    threadToBeDestroyed = currentThread;
-    status = ZOMBIE;
+    scheduler->AddZombie(this);
     Thread *t;
     while ((t = (Thread *)joinList->Remove()) != NULL) {
         t->setJoinState(arg);
@@ -281,15 +327,39 @@ Thread::Sleep ()
     if (status != ZOMBIE)
     {
         status = BLOCKED;
-        priority = WakeUpPriority;
+        scheduler->Blocked(this);
     }
         
-    while ((nextThread = scheduler->FindNextToRun()) == NULL)
+    while ((nextThread = scheduler->FindNextToRun()) == NULL
+	   && (nextThread = scheduler->FindOtherCPU()) == NULL)
 	interrupt->Idle();	// no one to run, wait for an interrupt
         
     scheduler->Run(nextThread); // returns when we've been signalled
 }
 
+//----------------------------------------------------------------------
+// Thread::SleepFor
+// 	Go to sleep, and wake up "ticks" from now.  Rather than spinning
+//	(or yielding) until then, the thread waits on the scheduler's
+//	list of sleepers, so that the time goes to other threads, or if
+//	there are none, the machine skips ahead to the next interrupt.
+//----------------------------------------------------------------------
+
+void
+Thread::SleepFor(int ticks)
+{
+    IntStatus oldLevel;
+
+    ASSERT(this == currentThread);
+    if (ticks <= 0)
+	return;
+    oldLevel = interrupt->SetLevel(IntOff);
+    DEBUG('t', "Thread \"%s\" sleeps for %d ticks\n", getName(), ticks);
+    scheduler->WakeAt(this, stats->totalTicks + ticks, NULL);
+    Sleep();
+    (void) interrupt->SetLevel(oldLevel);
+}
+
 void
 Thread::refreshTickCount()
 {
@@ -349,8 +419,10 @@ void ThreadPrint(int arg){ Thread *t = (Thread *)arg; t->Print(); }
 
 //----------------------------------------------------------------------
 // Thread::StackAllocate
-//	Allocate and initialize an execution stack.  The stack is
-//	initialized with an initial stack frame for ThreadRoot, which:
+//	Allocate and initialize an execution stack -- one left behind by
+//	a finished thread, if there is one.  Running off either end of it
+//	hits a protected page.  The stack is initialized with an initial
+//	stack frame for ThreadRoot, which:
 //		enables interrupts
 //		calls (*func)(arg)
 //		calls Thread::Finish
@@ -362,19 +434,19 @@ void ThreadPrint(int arg){ Thread *t = (Thread *)arg; t->Print(); }
 void
 Thread::StackAllocate (VoidFunctionPtr func, int arg)
 {
-    stack = (int *) AllocBoundedArray(StackSize * sizeof(int));
+    stack = GetStack(stackSize);
 
 #ifdef HOST_SNAKE
     // HP stack works from low addresses to high addresses
     stackTop = stack + 16;	// HP requires 64-byte frame marker
-    stack[StackSize - 1] = STACK_FENCEPOST;
+    stack[stackSize - 1] = STACK_FENCEPOST;
 #else
     // i386 & MIPS & SPARC stack works from high addresses to low addresses
 #ifdef HOST_SPARC
     // SPARC stack must contains at least 1 activation record to start with.
-    stackTop = stack + StackSize - 96;
+    stackTop = stack + stackSize - 96;
 #else  // HOST_MIPS  || HOST_i386
-    stackTop = stack + StackSize - 4;	// -4 to be on the safe side!
+    stackTop = stack + stackSize - 4;	// -4 to be on the safe side!
 #ifdef HOST_i386
     // the 80386 passes the return address on the stack.  In order for
     // SWITCH() to go to ThreadRoot when we switch to this thread, the
@@ -57,10 +57,15 @@
 #define MachineStateSize 18 
 
 
-// Size of the thread's private execution stack.
+// Size of the thread's private execution stack, unless the thread
+// asks for another size before it is forked.
 // WATCH OUT IF THIS ISN'T BIG ENOUGH!!!!!
 #define StackSize	(4 * 1024)	// in words
 
+// Stacks of finished threads kept around for new threads to use,
+// rather than being freed (only stacks of the default size)
+#define MaxPooledStacks	64
+
 
 // Thread state
 enum ThreadStatus { JUST_CREATED, RUNNING, READY, BLOCKED, ZOMBIE };
@@ -100,6 +105,8 @@ class Thread {
 						// other thread is runnable
     void Sleep();  				// Put the thread to sleep and 
 						// relinquish the processor
+    void SleepFor(int ticks);			// Sleep, for "ticks" of
+						// simulated time
     void Finish(int arg = 0);  				// The thread is done executing
     
     void CheckOverflow();   			// Check if thread has 
@@ -114,11 +121,17 @@ class Thread {
     void decPriority() {priority -= PriorityAdjustPace; if (priority < 1) priority = 1; DEBUG('t', "Thread \"%s\" (tid: %d) dec priority. now: %d\n", name, tid, priority);}
     void incPriority() {priority += PriorityAdjustPace; DEBUG('t', "Thread \"%s\" (tid: %d) inc priority. now: %d\n", name, tid, priority);}
     void setTimeQuantum(int num) {timeQuantum = num;}
+    void setStackSize(int words) {ASSERT(stack == NULL); stackSize = words;}
+					// call before Fork
     void clearTickCount() {tickCount = 0;}
     void refreshTickCount(); // invoked on timer interrupt,
     int getUID() {return uid;}
     int getTID() {return tid;}
-    int getPriority() {return priority;}
+    int getPriority() {return (donatedPriority > priority) ? donatedPriority : priority;}
+					// counting priority inherited
+					// through Locks it holds
+    int getBasePriority() {return priority;}
+    void setDonatedPriority(int num) {donatedPriority = num;}
     int getTimeQuantum() {return timeQuantum;}
     int getTickCount() {return tickCount;}
     void addToJoinList(Thread *t) {joinList->Append((void *)t);}
@@ -129,16 +142,32 @@ class Thread {
     void getMsg(int i, char *msg);
     void setWaitingLock(void *lock) {waitingLock = lock;}
     void* getWaitingLock() {return waitingLock; }
-    void mark() {marked = 1;}
-    void clearMarked() {marked = 0;}
-    bool isMarked() {return marked == 1;}
-    void setHoldLock(void *lock) {holdLock = lock;}
-    void* getHoldLock() {return holdLock;} 
+    void setCPU(int which) {cpu = which;}
+    int getCPU() {return cpu;}		// -1 if it has never run
+    List *getHeldLocks() {return heldLocks;}	// every Lock it holds
+    void setTimedOut(bool t) {timedOut = t;}
+    bool hasTimedOut() {return timedOut;}	// did its last timed wait
+						// give up?  (cf. synch.cc)
+    void setTimedQueue(List *queue) {timedQueue = queue;}
+    List *getTimedQueue() {return timedQueue;}	// what it is waiting on,
+						// with a time limit
+    void setVirtualTime(int vt) {virtualTime = vt;}
+    int getVirtualTime() {return virtualTime;}	// cf. policy.h
+    void addCPUTicks(int ticks) {cpuTicks += ticks;}
+    int getCPUTicks() {return cpuTicks;}
+    void setReadySince(int when) {readySince = when;}
+    int getReadySince() {return readySince;}	// -1 unless READY
+    void addWait(int ticks) {waitTicks += ticks; numWaits++; if (ticks > maxWait) maxWait = ticks;}
+    int getWaitTicks() {return waitTicks;}
+    int getNumWaits() {return numWaits;}
+    int getMaxWait() {return maxWait;}
 
   private:
     // some of the private data for this class is listed above
 
     int priority;
+    int donatedPriority;	// highest priority of a thread waiting for
+				// a Lock it holds, 0 if none
     int tickCount; // true execute time
     int timeQuantum; 
     int uid;
@@ -146,13 +175,22 @@ class Thread {
     int* stack; 	 		// Bottom of the stack 
 					// NULL if this is the main thread
 					// (If NULL, don't deallocate stack)
+    int stackSize;			// Size of the stack, in words
     ThreadStatus status;		// ready, running or blocked
     char* name;
     List *joinList;
     int joinState;
     void *waitingLock;
-    int marked;
-    void *holdLock;
+    List *heldLocks;
+    bool timedOut;
+    List *timedQueue;			// cf. Scheduler::WakeAt
+    int cpu;				// the CPU it last ran on
+    int virtualTime;			// for the stride and cfs policies
+    int cpuTicks;			// time spent running
+    int readySince;			// when it last became ready
+    int waitTicks;			// time spent ready but not running,
+    int numWaits;			// how many times it did, and the
+    int maxWait;			// longest
 
     void StackAllocate(VoidFunctionPtr func, int arg);
     					// Allocate a stack for thread.
@@ -0,0 +1,172 @@
+// threadpool.cc
+//	Routines for running pieces of work on a pool of worker threads.
+//
+//	Each worker loops: take a WorkItem off the queue, call the
+//	procedure, and tell the item's Task that one more call is done.
+//	Workers are forked once, when the pool is created, so a piece of
+//	work costs a WorkItem on a queue, not a Thread, a stack, and a
+//	slot in the thread table.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "threadpool.h"
+#include "system.h"
+
+static WorkItem quitItem = { NULL, 0 };	// Put on the queue once for each
+					// worker, to stop the pool
+
+//----------------------------------------------------------------------
+// Task::Task
+// 	Initialize a handle for "count" calls to "func", whose arguments
+//	are filled in by the thread pool.
+//----------------------------------------------------------------------
+
+Task::Task(VoidFunctionPtr fn, int count)
+{
+    func = fn;
+    items = new WorkItem[count];
+    remaining = count;
+    lock = new Lock("task");
+    done = new Condition("task done");
+}
+
+//----------------------------------------------------------------------
+// Task::~Task
+// 	De-allocate a handle.  The work must be done: the workers are
+//	still using it until then.
+//----------------------------------------------------------------------
+
+Task::~Task()
+{
+    ASSERT(remaining == 0);
+    delete [] items;
+    delete lock;
+    delete done;
+}
+
+//----------------------------------------------------------------------
+// Task::Wait
+// 	Wait until every call submitted with this task has returned.
+//----------------------------------------------------------------------
+
+void
+Task::Wait()
+{
+    lock->Acquire();
+    while (remaining > 0)
+	done->Wait(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Task::Finished
+// 	Called by a worker when one of the calls has returned; wake up
+//	everyone waiting, if it was the last one.
+//----------------------------------------------------------------------
+
+void
+Task::Finished()
+{
+    lock->Acquire();
+    remaining--;
+    if (remaining == 0)
+	done->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::ThreadPool
+// 	Fork "count" worker threads, to wait for work.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+ThreadPool::ThreadPool(char *debugName, int count)
+{
+    name = debugName;
+    numWorkers = count;
+    queue = new SynchList;
+    stopped = new Semaphore("pool stopped", 0);
+    for (int i = 0; i < numWorkers; i++) {
+	Thread *t = new Thread(name);
+
+	ASSERT(t->getTID() != -1);
+	t->Fork(Worker, (int) this);
+    }
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::~ThreadPool
+// 	Stop the workers, once they have run all the work submitted so
+//	far, and de-allocate the pool.  Must not be called by a worker!
+//----------------------------------------------------------------------
+
+ThreadPool::~ThreadPool()
+{
+    for (int i = 0; i < numWorkers; i++)
+	queue->Append((void *) &quitItem);
+    for (int i = 0; i < numWorkers; i++)
+	stopped->P();
+    delete queue;
+    delete stopped;
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::Submit
+// 	Arrange for one of the workers to call (*func)(arg), and return
+//	a Task to wait on for it to finish.
+//----------------------------------------------------------------------
+
+Task *
+ThreadPool::Submit(VoidFunctionPtr func, int arg)
+{
+    return SubmitAll(func, &arg, 1);
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::SubmitAll
+// 	Arrange for the workers to call (*func)(args[i]) for each of the
+//	"count" arguments, in any order, and return one Task that is done
+//	when all of the calls are.
+//----------------------------------------------------------------------
+
+Task *
+ThreadPool::SubmitAll(VoidFunctionPtr func, int *args, int count)
+{
+    Task *task = new Task(func, count);
+
+    DEBUG('t', "Submitting %d calls to pool \"%s\"\n", count, name);
+    for (int i = 0; i < count; i++) {
+	task->items[i].task = task;
+	task->items[i].arg = args[i];
+	queue->Append((void *) &task->items[i]);
+    }
+    return task;
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::Worker
+// 	The body of each worker thread: run work off the queue until
+//	told to quit.
+//
+//	"arg" is the pool the worker belongs to.
+//----------------------------------------------------------------------
+
+void
+ThreadPool::Worker(int arg)
+{
+    ThreadPool *pool = (ThreadPool *) arg;
+    WorkItem *item;
+
+    while ((item = (WorkItem *) pool->queue->Remove())->task != NULL) {
+	Task *task = item->task;
+
+	(*task->func)(item->arg);
+	task->Finished();		// may free item, once it returns
+    }
+    DEBUG('t', "Worker \"%s\" quitting\n", currentThread->getName());
+    pool->stopped->V();
+}
@@ -0,0 +1,87 @@
+// threadpool.h
+//	Data structures for running short pieces of work on a fixed set
+//	of kernel threads, rather than forking a thread for each.
+//
+//	A piece of work is a procedure and an integer argument, just as
+//	for Thread::Fork.  Submitting it puts it on a queue (a SynchList);
+//	the pool's worker threads take work off the queue and run it, one
+//	piece at a time.  Submitting returns a Task, which the caller can
+//	wait on until the work is done.  Many pieces of work can be
+//	submitted at once, with one Task for all of them.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "copyright.h"
+#include "synch.h"
+#include "synchlist.h"
+
+class Task;
+
+// One call to run: (*task->func)(arg), or if "task" is NULL, a signal
+// for the worker that gets it to quit
+class WorkItem {
+  public:
+    Task *task;
+    int arg;
+};
+
+// The following class defines a handle on work submitted to a thread
+// pool.  It is done when every call submitted with it has returned.
+// The caller deletes it, once it is done.
+
+class Task {
+  public:
+    ~Task();
+
+    void Wait();			// Wait until the work is done
+    bool IsDone() { return remaining == 0; }
+
+  private:
+    friend class ThreadPool;
+
+    Task(VoidFunctionPtr func, int count);
+					// "count" calls to "func" to come
+    void Finished();			// One of the calls has returned
+
+    VoidFunctionPtr func;		// What to call
+    WorkItem *items;			// The argument for each call
+    int remaining;			// Calls that haven't returned yet
+    Lock *lock;				// Protects "remaining"
+    Condition *done;			// Signalled when it reaches zero
+};
+
+// The following class defines a pool of worker threads.
+
+class ThreadPool {
+  public:
+    ThreadPool(char *debugName, int numWorkers);
+					// Fork the worker threads
+    ~ThreadPool();			// Run the work already submitted,
+					// then stop the workers
+
+    Task *Submit(VoidFunctionPtr func, int arg);
+					// Arrange for (*func)(arg) to be
+					// called by one of the workers
+    Task *SubmitAll(VoidFunctionPtr func, int *args, int count);
+					// Likewise for (*func)(args[i]),
+					// for each of the "count" args
+
+    char *getName() { return name; }
+
+  private:
+    char *name;				// For debugging
+    int numWorkers;
+    SynchList *queue;			// WorkItems waiting for a worker;
+					// one with no task tells a worker
+					// to quit
+    Semaphore *stopped;			// V'ed by each worker as it quits
+
+    static void Worker(int pool);	// What each worker thread does
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,138 @@
+// threadtable.cc
+//	Routines to keep track of every thread in the system, by thread ID.
+//
+//	Thread IDs are the slot number in the low TidSlotBits bits, and
+//	the generation of the slot above that; the generation wraps
+//	around before the ID would go negative.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "threadtable.h"
+
+#define SlotOf(tid)		((tid) & (MaxThreads - 1))
+#define GenerationOf(tid)	((unsigned) (tid) >> TidSlotBits)
+#define MaxGeneration		(1 << (31 - TidSlotBits))
+
+//----------------------------------------------------------------------
+// ThreadTable::ThreadTable
+// 	Initialize an empty table, with InitialThreads free slots.
+//----------------------------------------------------------------------
+
+ThreadTable::ThreadTable()
+{
+    numSlots = 0;
+    threads = NULL;
+    generation = NULL;
+    nextFree = NULL;
+    firstFree = -1;
+    Grow();
+}
+
+//----------------------------------------------------------------------
+// ThreadTable::~ThreadTable
+// 	De-allocate the table (but not the threads in it).
+//----------------------------------------------------------------------
+
+ThreadTable::~ThreadTable()
+{
+    delete [] threads;
+    delete [] generation;
+    delete [] nextFree;
+}
+
+//----------------------------------------------------------------------
+// ThreadTable::Grow
+// 	Double the size of the table (or create it), and put the new
+//	slots on the free list, lowest first.  Only called when the free
+//	list is empty.
+//----------------------------------------------------------------------
+
+void
+ThreadTable::Grow()
+{
+    int newSlots = (numSlots == 0) ? InitialThreads : numSlots * 2;
+    Thread **newThreads = new Thread *[newSlots];
+    int *newGeneration = new int[newSlots];
+    int *newNextFree = new int[newSlots];
+
+    ASSERT(firstFree == -1 && newSlots <= MaxThreads);
+    for (int i = 0; i < numSlots; i++) {
+	newThreads[i] = threads[i];
+	newGeneration[i] = generation[i];
+	newNextFree[i] = nextFree[i];
+    }
+    for (int i = numSlots; i < newSlots; i++) {
+	newThreads[i] = NULL;
+	newGeneration[i] = 0;
+	newNextFree[i] = (i + 1 < newSlots) ? i + 1 : -1;
+    }
+    DEBUG('t', "Thread table grows to %d slots\n", newSlots);
+
+    delete [] threads;
+    delete [] generation;
+    delete [] nextFree;
+    threads = newThreads;
+    generation = newGeneration;
+    nextFree = newNextFree;
+    firstFree = numSlots;
+    numSlots = newSlots;
+}
+
+//----------------------------------------------------------------------
+// ThreadTable::Add
+// 	Put "thread" in a free slot, growing the table if there is none.
+//	Return the new thread's ID, or -1 if the table can grow no more.
+//----------------------------------------------------------------------
+
+int
+ThreadTable::Add(Thread *thread)
+{
+    int slot;
+
+    if (firstFree == -1) {
+	if (numSlots == MaxThreads)
+	    return -1;
+	Grow();
+    }
+    slot = firstFree;
+    firstFree = nextFree[slot];
+    threads[slot] = thread;
+    return (generation[slot] << TidSlotBits) | slot;
+}
+
+//----------------------------------------------------------------------
+// ThreadTable::Remove
+// 	Free the slot of the thread with ID "tid", and start the slot's
+//	next generation, so that "tid" no longer finds anything.
+//----------------------------------------------------------------------
+
+void
+ThreadTable::Remove(int tid)
+{
+    int slot = SlotOf(tid);
+
+    ASSERT(Lookup(tid) != NULL);
+    threads[slot] = NULL;
+    generation[slot] = (generation[slot] + 1) % MaxGeneration;
+    nextFree[slot] = firstFree;
+    firstFree = slot;
+}
+
+//----------------------------------------------------------------------
+// ThreadTable::Lookup
+// 	Return the thread with ID "tid", or NULL if there is no such
+//	thread any more.
+//----------------------------------------------------------------------
+
+Thread *
+ThreadTable::Lookup(int tid)
+{
+    int slot = SlotOf(tid);
+
+    if (tid < 0 || slot >= numSlots || (int) GenerationOf(tid) != generation[slot])
+	return NULL;
+    return threads[slot];
+}
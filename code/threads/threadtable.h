@@ -0,0 +1,59 @@
+// threadtable.h
+//	Data structures for keeping track of every thread in the system,
+//	by thread ID.
+//
+//	The table starts small and doubles in size whenever it fills up.
+//	Free slots are kept on a list threaded through the table, so that
+//	finding one, and giving it back, take constant time.
+//
+//	A thread ID names a slot, plus the "generation" of the slot --
+//	how many threads have used it before.  So once a thread is gone,
+//	its ID never names the next thread to use the slot: looking up a
+//	stale ID (say, one a user program saved to Join on later) finds
+//	nothing, instead of some unrelated thread.  The first thread in
+//	each slot has the slot number for its ID.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef THREADTABLE_H
+#define THREADTABLE_H
+
+#include "copyright.h"
+#include "thread.h"
+
+#define InitialThreads	128		// slots in a new table
+#define TidSlotBits	16		// low bits of a thread ID: the slot
+#define MaxThreads	(1 << TidSlotBits)	// the table grows no further
+
+// The following class defines the thread table.
+
+class ThreadTable {
+  public:
+    ThreadTable();			// Initialize an empty table
+    ~ThreadTable();
+
+    int Add(Thread *thread);		// Give "thread" a slot; return its
+					// ID, or -1 if there are too many
+					// threads
+    void Remove(int tid);		// Free the slot of thread "tid"
+    Thread *Lookup(int tid);		// The thread with ID "tid", or NULL
+					// if it is gone (or never was)
+
+    int NumSlots() { return numSlots; }	// For walking through the table:
+    Thread *InSlot(int slot) { return threads[slot]; }
+					// the thread in a slot, or NULL
+
+  private:
+    int numSlots;			// Size of the table
+    Thread **threads;			// The thread in each slot
+    int *generation;			// Threads that have used each slot
+    int *nextFree;			// The free list: the next free slot
+					// after each free slot, or -1
+    int firstFree;			// Head of the free list, or -1
+
+    void Grow();			// Double the size of the table
+};
+
+#endif // THREADTABLE_H
@@ -13,6 +13,7 @@
 #include "system.h"
 #include "thread.h"
 #include "synch.h"
+#include "threadpool.h"
 #include <sysdep.h>
 
 // testnum is set in main.cc
@@ -30,24 +31,26 @@ checkCMD()
     scanf("%s", cmd);
     if ((cmd[0] == 't' || cmd[0] == 'T') && (cmd[1] == 's' || cmd[1] == 'S'))
     {
-        for (int i = 0; i < MAX_THREAD_NUM; ++i)
-            if (threadTable[i] != NULL)
-                threadTable[i]->Print();
+        for (int i = 0; i < threadTable->NumSlots(); ++i)
+            if (threadTable->InSlot(i) != NULL)
+                threadTable->InSlot(i)->Print();
     }
     else if ((cmd[0] == 'l' || cmd[0] == 'L') && (cmd[1] == 'T' || cmd[1] == 't'))
     {
         printf("lastScheduleTime: %d, currentTime: %d, main's tickCount: %d, TimeQuantum: %d\n",
             lastScheduleTime, stats->totalTicks, currentThread->getTickCount(), currentThread->getTimeQuantum());
-        if (threadTable[1] != NULL)
+        if (threadTable->Lookup(1) != NULL)
             printf("Priority: main %d, t1 %d\n", currentThread->getPriority(),
-                threadTable[1]->getPriority());
+                threadTable->Lookup(1)->getPriority());
     }
     else if ((cmd[0] == 'l' || cmd[0] == 'L') && (cmd[1] == 'P' || cmd[1] == 'p'))
     {
-        for (int i = 0; i < MAX_THREAD_NUM; ++i)
-            if (threadTable[i] != NULL)
+        for (int i = 0; i < threadTable->NumSlots(); ++i) {
+            Thread *t = threadTable->InSlot(i);
+            if (t != NULL)
                 printf("Thread \"%s\" (tid: %d) has priority %d\n", 
-                    threadTable[i]->getName(), threadTable[i]->getTID(), threadTable[i]->getPriority());
+                    t->getName(), t->getTID(), t->getPriority());
+        }
     }
 }
 
@@ -92,7 +95,8 @@ ThreadTest1()
 
 //----------------------------------------------------------------------
 // ThreadTest2
-//  Set up 200 threads to test the limitation of threads' number
+//  Set up 200 threads, more than the thread table starts out with,
+//  to see it grow
 //----------------------------------------------------------------------
 void
 ThreadTest2()
@@ -256,7 +260,7 @@ void Consumer(int which)
 
 void ProducerAndConsumer()
 {
-    lock = new Lock("lock");
+    lock = new Lock("lock", TRUE);
     full = new Condition("full");
     empty = new Condition("empty");
     sum = 0;
@@ -305,6 +309,12 @@ void NewReader(int which)
         // read the data
         printf("Thread \"%s\" (tid: %d) is reading. sharedValue: %d\n",
             currentThread->getName(), currentThread->getTID(), sharedValue);
+        // now and then, bump the value, if no one else is reading it
+        if (Random() % 8 == 0 && rwlock->TryUpgrade()) {
+            sharedValue++;
+            printf("Thread \"%s\" (tid: %d) upgraded. sharedValue: %d\n",
+                currentThread->getName(), currentThread->getTID(), sharedValue);
+        }
         rwlock->unlock();
         currentThread->Yield();
     }
@@ -319,6 +329,11 @@ void NewWriter(int which)
         sharedValue = Random() % 1000;
         printf("Thread \"%s\" (tid: %d) is writing. sharedValue: %d\n",
             currentThread->getName(), currentThread->getTID(), sharedValue);
+        // let the readers in, while we check no one changed it
+        int written = sharedValue;
+        rwlock->Downgrade();
+        currentThread->Yield();
+        ASSERT(sharedValue == written);
         rwlock->unlock();
         currentThread->Yield();
     }
@@ -433,7 +448,7 @@ void getLock3First(int which)
     lock1->Acquire();
     printf("%s get Lock1\n", currentThread->getName());
     lock1->Release();
-    // lock3->Release();
+    lock3->Release();
 }
 
 void DeadLockTest()
@@ -450,13 +465,269 @@ void DeadLockTest()
     t1->Fork(getLock1First, 0);
     t2->Fork(getLock2First, 0);
     t3->Fork(getLock3First, 0);
-    // currentThread->Yield();
-    // currentThread->Yield();
-    // if (DeadLockDetect())
-    //     printf("DeadLock occurs!!\n");
-    // else
-    //     printf("No DeadLock\n");
 }
+//----------------------------------------------------------------------
+// ThreadPoolTest
+//  Square some numbers on a pool of three workers: one at a time,
+//  then a batch of them, and check the sum.
+//----------------------------------------------------------------------
+int squares[20];
+
+void Square(int which)
+{
+    squares[which] = which * which;
+    printf("Thread \"%s\" (tid: %d) squared %d\n",
+        currentThread->getName(), currentThread->getTID(), which);
+    currentThread->Yield();
+}
+
+void
+ThreadPoolTest()
+{
+    ThreadPool *pool = new ThreadPool("worker", 3);
+    Task *tasks[5], *batch;
+    int args[15], total = 0;
+
+    for (int i = 0; i < 5; ++i)
+        tasks[i] = pool->Submit(Square, i);
+    for (int i = 0; i < 15; ++i)
+        args[i] = i + 5;
+    batch = pool->SubmitAll(Square, args, 15);
+    for (int i = 0; i < 5; ++i) {
+        tasks[i]->Wait();
+        delete tasks[i];
+    }
+    batch->Wait();
+    delete batch;
+    for (int i = 0; i < 20; ++i)
+        total += squares[i];
+    printf("Sum of squares: %d (expected 2470)\n", total);
+    delete pool;
+}
+
+//----------------------------------------------------------------------
+// SMPTest
+//  Eight threads take turns adding to a counter under a Lock, each
+//  doing some work with and without it.  Run with "-smp <n>" to see
+//  how the work spreads over the CPUs, and how often the threads wait
+//  for the lock.
+//----------------------------------------------------------------------
+Lock *counterLock;
+Semaphore *smpDone;
+int counter;
+
+void Counter(int which)
+{
+    for (int i = 0; i < 20; ++i) {
+        counterLock->Acquire();
+        counter++;
+        for (int j = 0; j < 5; ++j)     // work, holding the lock
+            interrupt->OneTick();
+        counterLock->Release();
+        for (int j = 0; j < 20; ++j)    // work, not holding it
+            interrupt->OneTick();
+    }
+    smpDone->V();
+}
+
+void
+SMPTest()
+{
+    counterLock = new Lock("counter");
+    smpDone = new Semaphore("smp done", 0);
+    counter = 0;
+    for (int i = 0; i < 8; ++i) {
+        Thread *t = new Thread("counter");
+        t->Fork(Counter, i);
+    }
+    for (int i = 0; i < 8; ++i)
+        smpDone->P();
+    printf("Counter: %d (expected 160), at tick %d\n", counter,
+        stats->totalTicks);
+}
+
+//----------------------------------------------------------------------
+// ShareTest
+//  Three threads with 1, 2 and 3 times the default priority each
+//  spin for the same time.  When the first is done, print how much of
+//  the CPU each has had, and how long each waited to run.  Run with
+//  "-sched stride" or "-sched cfs" to see shares of about 1:2:3.
+//----------------------------------------------------------------------
+Thread *spinners[3];
+Semaphore *shareDone;
+bool shareReported;
+
+void Spinner(int which)
+{
+    for (int i = 0; i < 3000; ++i)
+        interrupt->OneTick();
+    if (!shareReported) {
+        int ticks[3], total = 0;
+
+        shareReported = TRUE;
+        for (int i = 0; i < 3; ++i) {
+            ticks[i] = spinners[i]->getCPUTicks();
+            if (spinners[i] == currentThread)
+                ticks[i] += stats->totalTicks - lastScheduleTime;
+            total += ticks[i];
+        }
+        for (int i = 0; i < 3; ++i) {
+            Thread *t = spinners[i];
+
+            printf("Thread \"%s\" (tid: %d) priority %d: %d ticks (%d%%), "
+                "waited %d times, mean %d, max %d\n", t->getName(),
+                t->getTID(), t->getPriority(), ticks[i], ticks[i] * 100 / total,
+                t->getNumWaits(),
+                t->getNumWaits() ? t->getWaitTicks() / t->getNumWaits() : 0,
+                t->getMaxWait());
+        }
+    }
+    shareDone->V();
+}
+
+void
+ShareTest()
+{
+    shareDone = new Semaphore("share done", 0);
+    shareReported = FALSE;
+    for (int i = 0; i < 3; ++i) {
+        spinners[i] = new Thread("spinner");
+        spinners[i]->setPriority(DefaultPriority * (i + 1));
+    }
+    for (int i = 0; i < 3; ++i)
+        spinners[i]->Fork(Spinner, i);
+    for (int i = 0; i < 3; ++i)
+        shareDone->P();
+}
+
+//----------------------------------------------------------------------
+// InversionTest
+//  A low-priority thread holds a lock that a high-priority thread
+//  wants, while medium-priority threads keep the CPU busy.  The low
+//  thread inherits the high one's priority until it releases the lock;
+//  print how long the high thread waited for it.
+//----------------------------------------------------------------------
+Lock *resource;
+Semaphore *inversionDone;
+
+void Holder(int which)
+{
+    resource->Acquire();
+    currentThread->Yield();             // let the others start
+    for (int i = 0; i < 300; ++i)
+        interrupt->OneTick();
+    printf("Thread \"%s\" (tid: %d) releases %s, priority %d\n",
+        currentThread->getName(), currentThread->getTID(),
+        resource->getName(), currentThread->getPriority());
+    resource->Release();
+    inversionDone->V();
+}
+
+void Hog(int which)
+{
+    for (int i = 0; i < 600; ++i)
+        interrupt->OneTick();
+    inversionDone->V();
+}
+
+void Waiter(int which)
+{
+    int start = stats->totalTicks;
+
+    resource->Acquire();
+    printf("Thread \"%s\" (tid: %d) waited %d ticks for %s\n",
+        currentThread->getName(), currentThread->getTID(),
+        stats->totalTicks - start, resource->getName());
+    resource->Release();
+    inversionDone->V();
+}
+
+void
+InversionTest()
+{
+    Thread *t;
+
+    resource = new Lock("resource");
+    inversionDone = new Semaphore("inversion done", 0);
+    t = new Thread("low");
+    t->setPriority(2);
+    t->Fork(Holder, 0);
+    for (int i = 0; i < 3; ++i) {
+        t = new Thread("medium");
+        t->setPriority(20);
+        t->Fork(Hog, i);
+    }
+    t = new Thread("high");
+    t->setPriority(40);
+    t->Fork(Waiter, 0);
+    for (int i = 0; i < 5; ++i)
+        inversionDone->P();
+}
+
+//----------------------------------------------------------------------
+// TimeoutTest
+//  Wait on a semaphore with a time limit, once when it is V'ed in time
+//  and once when it isn't, and try for a lock that is busy.  Then the
+//  same for a condition, and sleep while no one else is running.
+//----------------------------------------------------------------------
+Semaphore *ping;
+Lock *busyLock;
+Condition *pinged;
+
+void Pinger(int which)
+{
+    printf("Pinger: lock is %s\n", busyLock->TryAcquire() ? "free" : "busy");
+    currentThread->SleepFor(200);
+    ping->V();
+}
+
+void CondPinger(int which)
+{
+    currentThread->SleepFor(200);
+    busyLock->Acquire();
+    pinged->Signal(busyLock);
+    busyLock->Release();
+}
+
+void
+TimeoutTest()
+{
+    Thread *t = new Thread("pinger");
+    int start = stats->totalTicks;
+    bool gotIt;
+
+    ping = new Semaphore("ping", 0);
+    busyLock = new Lock("busy");
+    busyLock->Acquire();
+    t->Fork(Pinger, 0);
+    gotIt = ping->TimedP(1000);
+    printf("TimedP(1000): %s after %d ticks\n", gotIt ? "got it" : "timed out",
+        stats->totalTicks - start);
+    start = stats->totalTicks;
+    gotIt = ping->TimedP(500);
+    printf("TimedP(500): %s after %d ticks\n", gotIt ? "got it" : "timed out",
+        stats->totalTicks - start);
+    busyLock->Release();
+    printf("Main: lock is %s\n", busyLock->TryAcquire() ? "free" : "busy");
+
+    pinged = new Condition("pinged");
+    t = new Thread("cond pinger");
+    t->Fork(CondPinger, 0);
+    start = stats->totalTicks;
+    gotIt = pinged->TimedWait(busyLock, 1000);
+    printf("TimedWait(1000): %s after %d ticks\n",
+        gotIt ? "signalled" : "timed out", stats->totalTicks - start);
+    start = stats->totalTicks;
+    gotIt = pinged->TimedWait(busyLock, 500);
+    printf("TimedWait(500): %s after %d ticks\n",
+        gotIt ? "signalled" : "timed out", stats->totalTicks - start);
+    busyLock->Release();
+
+    start = stats->totalTicks;
+    currentThread->SleepFor(5000);
+    printf("SleepFor(5000): woke after %d ticks\n", stats->totalTicks - start);
+}
+
 void
 ThreadTest()
 {
@@ -464,6 +735,30 @@ ThreadTest()
     case 1:
         DeadLockTest();
         break;
+    case 2:
+        ThreadTest2();
+        break;
+    case 3:
+        ThreadPoolTest();
+        break;
+    case 4:
+        SMPTest();
+        break;
+    case 5:
+        ShareTest();
+        break;
+    case 6:
+        InversionTest();
+        break;
+    case 7:
+        ProducerAndConsumer();
+        break;
+    case 8:
+        TimeoutTest();
+        break;
+    case 9:
+        NewReaderAndWriter();
+        break;
     default:
         printf("No test specified.\n");
         break;
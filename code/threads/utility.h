@@ -13,6 +13,7 @@
 //   	'm' -- machine emulation (USER_PROGRAM)
 //   	'd' -- disk emulation (FILESYS)
 //   	'f' -- file system (FILESYS)
+//   	'j' -- file system journal (FILESYS)
 //   	'a' -- address spaces (USER_PROGRAM)
 //   	'n' -- network emulation (NETWORK)
 //
@@ -19,6 +19,7 @@
 #include "system.h"
 #include "addrspace.h"
 #include "noff.h"
+#include "syscall.h"
 #ifdef HOST_SPARC
 #include <strings.h>
 #endif
@@ -188,16 +189,20 @@ AddrSpace::AddrSpace(OpenFile *executable)
     //     machine->reverseTable[i].dirty = FALSE;
     //     machine->reverseTable[i].readOnly = FALSE;
     // }
+    for (i = 0; i < MaxOpenFiles; i++)
+	openFiles[i] = NULL;
     refCnt = 1;
 }
 
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
-// 	Dealloate an address space.  Nothing for now!
+// 	Dealloate an address space, closing any files left open.
 //----------------------------------------------------------------------
 
 AddrSpace::~AddrSpace()
 {
+    for (int i = 0; i < MaxOpenFiles; i++)
+	delete openFiles[i];		// close what the program left open
     for (int i = 0; i < numPages; ++i)
         memoryMap->Clear(pageTable[i].physicalPage);
    delete pageTable;
@@ -269,4 +274,43 @@ void AddrSpace::ForkInitRegisters(int addr)
     machine->WriteRegister(PCReg, addr);
     machine->WriteRegister(NextPCReg, addr + 4);
     machine->WriteRegister(StackReg, numPages * PageSize - 16 - 128 * (refCnt - 1));
-}
\ No newline at end of file
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AddFile, AddrSpace::GetFile, AddrSpace::RemoveFile
+// 	Manage the files the program has open.  The OpenFileId a program
+//	is given is an index into this table, so it can only name files
+//	it has opened itself; and each entry is one OpenFile, which keeps
+//	the seek position from one Read or Write to the next.
+//
+//	OpenFileIds 0 and 1 are the console, and are never in the table.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::AddFile(OpenFile *file)
+{
+    for (int fd = ConsoleOutput + 1; fd < MaxOpenFiles; fd++)
+	if (openFiles[fd] == NULL) {
+	    openFiles[fd] = file;
+	    return fd;
+	}
+    return -1;
+}
+
+OpenFile *
+AddrSpace::GetFile(int fd)
+{
+    if (fd < 0 || fd >= MaxOpenFiles)
+	return NULL;
+    return openFiles[fd];
+}
+
+OpenFile *
+AddrSpace::RemoveFile(int fd)
+{
+    OpenFile *file = GetFile(fd);
+
+    if (file != NULL)
+	openFiles[fd] = NULL;
+    return file;
+}
@@ -17,6 +17,8 @@
 #include "filesys.h"
 
 #define UserStackSize		1024 	// increase this as necessary!
+#define MaxOpenFiles		16	// open files per address space,
+					// counting the console (cf. syscall.h)
 
 class AddrSpace {
   public:
@@ -33,8 +35,17 @@ class AddrSpace {
 
     void ForkInitRegisters(int addr);
 
+    int AddFile(OpenFile *file);	// Put file in the open-file table,
+					// and return its OpenFileId (-1 if
+					// the table is full)
+    OpenFile *GetFile(int fd);		// The file open as "fd", NULL if
+					// there is none
+    OpenFile *RemoveFile(int fd);	// Take it out of the table
+
     int refCnt;
   private:
+    OpenFile *openFiles[MaxOpenFiles];	// indexed by OpenFileId; the
+					// console's entries stay NULL
     TranslationEntry *tlb;
     TranslationEntry *pageTable;	// Assume linear page table translation
 					// for now!
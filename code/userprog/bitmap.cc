@@ -164,6 +164,26 @@ BitMap::WriteBack(OpenFile *file)
    file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
 }
 
+//----------------------------------------------------------------------
+// BitMap::FetchFrom/WriteBack
+// 	Copy the contents of a bitmap from/to a buffer in memory, which
+//	must have room for numWords words.
+//
+//	"data" is the buffer to copy from/to
+//----------------------------------------------------------------------
+
+void
+BitMap::FetchFrom(char *data)
+{
+    bcopy(data, (char *)map, numWords * sizeof(unsigned));
+}
+
+void
+BitMap::WriteBack(char *data)
+{
+    bcopy((char *)map, data, numWords * sizeof(unsigned));
+}
+
 float
 BitMap::MarkRate()
 {
@@ -51,6 +51,8 @@ class BitMap {
     // write the bitmap to a file
     void FetchFrom(OpenFile *file); 	// fetch contents from disk 
     void WriteBack(OpenFile *file); 	// write contents to disk
+    void FetchFrom(char *data);		// ... or from/to a buffer, such
+    void WriteBack(char *data);		// as a sector read from disk
     float MarkRate();
 
   private:
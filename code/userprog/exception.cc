@@ -66,6 +66,10 @@ ExceptionHandler(ExceptionType which)
     if (which == SyscallException) {
         if ((type == SC_Halt)) {
         	DEBUG('a', "Shutdown, initiated by user program.\n");
+#ifdef FILESYS
+        	fileSystem->Unmount();		// flush the journal, and mark
+						// the file system clean
+#endif
         	interrupt->Halt();
         } else if (type == SC_Create) {
             int base = machine->ReadRegister(4);
@@ -102,25 +106,26 @@ ExceptionHandler(ExceptionType which)
                 fileName[i] = (char)value;
             }
             OpenFile* file = fileSystem->Open(fileName);
-            int fd = file->getFd();
+            int fd = -1;
             if (file != NULL) {
-                machine->WriteRegister(2, fd);
-                printf("Open file %s success! fd: %d\n", fileName, fd);
+                fd = currentThread->space->AddFile(file);
+                if (fd == -1)
+                    delete file;        // too many files open
             }
-            else {
-                machine->WriteRegister(2, -1);
+            machine->WriteRegister(2, fd);
+            if (fd != -1)
+                printf("Open file %s success! fd: %d\n", fileName, fd);
+            else
                 printf("Open file %s failed!\n", fileName);
-            }
             machine->AdvancePC();
         } else if (type == SC_Close) {
             int fd = machine->ReadRegister(4);
-            Close(fd);
-            #ifdef FILESYS
-            fileSystem->refCnt[fd]--;
-            if (fileSystem->refCnt[fd] == 0)
-                strcpy(fileSystem->openFileNames[fd], "");
-            #endif
-            printf("Close file (fd:%d) success!\n", fd);
+            OpenFile* file = currentThread->space->RemoveFile(fd);
+            if (file != NULL) {
+                delete file;
+                printf("Close file (fd:%d) success!\n", fd);
+            } else
+                printf("Close file (fd:%d) failed!\n", fd);
             machine->AdvancePC();
         } else if (type == SC_Write) {
             int base = machine->ReadRegister(4);
@@ -138,25 +143,30 @@ ExceptionHandler(ExceptionType which)
                 machine->ReadMem(base+i, 1, &value);
                 tmp[i] = (char)value;
             }
-            OpenFile* file = new OpenFile(fd);
-            file->Write(tmp, size);
-            delete file;
-            printf("Write file (fd: %d) success!\n", fd);
+            OpenFile* file = currentThread->space->GetFile(fd);
+            if (file != NULL) {
+                file->Write(tmp, size);
+                printf("Write file (fd: %d) success!\n", fd);
+            } else
+                printf("Write file (fd: %d) failed!\n", fd);
             machine->AdvancePC();
         } else if (type == SC_Read) {
             int base = machine->ReadRegister(4);
             int size = machine->ReadRegister(5);
             int fd = machine->ReadRegister(6);
-            char tmp[size];
-            int readnum;
-            OpenFile* file = new OpenFile(fd);
-            readnum = file->Read(tmp, size);
-            for (int i = 0; i < size; ++i)
-                machine->WriteMem(base, 1, tmp[i]);
-            delete file;
+            char tmp[size + 1];
+            int readnum = -1;
+            OpenFile* file = currentThread->space->GetFile(fd);
+            if (file != NULL) {
+                readnum = file->Read(tmp, size);
+                for (int i = 0; i < readnum; ++i)
+                    machine->WriteMem(base + i, 1, tmp[i]);
+                tmp[readnum] = '\0';
+                printf("Read file (fd: %d) success!\n", fd);
+                printf("Read content: %s\n", tmp);
+            } else
+                printf("Read file (fd: %d) failed!\n", fd);
             machine->WriteRegister(2, readnum);
-            printf("Read file (fd: %d) success!\n", fd);
-            printf("Read content: %s\n", tmp);
             machine->AdvancePC();
         } else if (type == SC_Exit) {
             int arg = machine->ReadRegister(4);
@@ -193,13 +203,18 @@ ExceptionHandler(ExceptionType which)
             ASSERT(FALSE);          // machine->Run never returns;
         } else if (type == SC_Join) {
             int tid = machine->ReadRegister(4);
-            ASSERT(tid < MAX_THREAD_NUM);
-            ASSERT(threadTable[tid] != NULL);
-            threadTable[tid]->addToJoinList(currentThread);
+            Thread *t = threadTable->Lookup(tid);
             machine->AdvancePC();
-            currentThread->Sleep();
-            int exitState = currentThread->getJoinState();
-            machine->WriteRegister(2, exitState);
+            if (t == NULL || t->getStatus() == ZOMBIE) {  // already gone
+                machine->WriteRegister(2, -1);
+            } else {
+                IntStatus oldLevel = interrupt->SetLevel(IntOff);
+                t->addToJoinList(currentThread);
+                currentThread->Sleep();
+                (void) interrupt->SetLevel(oldLevel);
+                int exitState = currentThread->getJoinState();
+                machine->WriteRegister(2, exitState);
+            }
         } else if (type == SC_Fork) {
             int addr = machine->ReadRegister(4);
             Thread *t = new Thread("forked userprog");
@@ -212,6 +227,10 @@ ExceptionHandler(ExceptionType which)
             machine->AdvancePC();
             printf("thread \"%s\" is yielding\n", currentThread->getName());
             currentThread->Yield();
+        } else if (type == SC_Sleep) {
+            int ticks = machine->ReadRegister(4);
+            machine->AdvancePC();
+            currentThread->SleepFor(ticks);
         }
     } else if (which == TLBPageFaultException) {
     	int NextPC = machine->ReadRegister(NextPCReg);
@@ -29,6 +29,7 @@
 #define SC_Close	8
 #define SC_Fork		9
 #define SC_Yield	10
+#define SC_Sleep	11
 
 #ifndef IN_ASM
 
@@ -124,6 +125,11 @@ void Fork(void (*func)());
  */
 void Yield();		
 
+/* Put the current thread to sleep for "ticks" of simulated time, without
+ * using the CPU meanwhile.
+ */
+void Sleep(int ticks);
+
 #endif /* IN_ASM */
 
 #endif /* SYSCALL_H */